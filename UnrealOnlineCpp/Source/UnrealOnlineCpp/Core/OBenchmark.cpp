@@ -0,0 +1,425 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OBenchmark.h"
+#include "OGameInstance.h"
+#include "OLoadGenerator.h"
+#include "OStats.h"
+#include "../Gameplay/OCharacterSignificance.h"
+#include "../Gameplay/OPlayerCharacter.h"
+#include "Camera/CameraActor.h"
+#include "Containers/Ticker.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerStart.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogBenchmark, Log, All);
+
+static void BenchmarkStartCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UOGameInstance* GameInstance = World ? Cast<UOGameInstance>(World->GetGameInstance()) : nullptr;
+	if (GameInstance)
+	{
+		GameInstance->GetBenchmark()->Start((Args.Num() > 0) ? FCString::Atoi(*Args[0]) : 0, -1, FString(), false);
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkStartConsoleCommand(
+	TEXT("o.Benchmark.Start"),
+	TEXT("Runs the gameplay benchmark and writes its results to Saved/Benchmark. Usage: o.Benchmark.Start [Seed]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkStartCommand));
+
+static void BenchmarkStopCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UOGameInstance* GameInstance = World ? Cast<UOGameInstance>(World->GetGameInstance()) : nullptr;
+	if (GameInstance)
+	{
+		GameInstance->GetBenchmark()->Stop();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs BenchmarkStopConsoleCommand(
+	TEXT("o.Benchmark.Stop"),
+	TEXT("Ends the running gameplay benchmark and writes what was measured."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkStopCommand));
+
+UOBenchmark::UOBenchmark()
+{
+	BenchmarkMap = TEXT("/Game/FirstPersonCPP/Maps/BenchmarkMap");
+	NumBots = 16;
+	FixedFrameRate = 30.0f;
+	WarmupSeconds = 5.0f;
+	DurationSeconds = 60.0f;
+	BotSpawnRadius = 800.0f;
+	BotFireInterval = 0.25f;
+	BotTurnRate = 0.5f;
+
+	CameraPath.Add(FVector(-1500.0f, -1500.0f, 600.0f));
+	CameraPath.Add(FVector(1500.0f, -1500.0f, 600.0f));
+	CameraPath.Add(FVector(1500.0f, 1500.0f, 300.0f));
+	CameraPath.Add(FVector(-1500.0f, 1500.0f, 300.0f));
+	CameraSpeed = 400.0f;
+	CameraTarget = FVector::ZeroVector;
+
+	Camera = nullptr;
+	Seed = 0;
+	NumRunBots = 0;
+	bExitWhenDone = false;
+	bWaitingForMap = false;
+	NumSimulatedFrames = 0;
+	LastFrameTime = 0.0;
+	bWasBenchmarking = false;
+	PreviousFixedDeltaTime = 0.0;
+}
+
+void UOBenchmark::BeginDestroy()
+{
+	if (TickHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+		TickHandle.Reset();
+	}
+
+	Super::BeginDestroy();
+}
+
+UWorld* UOBenchmark::GetGameWorld() const
+{
+	const UOGameInstance* OwningGameInstance = GetTypedOuter<UOGameInstance>();
+	return OwningGameInstance ? OwningGameInstance->GetWorld() : nullptr;
+}
+
+void UOBenchmark::Start(int32 InSeed, int32 InNumBots, const FString& InOutputPath, bool bInExitWhenDone)
+{
+	UWorld* World = GetGameWorld();
+	if (IsRunning() || World == nullptr)
+	{
+		UE_LOG(LogBenchmark, Warning, TEXT("Benchmark %s"), IsRunning() ? TEXT("already runs") : TEXT("needs a world"));
+		return;
+	}
+
+	Seed = InSeed;
+	NumRunBots = (InNumBots >= 0) ? InNumBots : NumBots;
+	OutputPath = InOutputPath;
+	bExitWhenDone = bInExitWhenDone;
+
+	// Every frame advances the game by the same time, however long it took, so a seed always plays out the same way
+	bWasBenchmarking = FApp::IsBenchmarking();
+	PreviousFixedDeltaTime = FApp::GetFixedDeltaTime();
+	FApp::SetBenchmarking(true);
+	FApp::SetFixedDeltaTime(1.0 / FMath::Max(FixedFrameRate, 1.0f));
+
+	FMath::RandInit(Seed);
+	FMath::SRandInit(Seed);
+
+	const bool bIsOnBenchmarkMap = BenchmarkMap.IsEmpty() || World->GetOutermost()->GetName() == BenchmarkMap;
+	bWaitingForMap = !bIsOnBenchmarkMap && FPackageName::DoesPackageExist(BenchmarkMap);
+
+	if (bWaitingForMap)
+	{
+		UE_LOG(LogBenchmark, Log, TEXT("Loading %s for the benchmark"), *BenchmarkMap);
+		UGameplayStatics::OpenLevel(World, FName(*BenchmarkMap));
+	}
+	else if (!bIsOnBenchmarkMap)
+	{
+		UE_LOG(LogBenchmark, Warning, TEXT("%s does not exist, running the benchmark on %s"), *BenchmarkMap, *World->GetOutermost()->GetName());
+	}
+
+	TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UOBenchmark::Tick));
+
+	if (!bWaitingForMap)
+	{
+		BeginRun(World);
+	}
+}
+
+void UOBenchmark::BeginRun(UWorld* World)
+{
+	UE_LOG(LogBenchmark, Log, TEXT("Benchmark on %s: seed %d, %d bots, %.0f fps fixed step, %.0f s warm-up, %.0f s recorded"),
+		*World->GetOutermost()->GetName(), Seed, NumRunBots, FixedFrameRate, WarmupSeconds, DurationSeconds);
+
+	SpawnBots(World);
+
+	if (CameraPath.Num() > 0)
+	{
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		Camera = World->SpawnActor<ACameraActor>(CameraPath[0], FRotator::ZeroRotator, SpawnParameters);
+
+		APlayerController* PlayerController = World->GetFirstPlayerController();
+		if (PlayerController != nullptr && Camera != nullptr)
+		{
+			PlayerController->SetViewTarget(Camera);
+		}
+	}
+
+	FrameTimesMs.Reset();
+	FrameTimesMs.Reserve(FMath::CeilToInt(DurationSeconds * FixedFrameRate));
+
+	NumSimulatedFrames = 0;
+	LastFrameTime = FPlatformTime::Seconds();
+}
+
+void UOBenchmark::SpawnBots(UWorld* World)
+{
+	const AGameModeBase* GameMode = World->GetAuthGameMode();
+	UClass* BotClass = GameMode ? GameMode->DefaultPawnClass : nullptr;
+	if (BotClass == nullptr || !BotClass->IsChildOf(AOPlayerCharacter::StaticClass()))
+	{
+		UE_LOG(LogBenchmark, Warning, TEXT("The game mode's pawn is no player character, running without bots"));
+		return;
+	}
+
+	TActorIterator<APlayerStart> PlayerStartIt(World);
+	const FVector Center = PlayerStartIt ? PlayerStartIt->GetActorLocation() : FVector::ZeroVector;
+
+	FRandomStream RandomStream(Seed);
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	for (int32 BotIdx = 0; BotIdx < NumRunBots; BotIdx++)
+	{
+		const float Angle = 2.0f * PI * BotIdx / NumRunBots;
+		const FVector Location = Center + FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.0f) * BotSpawnRadius;
+
+		// Bots face the center, so their shots cross the arena
+		AOPlayerCharacter* Bot = World->SpawnActor<AOPlayerCharacter>(BotClass, Location, (Center - Location).Rotation(), SpawnParameters);
+		if (Bot == nullptr)
+		{
+			continue;
+		}
+
+		// AI controllers move the character but ignore turn input, turning patterns run straight
+		Bot->SpawnDefaultController();
+
+		Bots.Add(Bot);
+		BotPhases.Add(RandomStream.FRandRange(0.0f, 2.0f * PI));
+		BotNextFireTimes.Add(RandomStream.FRandRange(0.0f, BotFireInterval));
+	}
+}
+
+bool UOBenchmark::Tick(float DeltaTime)
+{
+	UWorld* World = GetGameWorld();
+	if (World == nullptr)
+	{
+		return true;
+	}
+
+	if (bWaitingForMap)
+	{
+		if (World->GetOutermost()->GetName() != BenchmarkMap || !World->HasBegunPlay())
+		{
+			return true;
+		}
+
+		bWaitingForMap = false;
+		BeginRun(World);
+		return true;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	const float RunTime = NumSimulatedFrames / FixedFrameRate;
+	const int32 NumWarmupFrames = FMath::CeilToInt(WarmupSeconds * FixedFrameRate);
+	const int32 NumRecordedFrames = FMath::CeilToInt(DurationSeconds * FixedFrameRate);
+
+	if (NumSimulatedFrames == NumWarmupFrames)
+	{
+		FOCycleCounter::ResetAll();
+		FOCycleCounter::SetRecording(true);
+	}
+	else if (NumSimulatedFrames > NumWarmupFrames)
+	{
+		FrameTimesMs.Add((Now - LastFrameTime) * 1000.0);
+	}
+
+	LastFrameTime = Now;
+
+	if (NumSimulatedFrames >= NumWarmupFrames + NumRecordedFrames)
+	{
+		Stop();
+		return false;
+	}
+
+	DriveBots(RunTime);
+	UpdateCamera(RunTime);
+
+	NumSimulatedFrames++;
+
+	return true;
+}
+
+void UOBenchmark::DriveBots(float RunTime)
+{
+	for (int32 BotIdx = 0; BotIdx < Bots.Num(); BotIdx++)
+	{
+		AOPlayerCharacter* Bot = Bots[BotIdx];
+		if (Bot == nullptr || Bot->IsPendingKill())
+		{
+			continue;
+		}
+
+		UOLoadGenerator::DrivePattern(Bot, BotIdx % UOLoadGenerator::NumPatterns, RunTime + BotPhases[BotIdx], BotTurnRate);
+
+		if (RunTime >= BotNextFireTimes[BotIdx])
+		{
+			Bot->OnFire();
+			BotNextFireTimes[BotIdx] = RunTime + BotFireInterval;
+		}
+	}
+}
+
+void UOBenchmark::UpdateCamera(float RunTime)
+{
+	if (Camera == nullptr || CameraPath.Num() == 0)
+	{
+		return;
+	}
+
+	float PathLength = 0.0f;
+	for (int32 PointIdx = 0; PointIdx < CameraPath.Num(); PointIdx++)
+	{
+		PathLength += FVector::Dist(CameraPath[PointIdx], CameraPath[(PointIdx + 1) % CameraPath.Num()]);
+	}
+
+	FVector Location = CameraPath[0];
+	float Distance = (PathLength > 0.0f) ? FMath::Fmod(RunTime * CameraSpeed, PathLength) : 0.0f;
+
+	for (int32 PointIdx = 0; PointIdx < CameraPath.Num(); PointIdx++)
+	{
+		const FVector& From = CameraPath[PointIdx];
+		const FVector& To = CameraPath[(PointIdx + 1) % CameraPath.Num()];
+		const float SegmentLength = FVector::Dist(From, To);
+
+		if (Distance <= SegmentLength)
+		{
+			Location = (SegmentLength > 0.0f) ? FMath::Lerp(From, To, Distance / SegmentLength) : From;
+			break;
+		}
+
+		Distance -= SegmentLength;
+	}
+
+	Camera->SetActorLocationAndRotation(Location, (CameraTarget - Location).Rotation());
+}
+
+void UOBenchmark::Stop()
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+	TickHandle.Reset();
+
+	FOCycleCounter::SetRecording(false);
+
+	if (!bWaitingForMap)
+	{
+		WriteResults();
+	}
+
+	EndRun();
+
+	if (bExitWhenDone)
+	{
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+void UOBenchmark::WriteResults() const
+{
+	const UWorld* World = GetGameWorld();
+	const FString MapName = World ? World->GetOutermost()->GetName() : FString();
+
+	TArray<float> SortedFrameTimesMs = FrameTimesMs;
+	SortedFrameTimesMs.Sort();
+
+	auto Percentile = [&SortedFrameTimesMs](float Fraction)
+	{
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Fraction * SortedFrameTimesMs.Num()) - 1, 0, SortedFrameTimesMs.Num() - 1);
+		return SortedFrameTimesMs.Num() > 0 ? SortedFrameTimesMs[Index] : 0.0f;
+	};
+
+	float FrameTimeSumMs = 0.0f;
+	for (float FrameTimeMs : SortedFrameTimesMs)
+	{
+		FrameTimeSumMs += FrameTimeMs;
+	}
+
+	const int32 NumFrames = SortedFrameTimesMs.Num();
+	const float AverageFrameTimeMs = (NumFrames > 0) ? FrameTimeSumMs / NumFrames : 0.0f;
+
+	// One row per value: Section,Name,Value,Calls. Counter values are total milliseconds
+	FString Csv = TEXT("Section,Name,Value,Calls\n");
+	Csv += FString::Printf(TEXT("Run,Map,%s,\n"), *MapName);
+	Csv += FString::Printf(TEXT("Run,Seed,%d,\n"), Seed);
+	Csv += FString::Printf(TEXT("Run,Bots,%d,\n"), Bots.Num());
+	Csv += FString::Printf(TEXT("Run,Significance,%d,\n"), AOCharacterSignificance::IsEnabled() ? 1 : 0);
+	Csv += FString::Printf(TEXT("Run,FixedFrameRate,%.1f,\n"), FixedFrameRate);
+	Csv += FString::Printf(TEXT("Run,Frames,%d,\n"), NumFrames);
+	Csv += FString::Printf(TEXT("FrameTime,AverageMs,%.3f,\n"), AverageFrameTimeMs);
+	Csv += FString::Printf(TEXT("FrameTime,P50Ms,%.3f,\n"), Percentile(0.5f));
+	Csv += FString::Printf(TEXT("FrameTime,P90Ms,%.3f,\n"), Percentile(0.9f));
+	Csv += FString::Printf(TEXT("FrameTime,P95Ms,%.3f,\n"), Percentile(0.95f));
+	Csv += FString::Printf(TEXT("FrameTime,P99Ms,%.3f,\n"), Percentile(0.99f));
+	Csv += FString::Printf(TEXT("FrameTime,MaxMs,%.3f,\n"), Percentile(1.0f));
+
+	for (const FOCycleCounter* Counter = FOCycleCounter::GetFirst(); Counter != nullptr; Counter = Counter->GetNext())
+	{
+		Csv += FString::Printf(TEXT("Counter,%s,%.3f,%lld\n"), Counter->GetName(),
+			FPlatformTime::ToMilliseconds64(static_cast<uint64>(Counter->GetTotalCycles())), Counter->GetNumCalls());
+	}
+
+	const FString FilePath = !OutputPath.IsEmpty() ? OutputPath
+		: FPaths::ProjectSavedDir() / TEXT("Benchmark") / FString::Printf(TEXT("%s-%d.csv"), *FPackageName::GetShortName(MapName), Seed);
+
+	if (FFileHelper::SaveStringToFile(Csv, *FilePath))
+	{
+		UE_LOG(LogBenchmark, Log, TEXT("Benchmark: %d frames, %.2f ms average, %.2f ms p50, %.2f ms p99, written to %s"),
+			NumFrames, AverageFrameTimeMs, Percentile(0.5f), Percentile(0.99f), *FilePath);
+	}
+	else
+	{
+		UE_LOG(LogBenchmark, Error, TEXT("Failed to write the benchmark results to %s"), *FilePath);
+	}
+}
+
+void UOBenchmark::EndRun()
+{
+	for (AOPlayerCharacter* Bot : Bots)
+	{
+		if (Bot != nullptr && !Bot->IsPendingKill())
+		{
+			if (AController* BotController = Bot->GetController())
+			{
+				BotController->Destroy();
+			}
+
+			Bot->Destroy();
+		}
+	}
+
+	if (Camera != nullptr && !Camera->IsPendingKill())
+	{
+		Camera->Destroy();
+	}
+
+	Bots.Empty();
+	BotPhases.Empty();
+	BotNextFireTimes.Empty();
+	Camera = nullptr;
+	bWaitingForMap = false;
+
+	FApp::SetBenchmarking(bWasBenchmarking);
+	FApp::SetFixedDeltaTime(PreviousFixedDeltaTime);
+}
@@ -0,0 +1,140 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "OBenchmark.generated.h"
+
+class ACameraActor;
+class AOPlayerCharacter;
+
+/**
+ * Reproducible gameplay benchmark. A run loads BenchmarkMap, seeds every random stream, steps the game with a fixed
+ * delta time and spawns AI controlled bots that play the scripted patterns of the load generator, while the view
+ * follows a fixed camera path. After the warm-up it records the real time of every frame and the totals of the
+ * cycle counters of this module, and writes frame time percentiles and counter totals to a CSV file.
+ *
+ * Headless: -game -nullrhi -nosound -unattended -GameplayBenchmark [-BenchmarkSeed=<Seed>] [-BenchmarkBots=<Count>]
+ * [-BenchmarkOutput=<File>], the process exits once the file is written. In a running game: o.Benchmark.Start [Seed].
+ * Compare a setting by running the same seed with -ExecCmds="<Setting> 0" and "<Setting> 1", for example the savings of
+ * o.Significance.Enabled with -BenchmarkBots=64.
+ */
+UCLASS(config = Game)
+class UNREALONLINECPP_API UOBenchmark : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UOBenchmark();
+
+	virtual void BeginDestroy() override;
+
+	/**
+	 * Starts a run, loading BenchmarkMap first if the world shows another map.
+	 *
+	 * @param InSeed: seed of every random stream of the run, the same seed gives the same simulation.
+	 * @param InNumBots: number of bots, negative for NumBots.
+	 * @param InOutputPath: file to write, empty for Saved/Benchmark/<Map>-<Seed>.csv.
+	 * @param bInExitWhenDone: requests engine exit once the results are written.
+	 */
+	void Start(int32 InSeed, int32 InNumBots, const FString& InOutputPath, bool bInExitWhenDone);
+
+	// Ends a run early and writes what was measured so far.
+	void Stop();
+
+	FORCEINLINE bool IsRunning() const { return TickHandle.IsValid(); }
+
+private:
+	bool Tick(float DeltaTime);
+
+	// Spawns bots and camera once the benchmark map is up.
+	void BeginRun(UWorld* World);
+
+	void SpawnBots(UWorld* World);
+
+	void DriveBots(float RunTime);
+
+	// Moves the camera along CameraPath, looping.
+	void UpdateCamera(float RunTime);
+
+	void WriteResults() const;
+
+	// Destroys bots and camera and gives the engine back its own time step.
+	void EndRun();
+
+	UWorld* GetGameWorld() const;
+
+public:
+	// Map of a run, the current map is used if this one does not exist.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	FString BenchmarkMap;
+
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	int32 NumBots;
+
+	// Simulated frames per second, every frame advances the game by the same delta time.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	float FixedFrameRate;
+
+	// Simulated seconds before recording starts, so loading and spawning stay out of the results.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	float WarmupSeconds;
+
+	// Simulated seconds that are recorded.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	float DurationSeconds;
+
+	// Bots spawn on a circle of this radius around the first player start.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	float BotSpawnRadius;
+
+	// Simulated seconds between two shots of a bot.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	float BotFireInterval;
+
+	// Normalized turn rate of turning bots.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	float BotTurnRate;
+
+	// Closed loop of world locations the camera flies along.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	TArray<FVector> CameraPath;
+
+	// Speed of the camera along its path in units per simulated second.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	float CameraSpeed;
+
+	// World location the camera looks at.
+	UPROPERTY(config, EditDefaultsOnly, Category = "Benchmark")
+	FVector CameraTarget;
+
+private:
+	UPROPERTY(Transient)
+	TArray<AOPlayerCharacter*> Bots;
+
+	UPROPERTY(Transient)
+	ACameraActor* Camera;
+
+	// Pattern offset and next shot time of every bot, by bot index
+	TArray<float> BotPhases;
+	TArray<float> BotNextFireTimes;
+
+	// Real milliseconds of every recorded frame
+	TArray<float> FrameTimesMs;
+
+	int32 Seed;
+	int32 NumRunBots;
+	FString OutputPath;
+	bool bExitWhenDone;
+
+	bool bWaitingForMap;
+	int32 NumSimulatedFrames;
+	double LastFrameTime;
+
+	// Engine time step settings before the run
+	bool bWasBenchmarking;
+	double PreviousFixedDeltaTime;
+
+	FDelegateHandle TickHandle;
+};
@@ -0,0 +1,94 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "ODiagnostics.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/ThreadSafeCounter64.h"
+
+DEFINE_LOG_CATEGORY(LogOSession);
+DEFINE_LOG_CATEGORY(LogOFriends);
+
+static TAutoConsoleVariable<int32> CVarDiagMaxPerSecond(
+	TEXT("o.Diag.MaxPerSecond"),
+	5,
+	TEXT("Messages one diagnostic call site may write per second, 0 for no limit."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarDiagOnScreen(
+	TEXT("o.Diag.OnScreen"),
+	1,
+	TEXT("Mirrors diagnostic messages on screen."),
+	ECVF_Default);
+
+static FAutoConsoleCommand DiagReportCommand(
+	TEXT("o.Diag.Report"),
+	TEXT("Logs how many diagnostic messages were written and skipped since the last report."),
+	FConsoleCommandDelegate::CreateLambda([]() { FODiagnostics::LogAndResetCounts(TEXT("report")); }));
+
+namespace
+{
+	FThreadSafeCounter64 NumWritten;
+	FThreadSafeCounter64 NumSkipped;
+}
+
+bool FODiagnosticRateLimiter::Allow(int32& OutNumSuppressed)
+{
+	const int32 MaxPerSecond = CVarDiagMaxPerSecond.GetValueOnGameThread();
+	if (MaxPerSecond <= 0)
+	{
+		OutNumSuppressed = 0;
+		return true;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (Now - WindowStartTime >= 1.0)
+	{
+		WindowStartTime = Now;
+		NumInWindow = 0;
+	}
+
+	if (NumInWindow >= MaxPerSecond)
+	{
+		NumSuppressed++;
+		return false;
+	}
+
+	NumInWindow++;
+	OutNumSuppressed = NumSuppressed;
+	NumSuppressed = 0;
+
+	return true;
+}
+
+void FODiagnostics::AddScreenMessage(ELogVerbosity::Type Verbosity, const FString& Message)
+{
+	// There is no screen on dedicated servers, and no engine during early startup or shutdown
+	if (GEngine == nullptr || IsRunningDedicatedServer() || CVarDiagOnScreen.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+
+	const ELogVerbosity::Type Level = static_cast<ELogVerbosity::Type>(Verbosity & ELogVerbosity::VerbosityMask);
+	const FColor Color = (Level <= ELogVerbosity::Error) ? FColor::Red : (Level == ELogVerbosity::Warning) ? FColor::Yellow : FColor::Cyan;
+
+	GEngine->AddOnScreenDebugMessage(INDEX_NONE, 10.0f, Color, Message);
+}
+
+void FODiagnostics::CountWritten()
+{
+	NumWritten.Increment();
+}
+
+void FODiagnostics::CountSkipped()
+{
+	NumSkipped.Increment();
+}
+
+void FODiagnostics::LogAndResetCounts(const TCHAR* Label)
+{
+	const int64 Written = NumWritten.Reset();
+	const int64 Skipped = NumSkipped.Reset();
+
+	UE_LOG(LogOSession, Log, TEXT("Diagnostics (%s): %lld messages written, %lld skipped without formatting, saving %lld string allocations"),
+		Label, Written, Skipped, Skipped);
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Diagnostics are compiled out of shipping builds unless the target defines O_DIAGNOSTICS=1
+#ifndef O_DIAGNOSTICS
+#define O_DIAGNOSTICS !UE_BUILD_SHIPPING
+#endif
+
+DECLARE_LOG_CATEGORY_EXTERN(LogOSession, Log, All);
+DECLARE_LOG_CATEGORY_EXTERN(LogOFriends, Log, All);
+
+/**
+ * Limits how often one call site of O_DIAG writes. A call site may write o.Diag.MaxPerSecond messages per second,
+ * everything above that is counted and reported with the next message that gets through.
+ * Game thread only, like the online callbacks that use it.
+ */
+struct UNREALONLINECPP_API FODiagnosticRateLimiter
+{
+public:
+	/**
+	 * @param OutNumSuppressed: messages suppressed since the last one that got through, set if this one may be written.
+	 * @returns whether the message may be written now.
+	 */
+	bool Allow(int32& OutNumSuppressed);
+
+private:
+	double WindowStartTime = 0.0;
+	int32 NumInWindow = 0;
+	int32 NumSuppressed = 0;
+};
+
+/**
+ * Counters and output of the diagnostic channel. A skipped message was never formatted, which saves one string
+ * allocation and, on clients, one queued on-screen message.
+ */
+class UNREALONLINECPP_API FODiagnostics
+{
+public:
+	// Writes a formatted message to the screen of non dedicated instances if o.Diag.OnScreen is set.
+	static void AddScreenMessage(ELogVerbosity::Type Verbosity, const FString& Message);
+
+	static void CountWritten();
+
+	static void CountSkipped();
+
+	// Logs the messages written and skipped since the last call, Label names the span they cover.
+	static void LogAndResetCounts(const TCHAR* Label);
+};
+
+#if O_DIAGNOSTICS
+
+/**
+ * Logs a message to a category and mirrors it on screen. Nothing is formatted if the category or verbosity is
+ * disabled, or the call site is over its rate limit.
+ */
+#define O_DIAG(CategoryName, Verbosity, Format, ...) \
+	do \
+	{ \
+		static FODiagnosticRateLimiter DiagRateLimiter; \
+		int32 DiagNumSuppressed = 0; \
+		if (UE_LOG_ACTIVE(CategoryName, Verbosity) && DiagRateLimiter.Allow(DiagNumSuppressed)) \
+		{ \
+			const FString DiagMessage = FString::Printf(Format, ##__VA_ARGS__); \
+			if (DiagNumSuppressed > 0) \
+			{ \
+				UE_LOG(CategoryName, Verbosity, TEXT("%s (%d similar suppressed)"), *DiagMessage, DiagNumSuppressed); \
+			} \
+			else \
+			{ \
+				UE_LOG(CategoryName, Verbosity, TEXT("%s"), *DiagMessage); \
+			} \
+			FODiagnostics::AddScreenMessage(ELogVerbosity::Verbosity, DiagMessage); \
+			FODiagnostics::CountWritten(); \
+		} \
+		else \
+		{ \
+			FODiagnostics::CountSkipped(); \
+		} \
+	} while (0)
+
+#else
+
+#define O_DIAG(CategoryName, Verbosity, Format, ...) do { } while (0)
+
+#endif
@@ -0,0 +1,299 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OFriendsCache.h"
+#include "HAL/IConsoleManager.h"
+#include "Interfaces/OnlinePresenceInterface.h"
+#include "OnlineSubsystemTypes.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogOFriendsCache, Log, All);
+
+namespace
+{
+	// Friend of the stand-in backend of the invite benchmark
+	class FOLocalFriend : public FOnlineFriend
+	{
+	public:
+		FOLocalFriend(const FString& InUniqueNetId, const FString& InName)
+			: UserId(MakeShared<FUniqueNetIdString>(InUniqueNetId))
+			, Name(InName)
+		{
+		}
+
+		virtual TSharedRef<const FUniqueNetId> GetUserId() const override { return UserId; }
+		virtual FString GetRealName() const override { return Name; }
+		virtual FString GetDisplayName(const FString& Platform = FString()) const override { return Name; }
+		virtual bool GetUserAttribute(const FString& AttrName, FString& OutAttrValue) const override { return false; }
+		virtual EInviteStatus::Type GetInviteStatus() const override { return EInviteStatus::Accepted; }
+		virtual const FOnlineUserPresence& GetPresence() const override { return Presence; }
+
+	private:
+		TSharedRef<const FUniqueNetId> UserId;
+		FString Name;
+		FOnlineUserPresence Presence;
+	};
+
+	// Session backend of the invite benchmark, serializes every request like a real one would before sending it
+	struct FOLocalInviteBackend
+	{
+		int32 NumRequests = 0;
+		int32 NumInvites = 0;
+		FString Payload;
+
+		void SendInvites(const TArray<TSharedRef<const FUniqueNetId>>& FriendIds)
+		{
+			Payload.Reset();
+			for (const TSharedRef<const FUniqueNetId>& FriendId : FriendIds)
+			{
+				Payload += FriendId->ToString();
+				Payload += TEXT(",");
+			}
+
+			NumRequests++;
+			NumInvites += FriendIds.Num();
+		}
+	};
+
+	TArray<TSharedRef<FOnlineFriend>> MakeLocalFriends(int32 NumFriends, int32 FirstId)
+	{
+		TArray<TSharedRef<FOnlineFriend>> Friends;
+		Friends.Reserve(NumFriends);
+
+		for (int32 FriendIdx = 0; FriendIdx < NumFriends; FriendIdx++)
+		{
+			const int32 Id = FirstId + FriendIdx;
+			Friends.Add(MakeShared<FOLocalFriend>(FString::Printf(TEXT("%lld"), 76561190000000000ll + Id), FString::Printf(TEXT("Player %d"), Id)));
+		}
+
+		return Friends;
+	}
+
+	void RunInviteBenchmark(const TArray<FString>& Args)
+	{
+		const int32 Iterations = (Args.Num() > 0) ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 20;
+		const int32 FriendCounts[] = { 10, 100, 1000 };
+
+		for (int32 NumFriends : FriendCounts)
+		{
+			const TArray<TSharedRef<FOnlineFriend>> Friends = MakeLocalFriends(NumFriends, 0);
+
+			// One percent of the friends replaced, as between two reads of a real list
+			const int32 NumChanged = FMath::Max(NumFriends / 100, 1);
+			TArray<TSharedRef<FOnlineFriend>> ChangedFriends = Friends;
+			ChangedFriends.RemoveAt(0, NumChanged);
+			ChangedFriends.Append(MakeLocalFriends(NumChanged, NumFriends));
+
+			// Every friend gets invited by name
+			TArray<FString> Names;
+			for (const TSharedRef<FOnlineFriend>& Friend : Friends)
+			{
+				Names.Add(Friend->GetRealName());
+			}
+
+			FOLocalInviteBackend LegacyBackend;
+			FOLocalInviteBackend IndexedBackend;
+			FOFriendsCache Cache;
+			double LegacySeconds = 0.0;
+			double IndexedSeconds = 0.0;
+			double FullApplySeconds = 0.0;
+			double IncrementalApplySeconds = 0.0;
+
+			for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+			{
+				// Scan of the whole list per name and one request per friend, as session starts used to do
+				double StartTime = FPlatformTime::Seconds();
+				for (const FString& Name : Names)
+				{
+					for (const TSharedRef<FOnlineFriend>& Friend : Friends)
+					{
+						if (Friend->GetRealName().Equals(Name, ESearchCase::IgnoreCase))
+						{
+							LegacyBackend.SendInvites({ Friend->GetUserId() });
+						}
+					}
+				}
+				LegacySeconds += FPlatformTime::Seconds() - StartTime;
+
+				Cache.Reset();
+				StartTime = FPlatformTime::Seconds();
+				Cache.ApplyFriendsList(Friends, StartTime);
+				FullApplySeconds += FPlatformTime::Seconds() - StartTime;
+
+				StartTime = FPlatformTime::Seconds();
+				TArray<TSharedRef<const FUniqueNetId>> FriendIds;
+				Cache.ResolveNames(Names, FriendIds);
+				IndexedBackend.SendInvites(FriendIds);
+				IndexedSeconds += FPlatformTime::Seconds() - StartTime;
+
+				StartTime = FPlatformTime::Seconds();
+				Cache.ApplyFriendsList(ChangedFriends, StartTime);
+				IncrementalApplySeconds += FPlatformTime::Seconds() - StartTime;
+			}
+
+			UE_LOG(LogOFriendsCache, Log, TEXT("Invite %d friends: scan %.3f ms (%d requests) | indexed %.3f ms (%d request) | index build %.3f ms | refresh with %d changed %.3f ms"),
+				NumFriends,
+				LegacySeconds * 1000.0 / Iterations, LegacyBackend.NumRequests / Iterations,
+				IndexedSeconds * 1000.0 / Iterations, IndexedBackend.NumRequests / Iterations,
+				FullApplySeconds * 1000.0 / Iterations,
+				NumChanged * 2, IncrementalApplySeconds * 1000.0 / Iterations);
+		}
+	}
+
+	FAutoConsoleCommand InviteBenchmarkCommand(
+		TEXT("o.Friends.InviteBenchmark"),
+		TEXT("Times inviting 10, 100 and 1000 friends of a local stand-in backend by scanning the list and through the friends cache. Args: [Iterations]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunInviteBenchmark));
+}
+
+FOFriendsCache::FApplyStats FOFriendsCache::ApplyFriendsList(const TArray<TSharedRef<FOnlineFriend>>& NewFriends, double Now)
+{
+	FApplyStats Stats;
+
+	TSet<FString> SeenIds;
+	SeenIds.Reserve(NewFriends.Num());
+
+	TArray<FString, TInlineAllocator<2>> Names;
+
+	for (const TSharedRef<FOnlineFriend>& Friend : NewFriends)
+	{
+		const FString UniqueNetId = Friend->GetUserId()->ToString();
+		SeenIds.Add(UniqueNetId);
+
+		Names.Reset();
+		GetNormalizedNames(*Friend, Names);
+
+		TSharedRef<FOnlineFriend>* ExistingFriend = FriendsById.Find(UniqueNetId);
+		if (ExistingFriend != nullptr)
+		{
+			// Backends may hand out new objects for the same friend, the index keeps the latest one
+			*ExistingFriend = Friend;
+
+			if (NamesById.FindChecked(UniqueNetId) != Names)
+			{
+				RemoveNames(UniqueNetId);
+				AddNames(UniqueNetId, Names);
+				Stats.NumRenamed++;
+			}
+			continue;
+		}
+
+		FriendsById.Add(UniqueNetId, Friend);
+		AddNames(UniqueNetId, Names);
+		Stats.NumAdded++;
+	}
+
+	if (SeenIds.Num() != FriendsById.Num())
+	{
+		for (auto It = FriendsById.CreateIterator(); It; ++It)
+		{
+			if (!SeenIds.Contains(It.Key()))
+			{
+				RemoveNames(It.Key());
+				It.RemoveCurrent();
+				Stats.NumRemoved++;
+			}
+		}
+	}
+
+	LastApplyTime = Now;
+	bStale = false;
+
+	return Stats;
+}
+
+TSharedPtr<FOnlineFriend> FOFriendsCache::FindById(const FString& UniqueNetId) const
+{
+	const TSharedRef<FOnlineFriend>* Friend = FriendsById.Find(UniqueNetId);
+	return Friend ? TSharedPtr<FOnlineFriend>(*Friend) : TSharedPtr<FOnlineFriend>();
+}
+
+void FOFriendsCache::FindByName(const FString& Name, TArray<TSharedRef<FOnlineFriend>>& OutFriends) const
+{
+	TArray<FString, TInlineAllocator<4>> UniqueNetIds;
+	IdsByName.MultiFind(NormalizeName(Name), UniqueNetIds);
+
+	for (const FString& UniqueNetId : UniqueNetIds)
+	{
+		OutFriends.Add(FriendsById.FindChecked(UniqueNetId));
+	}
+}
+
+int32 FOFriendsCache::ResolveNames(const TArray<FString>& Names, TArray<TSharedRef<const FUniqueNetId>>& OutIds) const
+{
+	TSet<FString> ResolvedIds;
+	TArray<FString, TInlineAllocator<4>> UniqueNetIds;
+
+	for (const FString& Name : Names)
+	{
+		UniqueNetIds.Reset();
+		IdsByName.MultiFind(NormalizeName(Name), UniqueNetIds);
+
+		for (const FString& UniqueNetId : UniqueNetIds)
+		{
+			bool bAlreadyResolved = false;
+			ResolvedIds.Add(UniqueNetId, &bAlreadyResolved);
+
+			if (!bAlreadyResolved)
+			{
+				OutIds.Add(FriendsById.FindChecked(UniqueNetId)->GetUserId());
+			}
+		}
+	}
+
+	return ResolvedIds.Num();
+}
+
+bool FOFriendsCache::NeedsRefresh(double Now, float RefreshInterval) const
+{
+	return bStale || !HasRead() || Now - LastApplyTime >= RefreshInterval;
+}
+
+void FOFriendsCache::Reset()
+{
+	FriendsById.Empty();
+	NamesById.Empty();
+	IdsByName.Empty();
+	LastApplyTime = 0.0;
+	bStale = true;
+}
+
+FString FOFriendsCache::NormalizeName(const FString& Name)
+{
+	return Name.TrimStartAndEnd().ToLower();
+}
+
+void FOFriendsCache::GetNormalizedNames(const FOnlineFriend& Friend, TArray<FString, TInlineAllocator<2>>& OutNames)
+{
+	const FString RealName = NormalizeName(Friend.GetRealName());
+	if (!RealName.IsEmpty())
+	{
+		OutNames.Add(RealName);
+	}
+
+	const FString DisplayName = NormalizeName(Friend.GetDisplayName());
+	if (!DisplayName.IsEmpty())
+	{
+		OutNames.AddUnique(DisplayName);
+	}
+}
+
+void FOFriendsCache::AddNames(const FString& UniqueNetId, const TArray<FString, TInlineAllocator<2>>& Names)
+{
+	for (const FString& Name : Names)
+	{
+		IdsByName.Add(Name, UniqueNetId);
+	}
+
+	NamesById.Add(UniqueNetId, Names);
+}
+
+void FOFriendsCache::RemoveNames(const FString& UniqueNetId)
+{
+	TArray<FString, TInlineAllocator<2>> Names;
+	if (NamesById.RemoveAndCopyValue(UniqueNetId, Names))
+	{
+		for (const FString& Name : Names)
+		{
+			IdsByName.RemoveSingle(Name, UniqueNetId);
+		}
+	}
+}
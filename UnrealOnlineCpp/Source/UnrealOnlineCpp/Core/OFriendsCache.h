@@ -0,0 +1,80 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/OnlineFriendsInterface.h"
+
+/**
+ * Friends list of one local user, indexed by unique net id and by normalized name so an invite resolves its friends
+ * without scanning the list. Applying a new list from the backend diffs it against the index and only touches the
+ * friends that were added, removed or renamed. The owner decides when to read the list again, see NeedsRefresh.
+ * Game thread only.
+ *
+ * o.Friends.InviteBenchmark [Iterations] times the invite and refresh paths against a local stand-in backend with
+ * 10, 100 and 1000 friends.
+ */
+class UNREALONLINECPP_API FOFriendsCache
+{
+public:
+	// Friends that changed in one ApplyFriendsList.
+	struct FApplyStats
+	{
+		int32 NumAdded = 0;
+		int32 NumRemoved = 0;
+		int32 NumRenamed = 0;
+	};
+
+	/**
+	 * Brings the index up to date with a list read from the backend.
+	 *
+	 * @param NewFriends: complete friends list, friends missing from it are removed.
+	 * @param Now: time of the read, in FPlatformTime::Seconds.
+	 */
+	FApplyStats ApplyFriendsList(const TArray<TSharedRef<FOnlineFriend>>& NewFriends, double Now);
+
+	// Returns the friend with a unique net id, as returned by FUniqueNetId::ToString.
+	TSharedPtr<FOnlineFriend> FindById(const FString& UniqueNetId) const;
+
+	// Appends every friend whose real or display name matches, ignoring case and surrounding whitespace.
+	void FindByName(const FString& Name, TArray<TSharedRef<FOnlineFriend>>& OutFriends) const;
+
+	/**
+	 * Appends the net ids of the friends with one of the names, each friend once.
+	 *
+	 * @returns the number of ids appended.
+	 */
+	int32 ResolveNames(const TArray<FString>& Names, TArray<TSharedRef<const FUniqueNetId>>& OutIds) const;
+
+	// Forces the next NeedsRefresh to return true, for example after the backend reported a change.
+	FORCEINLINE void MarkStale() { bStale = true; }
+
+	// Returns true if the list was never read, was marked stale or is older than RefreshInterval seconds.
+	bool NeedsRefresh(double Now, float RefreshInterval) const;
+
+	FORCEINLINE bool HasRead() const { return LastApplyTime > 0.0; }
+
+	FORCEINLINE int32 Num() const { return FriendsById.Num(); }
+
+	void Reset();
+
+	static FString NormalizeName(const FString& Name);
+
+private:
+	// Normalized real and display name of a friend, once each
+	static void GetNormalizedNames(const FOnlineFriend& Friend, TArray<FString, TInlineAllocator<2>>& OutNames);
+
+	void AddNames(const FString& UniqueNetId, const TArray<FString, TInlineAllocator<2>>& Names);
+
+	void RemoveNames(const FString& UniqueNetId);
+
+	TMap<FString, TSharedRef<FOnlineFriend>> FriendsById;
+
+	// Names every friend is indexed under, to take them out of IdsByName on rename or removal
+	TMap<FString, TArray<FString, TInlineAllocator<2>>> NamesById;
+
+	TMultiMap<FString, FString> IdsByName;
+
+	double LastApplyTime = 0.0;
+	bool bStale = true;
+};
@@ -1,9 +1,146 @@
 // Copyright (c) 2019 Jasper Drescher.
 
 #include "OGameInstance.h"
+#include "OBenchmark.h"
+#include "ODiagnostics.h"
+#include "OLoadGenerator.h"
+#include "OMatchmaking.h"
+#include "OServerPool.h"
+#include "OStats.h"
+#include "OTelemetry.h"
 #include "Engine/GameEngine.h"
 #include "Runtime/Engine/Classes/Kismet/GameplayStatics.h"
 #include "Runtime/Engine/Classes/Engine/LocalPlayer.h"
+#include "Containers/Ticker.h"
+#include "Engine/AssetManager.h"
+#include "Engine/NetDriver.h"
+#include "Engine/StreamableManager.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "GameMapsSettings.h"
+#include "GeneralProjectSettings.h"
+#include "HAL/IConsoleManager.h"
+#include "IPAddress.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/PackageName.h"
+#include "SocketSubsystem.h"
+#include "UObject/UObjectIterator.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogOGameInstance, Log, All);
+
+O_DECLARE_CYCLE_STAT("Session Requests", STAT_OSessionRequests);
+O_DECLARE_CYCLE_STAT("Session Search Poll", STAT_OSessionSearchPoll);
+O_DECLARE_CYCLE_STAT("Create Session Complete", STAT_OCreateSessionComplete);
+O_DECLARE_CYCLE_STAT("Start Session Complete", STAT_OStartSessionComplete);
+O_DECLARE_CYCLE_STAT("Find Sessions Complete", STAT_OFindSessionsComplete);
+O_DECLARE_CYCLE_STAT("Join Session Complete", STAT_OJoinSessionComplete);
+O_DECLARE_CYCLE_STAT("Destroy Session Complete", STAT_ODestroySessionComplete);
+O_DECLARE_CYCLE_STAT("Update Session Complete", STAT_OUpdateSessionComplete);
+O_DECLARE_CYCLE_STAT("Load Advertisement", STAT_OLoadAdvertisement);
+O_DECLARE_CYCLE_STAT("Read Friends List Complete", STAT_OReadFriendsListComplete);
+
+static void StartMatchCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UOGameInstance* GameInstance = World ? Cast<UOGameInstance>(World->GetGameInstance()) : nullptr;
+	if (GameInstance && Args.Num() > 0)
+	{
+		GameInstance->StartAdditionalMatch(FName(*Args[0]), Args.Contains(TEXT("LAN")), FMath::Max(GameInstance->DedicatedServerMaxNumPlayers, 1));
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs StartMatchConsoleCommand(
+	TEXT("o.Match.Start"),
+	TEXT("Hosts another match in this dedicated server process. Usage: o.Match.Start <Map> [LAN]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StartMatchCommand));
+
+static TAutoConsoleVariable<int32> CVarPreloadOnJoin(
+	TEXT("o.Session.PreloadOnJoin"),
+	1,
+	TEXT("Streams the advertised map and the join preload assets while joining a session. Compare join to first frame with 0 and 1."),
+	ECVF_Default);
+
+static void MatchTravelCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UOGameInstance* GameInstance = World ? Cast<UOGameInstance>(World->GetGameInstance()) : nullptr;
+	if (GameInstance && Args.Num() > 0)
+	{
+		GameInstance->TravelToMap(FName(*Args[0]));
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs MatchTravelConsoleCommand(
+	TEXT("o.Match.Travel"),
+	TEXT("Moves the match and its players to another map without disconnecting them. Usage: o.Match.Travel <Map>"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&MatchTravelCommand));
+
+static void MatchReportCommand()
+{
+	for (TObjectIterator<UOGameInstance> It; It; ++It)
+	{
+		if (It->GetMatches().Num() > 0)
+		{
+			It->LogMatchMemoryReport();
+		}
+	}
+}
+
+static FAutoConsoleCommand MatchReportConsoleCommand(
+	TEXT("o.Match.Report"),
+	TEXT("Logs the resident memory used per match hosted by this process."),
+	FConsoleCommandDelegate::CreateStatic(&MatchReportCommand));
+
+static void PoolGrowCommand(const TArray<FString>& Args)
+{
+	const int32 Count = (Args.Num() > 0) ? FCString::Atoi(*Args[0]) : 1;
+
+	for (TObjectIterator<UOGameInstance> It; It; ++It)
+	{
+		if (It->GetServerPool() != nullptr && !It->GetServerPool()->IsChild())
+		{
+			It->GetServerPool()->Grow(Count);
+		}
+	}
+}
+
+static FAutoConsoleCommand PoolGrowConsoleCommand(
+	TEXT("o.Pool.Grow"),
+	TEXT("Forks more children of the pre-warmed server pool. Usage: o.Pool.Grow [Count]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&PoolGrowCommand));
+
+static void PoolReportCommand()
+{
+	for (TObjectIterator<UOGameInstance> It; It; ++It)
+	{
+		if (It->GetServerPool() != nullptr)
+		{
+			It->GetServerPool()->LogReport();
+		}
+	}
+}
+
+static FAutoConsoleCommand PoolReportConsoleCommand(
+	TEXT("o.Pool.Report"),
+	TEXT("Logs RSS, PSS and private memory of the server pool process and its children."),
+	FConsoleCommandDelegate::CreateStatic(&PoolReportCommand));
+
+namespace
+{
+	FOSessionSearchEntry MakeSessionSearchEntry(const FOnlineSessionSearchResult& arg_SearchResult, int32 arg_SearchIndex)
+	{
+		FOSessionSearchEntry Entry;
+		Entry.SearchIndex = arg_SearchIndex;
+		Entry.OwningUserName = arg_SearchResult.Session.OwningUserName;
+		Entry.PingInMs = arg_SearchResult.PingInMs;
+		Entry.OpenPublicConnections = arg_SearchResult.Session.NumOpenPublicConnections;
+		Entry.MaxPublicConnections = arg_SearchResult.Session.SessionSettings.NumPublicConnections;
+		arg_SearchResult.Session.SessionSettings.Get(SETTING_MAPNAME, Entry.MapName);
+		arg_SearchResult.Session.SessionSettings.Get(SETTING_OSERVERLOAD, Entry.ServerLoad);
+		arg_SearchResult.Session.SessionSettings.Get(SETTING_ONUMPLAYERS, Entry.NumPlayers);
+		arg_SearchResult.Session.SessionSettings.Get(SETTING_OMATCHPHASE, Entry.MatchPhase);
+
+		return Entry;
+	}
+}
 
 UOGameInstance::UOGameInstance(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
@@ -12,28 +149,406 @@ UOGameInstance::UOGameInstance(const FObjectInitializer& ObjectInitializer) : Su
 	OnFindSessionsCompleteDelegate = FOnFindSessionsCompleteDelegate::CreateUObject(this, &UOGameInstance::OnFindSessionsComplete);
 	OnJoinSessionCompleteDelegate = FOnJoinSessionCompleteDelegate::CreateUObject(this, &UOGameInstance::OnJoinSessionComplete);
 	OnDestroySessionCompleteDelegate = FOnDestroySessionCompleteDelegate::CreateUObject(this, &UOGameInstance::OnDestroySessionComplete);
+	OnUpdateSessionCompleteDelegate = FOnUpdateSessionCompleteDelegate::CreateUObject(this, &UOGameInstance::OnUpdateSessionComplete);
 	OnReadFriendsListCompleteDelegate = FOnReadFriendsListComplete::CreateUObject(this, &UOGameInstance::OnReadFriendsListComplete);
 	OnSessionUserInviteAcceptedDelegate = FOnSessionUserInviteAcceptedDelegate::CreateUObject(this, &UOGameInstance::OnSessionUserInviteAccepted);
+	OnFriendsChangeDelegate = FOnFriendsChangeDelegate::CreateUObject(this, &UOGameInstance::OnFriendsChange);
+
+	DedicatedServerMaxNumPlayers = 16;
+	MatchBasePort = 7777;
+
+	MaxSearchResults = 20;
+	PingBucketSize = 50;
+	SearchCacheTimeToLive = 10.0f;
+	SearchPollInterval = 0.05f;
+	LoadAdvertisementInterval = 5.0f;
+	LoadAdvertisementThreshold = 0.05f;
+
+	PingWeight = 1.0f;
+	FreeSlotsWeight = 50.0f;
+	ServerLoadWeight = 100.0f;
+	PreferredMapWeight = 200.0f;
+
+	MatchmakingRegion = TEXT("local");
+	MatchmakingMaxMatches = 4;
+	MatchmakingHeartbeatInterval = 2.0f;
+	PlacementTimeout = 60.0f;
+	LastMatchmakingSendTime = 0.0;
+	PlacementRequestId = 0;
+	PlacementStartTime = 0.0;
+	bMatchmakingHost = false;
+	bMatchmakingLAN = false;
+	MatchmakingMaxPlayers = 0;
+
+	FriendsRefreshInterval = 300.0f;
+	AutoInviteFriendNames.Add(TEXT("Pingu"));
+	FriendsLocalUserNum = 0;
+	FriendsReadStartTime = 0.0;
+	bAutoInviteOnFriendsRead = false;
+
+	SessionSearchCacheKey = 0;
+	NextJoinCandidate = 0;
+	NumStreamedSearchResults = 0;
+	SessionSearchStartTime = 0.0;
+
+	LoadFrameSeconds = 0.0;
+	LoadNumFrames = 0;
+	LastLoadAdvertisementTime = 0.0;
+	AdvertisedNumPlayers = INDEX_NONE;
+	AdvertisedServerLoad = 0.0f;
+	bSessionUpdatePending = false;
+
+	LoadGenerator = nullptr;
+	Benchmark = nullptr;
+	ServerTravelStartTime = 0.0;
+
+	JoinPreloadAssets.Add(FSoftObjectPath(TEXT("/Game/FirstPersonCPP/Blueprints/BP_FirstPersonCharacter.BP_FirstPersonCharacter_C")));
+	PreloadedMapPackage = nullptr;
+	PreloadStartTime = 0.0;
+	JoinStartTime = 0.0;
+	bJoinMapPreloaded = false;
+
+	SessionState = EOSessionState::Idle;
+	StateBeforeSearch = EOSessionState::Idle;
+	bProcessingSessionRequests = false;
+	bSessionCancelRequested = false;
+	bTravelToEntryMapOnDestroy = false;
+	bSessionDelegatesRegistered = false;
 }
 
 void UOGameInstance::Init()
 {
 	Super::Init();
 
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	FOTelemetry::Get().Start();
+
+	RegisterSessionDelegates();
+}
+
+void UOGameInstance::OnStart()
+{
+	Super::OnStart();
+
+	// -MatchmakingService[=<Port>] runs the matchmaking service of a local cluster in this process
+	int32 MatchmakingServicePort = 0;
+	if (FParse::Value(FCommandLine::Get(), TEXT("MatchmakingService="), MatchmakingServicePort) || FParse::Param(FCommandLine::Get(), TEXT("MatchmakingService")))
+	{
+		MatchmakingService = MakeShared<FOMatchmakingService>();
+		MatchmakingService->Start((MatchmakingServicePort > 0) ? MatchmakingServicePort : FOMatchmakingService::DefaultPort);
+	}
+
+	FParse::Value(FCommandLine::Get(), TEXT("Matchmaker="), MatchmakerAddress);
+
+	// Dedicated servers host right away, configured from the command line:
+	// -SessionName=<Name> -GameMap=<Map> -MaxPlayers=<Count> -LAN
+	if (IsRunningDedicatedServer())
 	{
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+		FString SessionNameString = GameSessionName.ToString();
+		FParse::Value(FCommandLine::Get(), TEXT("SessionName="), SessionNameString);
 
-		if (OnlineSessionInterface.IsValid())
+		FString GameMapString;
+		FParse::Value(FCommandLine::Get(), TEXT("GameMap="), GameMapString);
+
+		int32 MaxNumPlayers = DedicatedServerMaxNumPlayers;
+		FParse::Value(FCommandLine::Get(), TEXT("MaxPlayers="), MaxNumPlayers);
+
+		// A session without public slots can't be joined or placed into
+		MaxNumPlayers = FMath::Max(MaxNumPlayers, 1);
+
+		const bool bIsLAN = FParse::Param(FCommandLine::Get(), TEXT("LAN"));
+
+		// Additional matches and pool children take the ports after the one this process listens on, -Port= included
+		if (GetWorld() && GetWorld()->URL.Port > 0)
+		{
+			MatchBasePort = GetWorld()->URL.Port;
+		}
+
+		// -ServerPool=<Size> warms this process up once and forks a server process per match instead of hosting one here
+		int32 ServerPoolSize = 0;
+		if (FParse::Value(FCommandLine::Get(), TEXT("ServerPool="), ServerPoolSize) && ServerPoolSize > 0)
+		{
+			if (!StartServerPool(FName(*GameMapString), bIsLAN, MaxNumPlayers, ServerPoolSize))
+			{
+				UE_LOG(LogOGameInstance, Error, TEXT("Failed to start a server pool of %d"), ServerPoolSize);
+			}
+			return;
+		}
+
+		MatchResidentMemory.Add(FPlatformMemory::GetStats().UsedPhysical);
+
+		if (!HostDedicatedSession(FName(*SessionNameString), FName(*GameMapString), bIsLAN, MaxNumPlayers))
+		{
+			UE_LOG(LogOGameInstance, Error, TEXT("Failed to host dedicated session %s"), *SessionNameString);
+			return;
+		}
+
+		FOnlineSessionInfo& MatchInfo = Matches.Add(FName(*SessionNameString));
+		MatchInfo.SessionName = FName(*SessionNameString);
+		MatchInfo.GameMapName = FName(*GameMapString);
+		MatchInfo.Port = MatchBasePort;
+
+		MatchResidentMemory.Add(FPlatformMemory::GetStats().UsedPhysical);
+
+		// -Matches=<Count> hosts more matches in this process, sharing engine, assets and code
+		int32 NumMatches = 1;
+		FParse::Value(FCommandLine::Get(), TEXT("Matches="), NumMatches);
+
+		for (int32 MatchIdx = 1; MatchIdx < NumMatches; MatchIdx++)
 		{
-			OnJoinSessionCompleteDelegateHandle = OnlineSessionInterface->AddOnJoinSessionCompleteDelegate_Handle(OnJoinSessionCompleteDelegate);
-			OnSessionUserInviteAcceptedDelegateHandle = OnlineSessionInterface->AddOnSessionUserInviteAcceptedDelegate_Handle(OnSessionUserInviteAcceptedDelegate);
+			StartAdditionalMatch(FName(*GameMapString), bIsLAN, MaxNumPlayers);
 		}
+
+		LogMatchMemoryReport();
+
+		StartMatchmakingHost(bIsLAN, MaxNumPlayers, NumMatches);
 	}
-	else
+
+	// -LoadTest reports server load, -Bots=<Count> [-ServerAddress=<Address>] runs simulated clients
+	int32 NumBots = 0;
+	FParse::Value(FCommandLine::Get(), TEXT("Bots="), NumBots);
+
+	if (NumBots > 0)
+	{
+		FString ServerAddress;
+		FParse::Value(FCommandLine::Get(), TEXT("ServerAddress="), ServerAddress);
+
+		GetLoadGenerator()->StartBots(NumBots, ServerAddress);
+	}
+	else if (FParse::Param(FCommandLine::Get(), TEXT("LoadTest")))
+	{
+		GetLoadGenerator()->StartServerReport();
+	}
+
+	// -GameplayBenchmark [-BenchmarkSeed=<Seed>] [-BenchmarkBots=<Count>] [-BenchmarkOutput=<File>] runs the benchmark and exits
+	if (FParse::Param(FCommandLine::Get(), TEXT("GameplayBenchmark")))
+	{
+		int32 BenchmarkSeed = 0;
+		FParse::Value(FCommandLine::Get(), TEXT("BenchmarkSeed="), BenchmarkSeed);
+
+		int32 BenchmarkBots = -1;
+		FParse::Value(FCommandLine::Get(), TEXT("BenchmarkBots="), BenchmarkBots);
+
+		FString BenchmarkOutput;
+		FParse::Value(FCommandLine::Get(), TEXT("BenchmarkOutput="), BenchmarkOutput);
+
+		GetBenchmark()->Start(BenchmarkSeed, BenchmarkBots, BenchmarkOutput, true);
+	}
+}
+
+UOLoadGenerator* UOGameInstance::GetLoadGenerator()
+{
+	if (LoadGenerator == nullptr)
+	{
+		LoadGenerator = NewObject<UOLoadGenerator>(this);
+	}
+
+	return LoadGenerator;
+}
+
+UOBenchmark* UOGameInstance::GetBenchmark()
+{
+	if (Benchmark == nullptr)
+	{
+		Benchmark = NewObject<UOBenchmark>(this);
+	}
+
+	return Benchmark;
+}
+
+bool UOGameInstance::IsSearchingSessions() const
+{
+	return SessionState == EOSessionState::Searching || SessionRequestQueue.ContainsByPredicate([](const FSessionRequest& Request)
+	{
+		return Request.Type == ESessionRequestType::Find;
+	});
+}
+
+bool UOGameInstance::StartAdditionalMatch(FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers)
+{
+	if (!IsRunningDedicatedServer() || arg_Map.IsNone())
+	{
+		UE_LOG(LogOGameInstance, Warning, TEXT("Additional matches need a dedicated server and a map"));
+		return false;
+	}
+
+	const int32 MatchIdx = Matches.Num();
+	const FName MatchSessionName = FName(*FString::Printf(TEXT("%s_%d"), *GameSessionName.ToString(), MatchIdx));
+	const int32 MatchPort = MatchBasePort + MatchIdx;
+
+	if (MatchResidentMemory.Num() == 0)
+	{
+		MatchResidentMemory.Add(FPlatformMemory::GetStats().UsedPhysical);
+	}
+
+	// Every match gets its own game instance and world context, the engine ticks all of them
+	UOGameInstance* MatchInstance = NewObject<UOGameInstance>(GetEngine(), GetClass());
+	MatchInstance->InitializeStandalone();
+
+	// Loading with listen gives the world its own net driver on the match port
+	FURL MatchURL(nullptr, *arg_Map.ToString(), TRAVEL_Absolute);
+	MatchURL.Port = MatchPort;
+	MatchURL.AddOption(TEXT("listen"));
+
+	FString Error;
+	if (GetEngine()->Browse(*MatchInstance->GetWorldContext(), MatchURL, Error) == EBrowseReturnVal::Failure)
+	{
+		UE_LOG(LogOGameInstance, Error, TEXT("Failed to load match %s on port %d: %s"), *MatchSessionName.ToString(), MatchPort, *Error);
+		MatchInstance->Shutdown();
+		return false;
+	}
+
+	if (!MatchInstance->HostDedicatedSession(MatchSessionName, arg_Map, arg_bIsLAN, arg_MaxNumPlayers))
+	{
+		UE_LOG(LogOGameInstance, Error, TEXT("Failed to host session %s"), *MatchSessionName.ToString());
+	}
+
+	MatchInstances.Add(MatchInstance);
+
+	FOnlineSessionInfo& MatchInfo = Matches.Add(MatchSessionName);
+	MatchInfo.SessionName = MatchSessionName;
+	MatchInfo.GameMapName = arg_Map;
+	MatchInfo.Port = MatchPort;
+
+	MatchResidentMemory.Add(FPlatformMemory::GetStats().UsedPhysical);
+
+	return true;
+}
+
+bool UOGameInstance::TravelToMap(FName arg_Map)
+{
+	UWorld* World = GetWorld();
+	if (World == nullptr || arg_Map.IsNone() || World->GetNetMode() == NM_Client || World->GetNetMode() == NM_Standalone)
+	{
+		return false;
+	}
+
+	ServerTravelStartTime = FPlatformTime::Seconds();
+	SessionInfo.GameMapName = arg_Map;
+
+	// Relative travel keeps the listen option and port of the match, the game mode decides whether it is seamless
+	return World->ServerTravel(arg_Map.ToString(), false);
+}
+
+void UOGameInstance::StartMatchmakingHost(bool arg_bIsLAN, int32 arg_MaxNumPlayers, int32 arg_NumMatches)
+{
+	if (MatchmakerAddress.IsEmpty())
+	{
+		return;
+	}
+
+	// The matches are reported to the matchmaking service, it asks for more: [-Region=<Region>] [-MaxMatches=<Count>] [-PublicAddress=<Ip>]
+	FParse::Value(FCommandLine::Get(), TEXT("Region="), MatchmakingRegion);
+	FParse::Value(FCommandLine::Get(), TEXT("MaxMatches="), MatchmakingMaxMatches);
+	FParse::Value(FCommandLine::Get(), TEXT("PublicAddress="), MatchmakingPublicAddress);
+
+	bMatchmakingHost = true;
+	bMatchmakingLAN = arg_bIsLAN;
+	MatchmakingMaxPlayers = arg_MaxNumPlayers;
+	MatchmakingMaxMatches = FMath::Max(MatchmakingMaxMatches, arg_NumMatches);
+
+	StartMatchmaking();
+}
+
+bool UOGameInstance::StartServerPool(FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers, int32 arg_Size)
+{
+	// Hosts advertise the short map name
+	FString MapPackageName = arg_Map.ToString();
+	if (arg_Map.IsNone() || (!FPackageName::IsValidLongPackageName(MapPackageName) && !FPackageName::SearchForPackageOnDisk(MapPackageName + FPackageName::GetMapPackageExtension(), &MapPackageName)))
+	{
+		UE_LOG(LogOGameInstance, Error, TEXT("Server pool needs a game map, no package found for '%s'"), *arg_Map.ToString());
+		return false;
+	}
+
+	const double WarmStartTime = FPlatformTime::Seconds();
+
+	// Everything loaded here is shared with the children copy-on-write instead of loaded by each of them
+	UPackage* MapPackage = LoadPackage(nullptr, *MapPackageName, LOAD_None);
+	if (MapPackage == nullptr)
+	{
+		UE_LOG(LogOGameInstance, Error, TEXT("Server pool failed to load %s"), *MapPackageName);
+		return false;
+	}
+
+	ServerPoolWarmObjects.Add(MapPackage);
+
+	for (const FSoftObjectPath& AssetPath : JoinPreloadAssets)
+	{
+		UObject* Asset = AssetPath.TryLoad();
+		if (Asset != nullptr)
+		{
+			ServerPoolWarmObjects.Add(Asset);
+		}
+	}
+
+	// Boot garbage would otherwise be collected by every child, writing to pages it could have shared
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+	FOProcessMemory Memory;
+	FOServerPool::ReadProcessMemory(FPlatformProcess::GetCurrentProcessId(), Memory);
+
+	UE_LOG(LogOGameInstance, Log, TEXT("Server pool warmed %s in %.3f s, %.3f s after process start | RSS %.1f MB"), *MapPackageName,
+		FPlatformTime::Seconds() - WarmStartTime, FPlatformTime::Seconds() - GStartTime, Memory.Rss / (1024.0 * 1024.0));
+
+	ServerPool = MakeShared<FOServerPool>();
+	return ServerPool->Start(arg_Size, [this, arg_Map, arg_bIsLAN, arg_MaxNumPlayers](int32 ChildIndex)
+	{
+		HostPoolMatch(ChildIndex, arg_Map, arg_bIsLAN, arg_MaxNumPlayers);
+	});
+}
+
+void UOGameInstance::HostPoolMatch(int32 arg_ChildIndex, FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers)
+{
+	// Subsystem state of the parent can't be shared, every child gets its own instance
+	UnregisterSessionDelegates();
+	OnlineSubsystemName = FName(*FString::Printf(TEXT("Null:Pool%d"), arg_ChildIndex));
+	RegisterSessionDelegates();
+
+	const FName MatchSessionName = FName(*FString::Printf(TEXT("%s_Pool%d"), *GameSessionName.ToString(), arg_ChildIndex));
+	const int32 MatchPort = MatchBasePort + 1 + arg_ChildIndex;
+
+	// The map package is already in memory, loading it only creates the world. Listening replaces the net driver of the parent
+	FURL MatchURL(nullptr, *arg_Map.ToString(), TRAVEL_Absolute);
+	MatchURL.Port = MatchPort;
+	MatchURL.AddOption(TEXT("listen"));
+
+	FString Error;
+	if (GetEngine()->Browse(*GetWorldContext(), MatchURL, Error) == EBrowseReturnVal::Failure)
+	{
+		UE_LOG(LogOGameInstance, Error, TEXT("Pool child %d failed to load %s on port %d: %s"), arg_ChildIndex, *arg_Map.ToString(), MatchPort, *Error);
+		FPlatformMisc::RequestExit(false);
+		return;
+	}
+
+	if (!HostDedicatedSession(MatchSessionName, arg_Map, arg_bIsLAN, arg_MaxNumPlayers))
+	{
+		UE_LOG(LogOGameInstance, Error, TEXT("Pool child %d failed to host session %s"), arg_ChildIndex, *MatchSessionName.ToString());
+		FPlatformMisc::RequestExit(false);
+		return;
+	}
+
+	Matches.Reset();
+	FOnlineSessionInfo& MatchInfo = Matches.Add(MatchSessionName);
+	MatchInfo.SessionName = MatchSessionName;
+	MatchInfo.GameMapName = arg_Map;
+	MatchInfo.Port = MatchPort;
+
+	StartMatchmakingHost(arg_bIsLAN, arg_MaxNumPlayers, 1);
+}
+
+void UOGameInstance::LogMatchMemoryReport() const
+{
+	const double BytesPerMegabyte = 1024.0 * 1024.0;
+
+	for (int32 MatchIdx = 1; MatchIdx < MatchResidentMemory.Num(); MatchIdx++)
+	{
+		UE_LOG(LogOGameInstance, Log, TEXT("Match %d: %.1f MB resident, +%.1f MB for this match"), MatchIdx,
+			MatchResidentMemory[MatchIdx] / BytesPerMegabyte, (static_cast<int64>(MatchResidentMemory[MatchIdx]) - static_cast<int64>(MatchResidentMemory[MatchIdx - 1])) / BytesPerMegabyte);
+	}
+
+	if (MatchResidentMemory.Num() > 2)
 	{
-		GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, TEXT("No OnlineSubsytem found!"));
+		const int64 AdditionalBytes = static_cast<int64>(MatchResidentMemory.Last()) - static_cast<int64>(MatchResidentMemory[1]);
+		UE_LOG(LogOGameInstance, Log, TEXT("%d matches in one process: %.1f MB resident per additional match"), Matches.Num(), AdditionalBytes / BytesPerMegabyte / (MatchResidentMemory.Num() - 2));
 	}
 }
 
@@ -41,433 +556,1920 @@ void UOGameInstance::Shutdown()
 {
 	Super::Shutdown();
 
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	if (LoadGenerator != nullptr)
 	{
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+		LoadGenerator->Stop();
+	}
 
-		if (OnlineSessionInterface.IsValid())
+	if (Benchmark != nullptr)
+	{
+		Benchmark->Stop();
+	}
+
+	for (UOGameInstance* MatchInstance : MatchInstances)
+	{
+		MatchInstance->Shutdown();
+	}
+
+	MatchInstances.Empty();
+
+	StopSessionSearchPolling();
+	StopLoadAdvertisement();
+	StopMatchmaking();
+
+	if (ServerPool.IsValid())
+	{
+		ServerPool->Stop();
+		ServerPool.Reset();
+	}
+
+	if (MatchmakingService.IsValid())
+	{
+		MatchmakingService->Stop();
+		MatchmakingService.Reset();
+	}
+
+	SessionRequestQueue.Empty();
+	UnregisterSessionDelegates();
+	UnregisterFriendsDelegates();
+
+	FWorldDelegates::OnWorldPostActorTick.Remove(FirstFrameHandle);
+	ReleasePreloads();
+}
+
+void UOGameInstance::RegisterSessionDelegates()
+{
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+	if (!OnlineSessionInterface.IsValid())
+	{
+		O_DIAG(LogOSession, Warning, TEXT("No online subsystem %s found"), *OnlineSubsystemName.ToString());
+		return;
+	}
+
+	if (bSessionDelegatesRegistered)
+	{
+		return;
+	}
+
+	OnCreateSessionCompleteDelegateHandle = OnlineSessionInterface->AddOnCreateSessionCompleteDelegate_Handle(OnCreateSessionCompleteDelegate);
+	OnStartSessionCompleteDelegateHandle = OnlineSessionInterface->AddOnStartSessionCompleteDelegate_Handle(OnStartSessionCompleteDelegate);
+	OnFindSessionsCompleteDelegateHandle = OnlineSessionInterface->AddOnFindSessionsCompleteDelegate_Handle(OnFindSessionsCompleteDelegate);
+	OnJoinSessionCompleteDelegateHandle = OnlineSessionInterface->AddOnJoinSessionCompleteDelegate_Handle(OnJoinSessionCompleteDelegate);
+	OnDestroySessionCompleteDelegateHandle = OnlineSessionInterface->AddOnDestroySessionCompleteDelegate_Handle(OnDestroySessionCompleteDelegate);
+	OnUpdateSessionCompleteDelegateHandle = OnlineSessionInterface->AddOnUpdateSessionCompleteDelegate_Handle(OnUpdateSessionCompleteDelegate);
+	OnSessionUserInviteAcceptedDelegateHandle = OnlineSessionInterface->AddOnSessionUserInviteAcceptedDelegate_Handle(OnSessionUserInviteAcceptedDelegate);
+
+	bSessionDelegatesRegistered = true;
+}
+
+void UOGameInstance::UnregisterSessionDelegates()
+{
+	if (!bSessionDelegatesRegistered)
+	{
+		return;
+	}
+
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+	if (OnlineSessionInterface.IsValid())
+	{
+		OnlineSessionInterface->ClearOnCreateSessionCompleteDelegate_Handle(OnCreateSessionCompleteDelegateHandle);
+		OnlineSessionInterface->ClearOnStartSessionCompleteDelegate_Handle(OnStartSessionCompleteDelegateHandle);
+		OnlineSessionInterface->ClearOnFindSessionsCompleteDelegate_Handle(OnFindSessionsCompleteDelegateHandle);
+		OnlineSessionInterface->ClearOnJoinSessionCompleteDelegate_Handle(OnJoinSessionCompleteDelegateHandle);
+		OnlineSessionInterface->ClearOnDestroySessionCompleteDelegate_Handle(OnDestroySessionCompleteDelegateHandle);
+		OnlineSessionInterface->ClearOnUpdateSessionCompleteDelegate_Handle(OnUpdateSessionCompleteDelegateHandle);
+		OnlineSessionInterface->ClearOnSessionUserInviteAcceptedDelegate_Handle(OnSessionUserInviteAcceptedDelegateHandle);
+	}
+
+	bSessionDelegatesRegistered = false;
+}
+
+IOnlineSessionPtr UOGameInstance::GetSessionInterface() const
+{
+	const IOnlineSubsystem* OnlineSubsystemInterface = GetOnlineSubsystem();
+	return OnlineSubsystemInterface ? OnlineSubsystemInterface->GetSessionInterface() : IOnlineSessionPtr();
+}
+
+bool UOGameInstance::IsSessionStateSettled() const
+{
+	return SessionState == EOSessionState::Idle || SessionState == EOSessionState::InProgress || SessionState == EOSessionState::Joined;
+}
+
+void UOGameInstance::SetSessionState(EOSessionState arg_NewState)
+{
+	if (arg_NewState == SessionState)
+	{
+		return;
+	}
+
+	const EOSessionState OldState = SessionState;
+	SessionState = arg_NewState;
+
+	O_DIAG(LogOSession, Verbose, TEXT("Session state %d -> %d"), static_cast<int32>(OldState), static_cast<int32>(arg_NewState));
+
+	if (IsSessionStateSettled())
+	{
+		bSessionCancelRequested = false;
+	}
+
+	// A join that didn't make it doesn't need its preloads anymore
+	if (arg_NewState == EOSessionState::Idle)
+	{
+		ReleasePreloads();
+		JoinStartTime = 0.0;
+	}
+
+	OnSessionStateChanged.Broadcast(OldState, arg_NewState);
+
+	// Every settled state is a chance to start what was queued while the backend was busy
+	if (IsSessionStateSettled())
+	{
+		ProcessSessionRequests();
+	}
+}
+
+bool UOGameInstance::RequestSessionOperation(const FSessionRequest& arg_Request)
+{
+	// Nothing running, start right away so the caller learns whether it worked
+	if (IsSessionStateSettled() && SessionRequestQueue.Num() == 0 && !bProcessingSessionRequests)
+	{
+		return ExecuteSessionRequest(arg_Request);
+	}
+
+	switch (arg_Request.Type)
+	{
+	case ESessionRequestType::Find:
+		// A running search already streams fresh results
+		if (SessionState == EOSessionState::Searching)
 		{
-			OnlineSessionInterface->ClearOnSessionUserInviteAcceptedDelegate_Handle(OnSessionUserInviteAcceptedDelegateHandle);
+			return true;
 		}
+		break;
+
+	case ESessionRequestType::Destroy:
+		// Leaving makes sessions that were about to be created or joined pointless
+		SessionRequestQueue.RemoveAll([](const FSessionRequest& QueuedRequest)
+		{
+			return QueuedRequest.Type == ESessionRequestType::Create || QueuedRequest.Type == ESessionRequestType::Join;
+		});
+		break;
+
+	default:
+		break;
+	}
+
+	// A newer request of the same type supersedes the queued one, so the queue never holds more than one of each
+	FSessionRequest* QueuedRequest = SessionRequestQueue.FindByPredicate([&arg_Request](const FSessionRequest& Request)
+	{
+		return Request.Type == arg_Request.Type;
+	});
+
+	if (QueuedRequest != nullptr)
+	{
+		const bool bForceRefresh = QueuedRequest->bForceRefresh || arg_Request.bForceRefresh;
+		*QueuedRequest = arg_Request;
+		QueuedRequest->bForceRefresh = bForceRefresh;
+	}
+	else
+	{
+		SessionRequestQueue.Add(arg_Request);
+	}
+
+	ProcessSessionRequests();
+
+	return true;
+}
+
+void UOGameInstance::ProcessSessionRequests()
+{
+	if (bProcessingSessionRequests)
+	{
+		return;
+	}
+
+	O_SCOPE_CYCLE_COUNTER(STAT_OSessionRequests);
+
+	TGuardValue<bool> ProcessingGuard(bProcessingSessionRequests, true);
+
+	// Requests that complete right away settle the state again, so keep going until one runs
+	while (IsSessionStateSettled() && SessionRequestQueue.Num() > 0)
+	{
+		const FSessionRequest Request = SessionRequestQueue[0];
+		SessionRequestQueue.RemoveAt(0);
+
+		ExecuteSessionRequest(Request);
+	}
+}
+
+bool UOGameInstance::ExecuteSessionRequest(const FSessionRequest& arg_Request)
+{
+	// Creating or joining another session needs the current one gone, the request runs once it is
+	const bool bHasSession = SessionState == EOSessionState::InProgress || SessionState == EOSessionState::Joined;
+	if (bHasSession && (arg_Request.Type == ESessionRequestType::Create || arg_Request.Type == ESessionRequestType::Join))
+	{
+		SessionRequestQueue.Insert(arg_Request, 0);
+		ExecuteDestroySession(false);
+
+		return true;
+	}
+
+	switch (arg_Request.Type)
+	{
+	case ESessionRequestType::Create:
+		return ExecuteCreateSession(arg_Request);
+
+	case ESessionRequestType::Find:
+		return ExecuteFindSessions(arg_Request);
+
+	case ESessionRequestType::Join:
+		return ExecuteJoinSession(arg_Request);
+
+	case ESessionRequestType::Destroy:
+		return ExecuteDestroySession(true);
+
+	default:
+		return false;
+	}
+}
+
+void UOGameInstance::CancelSessionRequests()
+{
+	SessionRequestQueue.Empty();
+
+	switch (SessionState)
+	{
+	case EOSessionState::Searching:
+	{
+		IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+		if (OnlineSessionInterface.IsValid())
+		{
+			OnlineSessionInterface->CancelFindSessions();
+		}
+
+		// A late completion of the cancelled search is ignored once the state moved on
+		StopSessionSearchPolling();
+		SetSessionState(StateBeforeSearch);
+		break;
+	}
+
+	case EOSessionState::Creating:
+	case EOSessionState::Starting:
+	case EOSessionState::Joining:
+		bSessionCancelRequested = true;
+		break;
+
+	default:
+		break;
+	}
+}
+
+bool UOGameInstance::HostSession(FName arg_SessionName, FName arg_Map, bool arg_bIsLAN, bool arg_bIsPresence, int32 arg_MaxNumPlayers)
+{
+	// Dedicated servers have no local player to host with
+	if (IsRunningDedicatedServer())
+	{
+		return HostDedicatedSession(arg_SessionName, arg_Map, arg_bIsLAN, arg_MaxNumPlayers);
+	}
+
+	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+	if (LocalPlayer->IsValidLowLevelFast())
+	{
+		FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(LocalPlayer->GetPreferredUniqueNetId());
+		return CreateSession(UniqueNetIdWrapper.GetUniqueNetId(), arg_SessionName, arg_Map, arg_bIsLAN, arg_bIsPresence, arg_MaxNumPlayers);
+	}
+
+	return false;
+}
+
+bool UOGameInstance::FindSessions(bool arg_bIsLAN, bool arg_bIsPresence, bool arg_bForceRefresh)
+{
+	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+	if (LocalPlayer->IsValidLowLevelFast())
+	{
+		FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(LocalPlayer->GetPreferredUniqueNetId());
+		FindSessions(UniqueNetIdWrapper.GetUniqueNetId(), arg_bIsLAN, arg_bIsPresence, arg_bForceRefresh);
+
+		return true;
+	}
+
+	return false;
+}
+
+bool UOGameInstance::JoinSession()
+{
+	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+
+	if (LocalPlayer->IsValidLowLevelFast())
+	{
+		TSharedPtr<const FUniqueNetId> LocalUserId = LocalPlayer->GetPreferredUniqueNetId();
+		if (LocalUserId.IsValid())
+		{
+			// Without a search result the best candidate of the last search is joined, once a running search is done
+			FSessionRequest Request;
+			Request.Type = ESessionRequestType::Join;
+			Request.UserId = LocalUserId;
+			Request.SessionName = GameSessionName;
+
+			return RequestSessionOperation(Request);
+		}
+	}
+
+	return false;
+}
+
+float UOGameInstance::ScoreSearchResult(const FOnlineSessionSearchResult& arg_SearchResult) const
+{
+	const FOnlineSessionSettings& Settings = arg_SearchResult.Session.SessionSettings;
+
+	float Score = -PingWeight * arg_SearchResult.PingInMs;
+
+	// Emptier sessions first, so players spread over the servers
+	if (Settings.NumPublicConnections > 0)
+	{
+		Score += FreeSlotsWeight * arg_SearchResult.Session.NumOpenPublicConnections / static_cast<float>(Settings.NumPublicConnections);
+	}
+
+	float ServerLoad = 0.0f;
+	if (Settings.Get(SETTING_OSERVERLOAD, ServerLoad))
+	{
+		Score -= ServerLoadWeight * FMath::Clamp(ServerLoad, 0.0f, 1.0f);
+	}
+
+	FString MapName;
+	if (!PreferredMapName.IsEmpty() && Settings.Get(SETTING_MAPNAME, MapName) && MapName == PreferredMapName)
+	{
+		Score += PreferredMapWeight;
+	}
+
+	return Score;
+}
+
+void UOGameInstance::BuildJoinCandidates(const FUniqueNetId& arg_LocalUserId)
+{
+	JoinCandidates.Reset();
+	NextJoinCandidate = 0;
+
+	TArray<TPair<float, int32>> ScoredResults;
+	ScoredResults.Reserve(SessionSearch->SearchResults.Num());
+
+	for (int32 SearchIdx = 0; SearchIdx < SessionSearch->SearchResults.Num(); SearchIdx++)
+	{
+		const FOnlineSessionSearchResult& SearchResult = SessionSearch->SearchResults[SearchIdx];
+
+		// Skip our own session, sessions without a free slot and the ones the backend should have filtered
+		const bool bIsOwnSession = SearchResult.Session.OwningUserId.IsValid() && *SearchResult.Session.OwningUserId == arg_LocalUserId;
+		if (bIsOwnSession || !SearchResult.IsValid() || SearchResult.Session.NumOpenPublicConnections <= 0 || !MatchesSessionQuery(SearchResult))
+		{
+			continue;
+		}
+
+		ScoredResults.Emplace(ScoreSearchResult(SearchResult), SearchIdx);
+	}
+
+	ScoredResults.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B)
+	{
+		return A.Key > B.Key;
+	});
+
+	JoinCandidates.Reserve(ScoredResults.Num());
+	for (const TPair<float, int32>& ScoredResult : ScoredResults)
+	{
+		JoinCandidates.Add(SessionSearch->SearchResults[ScoredResult.Value]);
+	}
+}
+
+bool UOGameInstance::TryNextJoinCandidate()
+{
+	// A cancelled join doesn't go on with the next candidate
+	if (bSessionCancelRequested)
+	{
+		JoinCandidates.Reset();
+	}
+
+	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+	if (LocalPlayer->IsValidLowLevelFast())
+	{
+		FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(LocalPlayer->GetPreferredUniqueNetId());
+
+		while (JoinCandidates.IsValidIndex(NextJoinCandidate))
+		{
+			const FOnlineSessionSearchResult& SearchResult = JoinCandidates[NextJoinCandidate++];
+			if (StartJoinSession(UniqueNetIdWrapper.GetUniqueNetId(), GameSessionName, SearchResult))
+			{
+				return true;
+			}
+		}
+	}
+
+	JoinCandidates.Reset();
+	SetSessionState(EOSessionState::Idle);
+
+	return false;
+}
+
+void UOGameInstance::PreloadSessionAssets(const FOnlineSessionSearchResult& arg_SearchResult)
+{
+	if (CVarPreloadOnJoin.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+
+	if (!PreloadAssetsHandle.IsValid() && JoinPreloadAssets.Num() > 0)
+	{
+		PreloadAssetsHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(JoinPreloadAssets, FStreamableDelegate(), FStreamableManager::AsyncLoadHighPriority);
+	}
+
+	FString MapName;
+	if (!arg_SearchResult.Session.SessionSettings.Get(SETTING_MAPNAME, MapName) || MapName.IsEmpty())
+	{
+		return;
+	}
+
+	// Hosts advertise the short map name
+	FString MapPackageName = MapName;
+	if (!FPackageName::IsValidLongPackageName(MapPackageName) && !FPackageName::SearchForPackageOnDisk(MapName + FPackageName::GetMapPackageExtension(), &MapPackageName))
+	{
+		UE_LOG(LogOGameInstance, Warning, TEXT("Can't preload map %s, no package found"), *MapName);
+		return;
+	}
+
+	// Candidates on the same map share the preload
+	if (PreloadingMapPackageName == FName(*MapPackageName))
+	{
+		return;
+	}
+
+	PreloadingMapPackageName = FName(*MapPackageName);
+	PreloadedMapPackage = nullptr;
+	PreloadStartTime = FPlatformTime::Seconds();
+
+	LoadPackageAsync(MapPackageName, FLoadPackageAsyncDelegate::CreateUObject(this, &UOGameInstance::OnMapPackagePreloaded), FStreamableManager::AsyncLoadHighPriority);
+}
+
+void UOGameInstance::OnMapPackagePreloaded(const FName& arg_PackageName, UPackage* arg_LoadedPackage, EAsyncLoadingResult::Type arg_Result)
+{
+	// A later join may have asked for another map
+	if (arg_PackageName != PreloadingMapPackageName || arg_Result != EAsyncLoadingResult::Succeeded)
+	{
+		return;
+	}
+
+	// Referenced until the client traveled, so the load finds the package in memory instead of reading it again
+	PreloadedMapPackage = arg_LoadedPackage;
+
+	UE_LOG(LogOGameInstance, Log, TEXT("Preloaded map %s in %.3f s"), *arg_PackageName.ToString(), FPlatformTime::Seconds() - PreloadStartTime);
+}
+
+void UOGameInstance::ReleasePreloads()
+{
+	PreloadedMapPackage = nullptr;
+	PreloadingMapPackageName = NAME_None;
+	PreloadAssetsHandle.Reset();
+}
+
+bool UOGameInstance::RetryJoinWithNextCandidate(FName arg_SessionName)
+{
+	// A session that was joined but can't be traveled to has to go before we can join another one.
+	// OnDestroySessionComplete goes on with the next candidate while the state is still Joining
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+	if (OnlineSessionInterface.IsValid() && OnlineSessionInterface->GetNamedSession(arg_SessionName) != nullptr)
+	{
+		SessionInfo.SessionName = arg_SessionName;
+		OnlineSessionInterface->DestroySession(arg_SessionName);
+
+		return true;
+	}
+
+	return TryNextJoinCandidate();
+}
+
+bool UOGameInstance::JoinSearchResult(int32 arg_SearchIndex)
+{
+	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+
+	if (LocalPlayer->IsValidLowLevelFast() && SessionSearch.IsValid() && SessionSearch->SearchResults.IsValidIndex(arg_SearchIndex))
+	{
+		FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(LocalPlayer->GetPreferredUniqueNetId());
+		return JoinSession(UniqueNetIdWrapper.GetUniqueNetId(), GameSessionName, SessionSearch->SearchResults[arg_SearchIndex]);
+	}
+
+	return false;
+}
+
+void UOGameInstance::DestroySession()
+{
+	FSessionRequest Request;
+	Request.Type = ESessionRequestType::Destroy;
+
+	RequestSessionOperation(Request);
+}
+
+bool UOGameInstance::ExecuteDestroySession(bool arg_bTravelToEntryMap)
+{
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+	if (!OnlineSessionInterface.IsValid() || OnlineSessionInterface->GetNamedSession(SessionInfo.SessionName) == nullptr)
+	{
+		// Nothing to destroy
+		SetSessionState(EOSessionState::Idle);
+		return false;
+	}
+
+	bTravelToEntryMapOnDestroy = arg_bTravelToEntryMap;
+	SetSessionState(EOSessionState::Destroying);
+
+	FOTelemetry::Get().BeginTimer(EOTelemetryTimer::SessionDestroy, this, SessionInfo.SessionName);
+	OnlineSessionInterface->DestroySession(SessionInfo.SessionName);
+
+	return true;
+}
+
+bool UOGameInstance::SendSessionInviteToFriend(const FString& arg_FriendUniqueNetId)
+{
+	TArray<FString> FriendUniqueNetIds;
+	FriendUniqueNetIds.Add(arg_FriendUniqueNetId);
+
+	return SendSessionInviteToFriends(FriendUniqueNetIds) > 0;
+}
+
+int32 UOGameInstance::SendSessionInviteToFriends(const TArray<FString>& arg_FriendUniqueNetIds)
+{
+	const IOnlineSubsystem* OnlineSubsystemInterface = GetOnlineSubsystem();
+	if (!OnlineSubsystemInterface)
+	{
+		return 0;
+	}
+
+	IOnlineIdentityPtr IdentityInterface = OnlineSubsystemInterface->GetIdentityInterface();
+
+	TArray<TSharedRef<const FUniqueNetId>> FriendIds;
+	FriendIds.Reserve(arg_FriendUniqueNetIds.Num());
+
+	for (const FString& FriendUniqueNetId : arg_FriendUniqueNetIds)
+	{
+		// Cached friends carry the id type of the backend, anybody else gets one made by the identity interface
+		const TSharedPtr<FOnlineFriend> Friend = FriendsCache.FindById(FriendUniqueNetId);
+		if (Friend.IsValid())
+		{
+			FriendIds.Add(Friend->GetUserId());
+			continue;
+		}
+
+		const TSharedPtr<const FUniqueNetId> FriendId = IdentityInterface.IsValid() ? IdentityInterface->CreateUniquePlayerId(FriendUniqueNetId) : TSharedPtr<const FUniqueNetId>();
+		if (FriendId.IsValid())
+		{
+			FriendIds.Add(FriendId.ToSharedRef());
+		}
+		else
+		{
+			O_DIAG(LogOFriends, Warning, TEXT("Can't invite %s, not a valid unique net id"), *FriendUniqueNetId);
+		}
+	}
+
+	return SendSessionInvites(FriendIds);
+}
+
+int32 UOGameInstance::InviteFriendsByName(const TArray<FString>& arg_FriendNames)
+{
+	TArray<TSharedRef<const FUniqueNetId>> FriendIds;
+	FriendsCache.ResolveNames(arg_FriendNames, FriendIds);
+
+	return SendSessionInvites(FriendIds);
+}
+
+int32 UOGameInstance::SendSessionInvites(const TArray<TSharedRef<const FUniqueNetId>>& arg_FriendIds)
+{
+	if (arg_FriendIds.Num() == 0)
+	{
+		return 0;
+	}
+
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+	if (!OnlineSessionInterface.IsValid() || LocalPlayer == nullptr)
+	{
+		return 0;
+	}
+
+	const FName InviteSessionName = SessionInfo.SessionName.IsNone() ? GameSessionName : SessionInfo.SessionName;
+
+	const double StartTime = FPlatformTime::Seconds();
+	const bool bWasSent = OnlineSessionInterface->SendSessionInviteToFriends(LocalPlayer->GetControllerId(), InviteSessionName, arg_FriendIds);
+	FOTelemetry::Get().Record(EOTelemetryHistogram::FriendInviteUs, (FPlatformTime::Seconds() - StartTime) * 1000000.0);
+
+	if (!bWasSent)
+	{
+		O_DIAG(LogOFriends, Warning, TEXT("Failed to invite %d friends to %s"), arg_FriendIds.Num(), *InviteSessionName.ToString());
+		return 0;
+	}
+
+	for (int32 FriendIdx = 0; FriendIdx < arg_FriendIds.Num(); FriendIdx++)
+	{
+		FOTelemetry::Get().Increment(EOTelemetryCounter::FriendInvitesSent);
+	}
+
+	O_DIAG(LogOFriends, Log, TEXT("Invited %d friends to %s"), arg_FriendIds.Num(), *InviteSessionName.ToString());
+
+	return arg_FriendIds.Num();
+}
+
+bool UOGameInstance::RefreshFriends(bool arg_bForce)
+{
+	// A running read brings the cache up to date anyway
+	if (FriendsReadStartTime > 0.0)
+	{
+		return false;
+	}
+
+	if (!arg_bForce && !FriendsCache.NeedsRefresh(FPlatformTime::Seconds(), FriendsRefreshInterval))
+	{
+		return false;
+	}
+
+	const IOnlineSubsystem* OnlineSubsystemInterface = GetOnlineSubsystem();
+	IOnlineFriendsPtr FriendInterface = OnlineSubsystemInterface ? OnlineSubsystemInterface->GetFriendsInterface() : IOnlineFriendsPtr();
+	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+	if (!FriendInterface.IsValid() || LocalPlayer == nullptr)
+	{
+		return false;
+	}
+
+	if (!OnFriendsChangeDelegateHandle.IsValid() || FriendsLocalUserNum != LocalPlayer->GetControllerId())
+	{
+		UnregisterFriendsDelegates();
+
+		FriendsLocalUserNum = LocalPlayer->GetControllerId();
+		OnFriendsChangeDelegateHandle = FriendInterface->AddOnFriendsChangeDelegate_Handle(FriendsLocalUserNum, OnFriendsChangeDelegate);
+		FriendsCache.Reset();
+	}
+
+	FriendsReadStartTime = FPlatformTime::Seconds();
+
+	if (!FriendInterface->ReadFriendsList(FriendsLocalUserNum, EFriendsLists::ToString(EFriendsLists::Default), OnReadFriendsListCompleteDelegate))
+	{
+		FriendsReadStartTime = 0.0;
+		return false;
+	}
+
+	return true;
+}
+
+void UOGameInstance::UnregisterFriendsDelegates()
+{
+	if (!OnFriendsChangeDelegateHandle.IsValid())
+	{
+		return;
+	}
+
+	const IOnlineSubsystem* OnlineSubsystemInterface = GetOnlineSubsystem();
+	IOnlineFriendsPtr FriendInterface = OnlineSubsystemInterface ? OnlineSubsystemInterface->GetFriendsInterface() : IOnlineFriendsPtr();
+	if (FriendInterface.IsValid())
+	{
+		FriendInterface->ClearOnFriendsChangeDelegate_Handle(FriendsLocalUserNum, OnFriendsChangeDelegateHandle);
+	}
+
+	OnFriendsChangeDelegateHandle.Reset();
+}
+
+bool UOGameInstance::HostDedicatedSession(FName arg_SessionName, FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers)
+{
+	// Presence belongs to a logged in user, which a dedicated server doesn't have
+	FSessionRequest Request;
+	Request.Type = ESessionRequestType::Create;
+	Request.SessionName = arg_SessionName;
+	Request.Map = arg_Map;
+	Request.bIsLAN = arg_bIsLAN;
+	Request.bIsDedicated = true;
+	Request.MaxNumPlayers = arg_MaxNumPlayers;
+
+	return RequestSessionOperation(Request);
+}
+
+void UOGameInstance::InitSessionSettings(FName arg_Map, bool arg_bIsLAN, bool arg_bIsPresence, int32 arg_MaxNumPlayers)
+{
+	SessionSettings = MakeShareable(new FOnlineSessionSettings());
+
+	SessionSettings->bIsLANMatch = arg_bIsLAN;
+	SessionSettings->bUsesPresence = arg_bIsPresence;
+	SessionSettings->NumPublicConnections = arg_MaxNumPlayers;
+	SessionSettings->NumPrivateConnections = 0;
+	SessionSettings->bAllowInvites = true;
+	SessionSettings->bAllowJoinInProgress = true;
+	SessionSettings->bShouldAdvertise = true;
+	SessionSettings->bAllowJoinViaPresence = arg_bIsPresence;
+	SessionSettings->bAllowJoinViaPresenceFriendsOnly = false;
+
+	if (!arg_Map.ToString().IsEmpty())
+	{
+		SessionInfo.GameMapName = arg_Map;
+		SessionSettings->Set(SETTING_MAPNAME, SessionInfo.GameMapName.ToString(), EOnlineDataAdvertisementType::ViaOnlineService);
+	}
+
+	// Live values are updated by AdvertiseSessionLoad once the session started
+	SessionSettings->Set(SETTING_OSERVERLOAD, 0.0f, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_ONUMPLAYERS, 0, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_OFRAMEMS, 0.0f, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_OTICKHEADROOM, 1.0f, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_OMATCHPHASE, FString(TEXT("Starting")), EOnlineDataAdvertisementType::ViaOnlineService);
+
+	// Searched by, see BuildSessionQuery
+	SessionSettings->Set(SETTING_OBUILDVERSION, GetBuildVersion(), EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_GAMEMODE, GetSessionGameModeName(arg_Map), EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_OREGION, MatchmakingRegion, EOnlineDataAdvertisementType::ViaOnlineService);
+}
+
+FString UOGameInstance::GetSessionGameModeName(FName arg_Map) const
+{
+	// Hosts creating the session from another map, like the menu, advertise the default game mode
+	const UWorld* World = GetWorld();
+	const AGameModeBase* GameMode = World ? World->GetAuthGameMode() : nullptr;
+	const bool bPlaysMap = GameMode && World->GetMapName() == FPackageName::GetShortName(arg_Map.ToString());
+
+	return FPackageName::ObjectPathToObjectName(bPlaysMap ? GameMode->GetClass()->GetPathName() : UGameMapsSettings::GetGlobalDefaultGameMode());
+}
+
+FString UOGameInstance::GetBuildVersion()
+{
+	// Config can't change the version while the process runs
+	static const FString BuildVersion = []()
+	{
+		FString Version;
+		if (!GConfig->GetString(TEXT("OnlineSubsystemSteam"), TEXT("GameVersion"), Version, GEngineIni) || Version.IsEmpty())
+		{
+			Version = GetDefault<UGeneralProjectSettings>()->ProjectVersion;
+		}
+
+		return Version;
+	}();
+
+	return BuildVersion;
+}
+
+void UOGameInstance::SetSessionQuery(const FOSessionQuery& arg_Query)
+{
+	SessionQuery = arg_Query;
+	SessionSearchCache.Empty();
+}
+
+void UOGameInstance::BuildSessionQuery(FOnlineSearchSettings& arg_QuerySettings, bool arg_bIsPresence) const
+{
+	if (arg_bIsPresence)
+	{
+		arg_QuerySettings.Set(SEARCH_PRESENCE, arg_bIsPresence, EOnlineComparisonOp::Equals);
+	}
+
+	if (SessionQuery.bSameBuildOnly)
+	{
+		arg_QuerySettings.Set(SETTING_OBUILDVERSION, GetBuildVersion(), EOnlineComparisonOp::Equals);
+	}
+
+	if (!SessionQuery.MapName.IsEmpty())
+	{
+		arg_QuerySettings.Set(SETTING_MAPNAME, SessionQuery.MapName, EOnlineComparisonOp::Equals);
+	}
+
+	if (!SessionQuery.GameMode.IsEmpty())
+	{
+		arg_QuerySettings.Set(SETTING_GAMEMODE, SessionQuery.GameMode, EOnlineComparisonOp::Equals);
+	}
+
+	if (!SessionQuery.Region.IsEmpty())
+	{
+		arg_QuerySettings.Set(SETTING_OREGION, SessionQuery.Region, EOnlineComparisonOp::Equals);
+	}
+
+	if (SessionQuery.MinFreeSlots > 0)
+	{
+		arg_QuerySettings.Set(SEARCH_MINSLOTSAVAILABLE, SessionQuery.MinFreeSlots, EOnlineComparisonOp::GreaterThanEquals);
+	}
+}
+
+bool UOGameInstance::MatchesSessionQuery(const FOnlineSessionSearchResult& arg_SearchResult) const
+{
+	const FOnlineSessionSettings& Settings = arg_SearchResult.Session.SessionSettings;
+	FString Value;
+
+	if (SessionQuery.bSameBuildOnly && !IsSessionCompatible(arg_SearchResult))
+	{
+		return false;
+	}
+
+	if (!SessionQuery.MapName.IsEmpty() && (!Settings.Get(SETTING_MAPNAME, Value) || Value != SessionQuery.MapName))
+	{
+		return false;
+	}
+
+	if (!SessionQuery.GameMode.IsEmpty() && (!Settings.Get(SETTING_GAMEMODE, Value) || Value != SessionQuery.GameMode))
+	{
+		return false;
+	}
+
+	if (!SessionQuery.Region.IsEmpty() && (!Settings.Get(SETTING_OREGION, Value) || Value != SessionQuery.Region))
+	{
+		return false;
+	}
+
+	return arg_SearchResult.Session.NumOpenPublicConnections >= SessionQuery.MinFreeSlots;
+}
+
+bool UOGameInstance::IsSessionCompatible(const FOnlineSessionSearchResult& arg_SearchResult, FString* arg_OutReason) const
+{
+	FString HostBuildVersion;
+	if (!arg_SearchResult.Session.SessionSettings.Get(SETTING_OBUILDVERSION, HostBuildVersion))
+	{
+		// Builds older than the version setting can't be compatible either
+		HostBuildVersion = TEXT("unknown");
+	}
+
+	if (HostBuildVersion != GetBuildVersion())
+	{
+		if (arg_OutReason)
+		{
+			*arg_OutReason = FString::Printf(TEXT("host runs build %s, this is %s"), *HostBuildVersion, *GetBuildVersion());
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+bool UOGameInstance::CreateSession(TSharedPtr<const FUniqueNetId> arg_UserId, FName arg_SessionName, FName arg_Map, bool arg_bIsLAN, bool arg_bIsPresence, int32 arg_MaxNumPlayers)
+{
+	if (!arg_UserId.IsValid())
+	{
+		return false;
+	}
+
+	FSessionRequest Request;
+	Request.Type = ESessionRequestType::Create;
+	Request.UserId = arg_UserId;
+	Request.SessionName = arg_SessionName;
+	Request.Map = arg_Map;
+	Request.bIsLAN = arg_bIsLAN;
+	Request.bIsPresence = arg_bIsPresence;
+	Request.MaxNumPlayers = arg_MaxNumPlayers;
+
+	return RequestSessionOperation(Request);
+}
+
+bool UOGameInstance::ExecuteCreateSession(const FSessionRequest& arg_Request)
+{
+	// Get the Session Interface, so we can call the "CreateSession" function on it
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+
+	if (!OnlineSessionInterface.IsValid())
+	{
+		O_DIAG(LogOSession, Warning, TEXT("No online subsystem %s found"), *OnlineSubsystemName.ToString());
+		return false;
+	}
+
+	if (!arg_Request.bIsDedicated && !arg_Request.UserId.IsValid())
+	{
+		return false;
+	}
+
+	InitSessionSettings(arg_Request.Map, arg_Request.bIsLAN, arg_Request.bIsPresence, arg_Request.MaxNumPlayers);
+	SessionSettings->bIsDedicated = arg_Request.bIsDedicated;
+
+	PendingSessionName = arg_Request.SessionName;
+	SetSessionState(EOSessionState::Creating);
+
+	FOTelemetry::Get().BeginTimer(EOTelemetryTimer::SessionCreate, this, arg_Request.SessionName);
+
+	// OnCreateSessionComplete gets called once this is complete (doesn't need to be successful!), possibly before it returns.
+	// Hosting player 0 of a dedicated server is the server itself
+	const bool bStarted = arg_Request.bIsDedicated
+		? OnlineSessionInterface->CreateSession(0, arg_Request.SessionName, *SessionSettings)
+		: OnlineSessionInterface->CreateSession(*arg_Request.UserId, arg_Request.SessionName, *SessionSettings);
+
+	if (!bStarted && SessionState == EOSessionState::Creating)
+	{
+		FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionCreate, this, arg_Request.SessionName);
+		SetSessionState(EOSessionState::Idle);
+	}
+
+	return bStarted;
+}
+
+bool UOGameInstance::JoinSession(TSharedPtr<const FUniqueNetId> arg_UserId, FName arg_SessionName, const FOnlineSessionSearchResult & arg_SearchResult)
+{
+	if (!arg_UserId.IsValid() || !arg_SearchResult.IsValid())
+	{
+		return false;
+	}
+
+	FSessionRequest Request;
+	Request.Type = ESessionRequestType::Join;
+	Request.UserId = arg_UserId;
+	Request.SessionName = arg_SessionName;
+	Request.SearchResult = arg_SearchResult;
+
+	return RequestSessionOperation(Request);
+}
+
+bool UOGameInstance::ExecuteJoinSession(const FSessionRequest& arg_Request)
+{
+	if (!arg_Request.UserId.IsValid())
+	{
+		return false;
+	}
+
+	if (arg_Request.SearchResult.IsValid())
+	{
+		JoinCandidates.Reset();
+		JoinCandidates.Add(arg_Request.SearchResult);
+		NextJoinCandidate = 0;
+	}
+	else if (SessionSearch.IsValid())
+	{
+		// Pick the best session instead of the first one, and keep the rest to fall back on
+		BuildJoinCandidates(*arg_Request.UserId);
+	}
+	else
+	{
+		return false;
+	}
+
+	SetSessionState(EOSessionState::Joining);
+
+	return TryNextJoinCandidate();
+}
+
+bool UOGameInstance::StartJoinSession(TSharedPtr<const FUniqueNetId> arg_UserId, FName arg_SessionName, const FOnlineSessionSearchResult& arg_SearchResult)
+{
+	// Get SessionInterface from the OnlineSubsystem
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+
+	// Hosts of other builds would drop the connection after the handshake, or worse accept it
+	FString IncompatibleReason;
+	if (!IsSessionCompatible(arg_SearchResult, &IncompatibleReason))
+	{
+		O_DIAG(LogOSession, Warning, TEXT("Not joining session of %s: %s"), *arg_SearchResult.Session.OwningUserName, *IncompatibleReason);
+		FOTelemetry::Get().Increment(EOTelemetryCounter::IncompatibleJoinsRejected);
+		return false;
+	}
+
+	if (OnlineSessionInterface.IsValid() && arg_UserId.IsValid())
+	{
+		// Call the "JoinSession" Function with the passed "SearchResult". The "SessionSearch->SearchResults" can be used to get such a
+		// "FOnlineSessionSearchResult" and pass it. Pretty straight forward!
+		FOTelemetry::Get().BeginTimer(EOTelemetryTimer::SessionJoin, this, arg_SessionName);
+		JoinStartTime = FPlatformTime::Seconds();
+
+		// Loading the map and the character overlaps with joining and connecting, instead of starting once the client travels
+		PreloadSessionAssets(arg_SearchResult);
+
+		if (OnlineSessionInterface->JoinSession(*arg_UserId, arg_SessionName, arg_SearchResult))
+		{
+			return true;
+		}
+
+		FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionJoin, this, arg_SessionName);
+		return false;
+	}
+
+	return false;
+}
+
+void UOGameInstance::FindSessions(TSharedPtr<const FUniqueNetId> arg_UserId, bool arg_bIsLAN, bool arg_bIsPresence, bool arg_bForceRefresh)
+{
+	if (!arg_UserId.IsValid())
+	{
+		return;
+	}
+
+	FSessionRequest Request;
+	Request.Type = ESessionRequestType::Find;
+	Request.UserId = arg_UserId;
+	Request.bIsLAN = arg_bIsLAN;
+	Request.bIsPresence = arg_bIsPresence;
+	Request.bForceRefresh = arg_bForceRefresh;
+
+	RequestSessionOperation(Request);
+}
+
+bool UOGameInstance::ExecuteFindSessions(const FSessionRequest& arg_Request)
+{
+	// Get the SessionInterface from our OnlineSubsystem
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+
+	if (!OnlineSessionInterface.IsValid() || !arg_Request.UserId.IsValid())
+	{
+		O_DIAG(LogOSession, Warning, TEXT("No online subsystem %s found"), *OnlineSubsystemName.ToString());
+		return false;
+	}
+
+	StateBeforeSearch = SessionState;
+	SetSessionState(EOSessionState::Searching);
+
+	SessionSearchCacheKey = (arg_Request.bIsLAN ? 1 : 0) | (arg_Request.bIsPresence ? 2 : 0);
+	SessionSearchTimings = FOSessionSearchTimings();
+	SessionSearchStartTime = FPlatformTime::Seconds();
+	NumStreamedSearchResults = 0;
+	RankedSearchIndices.Reset();
+
+	// Repeated browser refreshes are served from the cache until it expires
+	const FSessionSearchCacheEntry* CacheEntry = SessionSearchCache.Find(SessionSearchCacheKey);
+	if (!arg_Request.bForceRefresh && CacheEntry && FPlatformTime::Seconds() - CacheEntry->Time < SearchCacheTimeToLive)
+	{
+		SessionSearch = CacheEntry->Search;
+		RankedSearchIndices = CacheEntry->RankedSearchIndices;
+		SessionSearchTimings.bFromCache = true;
+
+		CompleteSessionSearch(true);
+		return true;
+	}
+
+	SessionSearch = MakeShareable(new FOnlineSessionSearch());
+	SessionSearch->bIsLanQuery = arg_Request.bIsLAN;
+	SessionSearch->MaxSearchResults = MaxSearchResults;
+	SessionSearch->PingBucketSize = PingBucketSize;
+
+	BuildSessionQuery(SessionSearch->QuerySettings, arg_Request.bIsPresence);
+
+	TSharedRef<FOnlineSessionSearch> SearchSettingsRef = SessionSearch.ToSharedRef();
+
+	// The subsystem appends results to the search as servers respond, poll them so the browser fills in while the search runs
+	StopSessionSearchPolling();
+	SessionSearchPollHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UOGameInstance::PollSessionSearch), SearchPollInterval);
+
+	FOTelemetry::Get().Increment(EOTelemetryCounter::SessionSearches);
+
+	// Finally call the SessionInterface function. OnFindSessionsComplete gets called once this is finished
+	if (!OnlineSessionInterface->FindSessions(*arg_Request.UserId, SearchSettingsRef) && SessionState == EOSessionState::Searching)
+	{
+		CompleteSessionSearch(false);
+		return false;
+	}
+
+	return true;
+}
+
+bool UOGameInstance::PollSessionSearch(float arg_DeltaTime)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OSessionSearchPoll);
+
+	if (!SessionSearch.IsValid())
+	{
+		SessionSearchPollHandle.Reset();
+		return false;
+	}
+
+	StreamNewSearchResults();
+
+	const bool bKeepPolling = SessionSearch->SearchState == EOnlineAsyncTaskState::InProgress || SessionSearch->SearchState == EOnlineAsyncTaskState::NotStarted;
+	if (!bKeepPolling)
+	{
+		SessionSearchPollHandle.Reset();
+	}
+
+	return bKeepPolling;
+}
+
+void UOGameInstance::StreamNewSearchResults()
+{
+	const int32 NumResults = SessionSearch->SearchResults.Num();
+
+	if (NumResults > NumStreamedSearchResults && SessionSearchTimings.TimeToFirstResult < 0.0f)
+	{
+		SessionSearchTimings.TimeToFirstResult = FPlatformTime::Seconds() - SessionSearchStartTime;
+	}
+
+	for (; NumStreamedSearchResults < NumResults; NumStreamedSearchResults++)
+	{
+		const FOnlineSessionSearchResult& SearchResult = SessionSearch->SearchResults[NumStreamedSearchResults];
+		if (MatchesSessionQuery(SearchResult))
+		{
+			OnSessionSearchResult.Broadcast(MakeSessionSearchEntry(SearchResult, NumStreamedSearchResults));
+		}
+	}
+}
+
+void UOGameInstance::CompleteSessionSearch(bool arg_bWasSuccessful)
+{
+	StopSessionSearchPolling();
+
+	TArray<FOSessionSearchEntry> RankedEntries;
+
+	if (SessionSearch.IsValid())
+	{
+		if (!SessionSearchTimings.bFromCache)
+		{
+			// Whatever arrived since the last poll
+			StreamNewSearchResults();
+
+			// The results stay where they arrived, streamed entries already point at them by index
+			const TArray<FOnlineSessionSearchResult>& SearchResults = SessionSearch->SearchResults;
+			RankedSearchIndices.Reset(SearchResults.Num());
+			for (int32 SearchIdx = 0; SearchIdx < SearchResults.Num(); SearchIdx++)
+			{
+				if (MatchesSessionQuery(SearchResults[SearchIdx]))
+				{
+					RankedSearchIndices.Add(SearchIdx);
+				}
+			}
+
+			SessionSearchTimings.NumFiltered = SearchResults.Num() - RankedSearchIndices.Num();
+
+			// Rank by the latency the subsystem measured for every result
+			RankedSearchIndices.StableSort([&SearchResults](int32 A, int32 B)
+			{
+				return SearchResults[A].PingInMs < SearchResults[B].PingInMs;
+			});
+
+			if (arg_bWasSuccessful)
+			{
+				FSessionSearchCacheEntry& CacheEntry = SessionSearchCache.FindOrAdd(SessionSearchCacheKey);
+				CacheEntry.Search = SessionSearch;
+				CacheEntry.RankedSearchIndices = RankedSearchIndices;
+				CacheEntry.Time = FPlatformTime::Seconds();
+			}
+		}
+
+		RankedEntries.Reserve(RankedSearchIndices.Num());
+		for (int32 SearchIdx : RankedSearchIndices)
+		{
+			RankedEntries.Add(MakeSessionSearchEntry(SessionSearch->SearchResults[SearchIdx], SearchIdx));
+		}
+	}
+
+	SessionSearchTimings.NumResults = RankedEntries.Num();
+	SessionSearchTimings.TimeToFullList = FPlatformTime::Seconds() - SessionSearchStartTime;
+	if (SessionSearchTimings.bFromCache && RankedEntries.Num() > 0)
+	{
+		SessionSearchTimings.TimeToFirstResult = SessionSearchTimings.TimeToFullList;
+	}
+
+	if (!SessionSearchTimings.bFromCache)
+	{
+		FOTelemetry::Get().Record(EOTelemetryHistogram::SessionFindMs, SessionSearchTimings.TimeToFullList * 1000.0);
+	}
+	if (!arg_bWasSuccessful)
+	{
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionSearchFailures);
+	}
+
+	UE_LOG(LogOGameInstance, Log, TEXT("Session search: %d results | %d filtered | first result %.3f s | full list %.3f s | cached %d"),
+		SessionSearchTimings.NumResults, SessionSearchTimings.NumFiltered, SessionSearchTimings.TimeToFirstResult, SessionSearchTimings.TimeToFullList, SessionSearchTimings.bFromCache);
+
+	OnSessionSearchComplete.Broadcast(arg_bWasSuccessful, RankedEntries, SessionSearchTimings);
+
+	// Back to where the search started from, which starts the next queued request
+	if (SessionState == EOSessionState::Searching)
+	{
+		SetSessionState(StateBeforeSearch);
+	}
+}
+
+void UOGameInstance::StopSessionSearchPolling()
+{
+	if (SessionSearchPollHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(SessionSearchPollHandle);
+		SessionSearchPollHandle.Reset();
+	}
+}
+
+void UOGameInstance::StartLoadAdvertisement()
+{
+	if (SessionState != EOSessionState::InProgress || !SessionSettings.IsValid() || LoadAdvertisementTickHandle.IsValid())
+	{
+		return;
+	}
+
+	LoadFrameSeconds = 0.0;
+	LoadNumFrames = 0;
+	LastLoadAdvertisementTime = FPlatformTime::Seconds();
+	AdvertisedNumPlayers = 0;
+	AdvertisedServerLoad = 0.0f;
+	AdvertisedMatchPhase = TEXT("Starting");
+	bSessionUpdatePending = false;
+
+	// Every frame, the frame time average has to cover all of them
+	LoadAdvertisementTickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UOGameInstance::TickLoadAdvertisement), 0.0f);
+}
+
+void UOGameInstance::StopLoadAdvertisement()
+{
+	if (LoadAdvertisementTickHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(LoadAdvertisementTickHandle);
+		LoadAdvertisementTickHandle.Reset();
+	}
+
+	bSessionUpdatePending = false;
+}
+
+bool UOGameInstance::TickLoadAdvertisement(float arg_DeltaTime)
+{
+	// The session is being destroyed or this instance went on to search or join
+	if (SessionState != EOSessionState::InProgress || !SessionSettings.IsValid())
+	{
+		LoadAdvertisementTickHandle.Reset();
+		bSessionUpdatePending = false;
+		return false;
+	}
+
+	LoadFrameSeconds += FMath::Max(FApp::GetDeltaTime() - FApp::GetIdleTime(), 0.0);
+	LoadNumFrames++;
+
+	// Joins and leaves in between end up in one update, and a running update is never overtaken
+	if (!bSessionUpdatePending && FPlatformTime::Seconds() - LastLoadAdvertisementTime >= LoadAdvertisementInterval)
+	{
+		AdvertiseSessionLoad();
+	}
+
+	return true;
+}
+
+bool UOGameInstance::AdvertiseSessionLoad()
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OLoadAdvertisement);
+
+	const float FrameMs = (LoadNumFrames > 0) ? static_cast<float>(LoadFrameSeconds / LoadNumFrames * 1000.0) : 0.0f;
+	LoadFrameSeconds = 0.0;
+	LoadNumFrames = 0;
+	LastLoadAdvertisementTime = FPlatformTime::Seconds();
+
+	UWorld* World = GetWorld();
+	const AGameModeBase* GameMode = World ? World->GetAuthGameMode() : nullptr;
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+	if (GameMode == nullptr || !OnlineSessionInterface.IsValid())
+	{
+		return false;
+	}
+
+	const UNetDriver* NetDriver = World->GetNetDriver();
+	const float FrameBudgetMs = 1000.0f / FMath::Max(NetDriver ? NetDriver->NetServerMaxTickRate : 30, 1);
+	const float TickHeadroom = FMath::Clamp(1.0f - FrameMs / FrameBudgetMs, 0.0f, 1.0f);
+
+	// A server is as loaded as its fullest resource, slots or frame budget
+	const int32 NumPlayers = GameMode->GetNumPlayers();
+	const float SlotLoad = (SessionSettings->NumPublicConnections > 0) ? NumPlayers / static_cast<float>(SessionSettings->NumPublicConnections) : 0.0f;
+	const float ServerLoad = FMath::Clamp(FMath::Max(SlotLoad, 1.0f - TickHeadroom), 0.0f, 1.0f);
+
+	const FString MatchPhase = World->IsInSeamlessTravel() ? TEXT("Travelling") : GameMode->HasMatchStarted() ? TEXT("InProgress") : TEXT("Starting");
+
+	if (NumPlayers == AdvertisedNumPlayers && MatchPhase == AdvertisedMatchPhase && FMath::Abs(ServerLoad - AdvertisedServerLoad) < LoadAdvertisementThreshold)
+	{
+		return false;
+	}
+
+	SessionSettings->Set(SETTING_OSERVERLOAD, ServerLoad, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_ONUMPLAYERS, NumPlayers, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_OFRAMEMS, FrameMs, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_OTICKHEADROOM, TickHeadroom, EOnlineDataAdvertisementType::ViaOnlineService);
+	SessionSettings->Set(SETTING_OMATCHPHASE, MatchPhase, EOnlineDataAdvertisementType::ViaOnlineService);
+
+	// Taken as advertised right away, a failed update resets them so the next interval sends again
+	AdvertisedNumPlayers = NumPlayers;
+	AdvertisedServerLoad = ServerLoad;
+	AdvertisedMatchPhase = MatchPhase;
+	bSessionUpdatePending = true;
+
+	O_DIAG(LogOSession, Verbose, TEXT("Advertising %s: %d players | load %.2f | frame %.1f ms | headroom %.2f | %s"),
+		*SessionInfo.SessionName.ToString(), NumPlayers, ServerLoad, FrameMs, TickHeadroom, *MatchPhase);
+
+	FOTelemetry::Get().Increment(EOTelemetryCounter::SessionLoadUpdates);
+
+	// OnUpdateSessionComplete gets called once this is complete, possibly before it returns
+	if (!OnlineSessionInterface->UpdateSession(SessionInfo.SessionName, *SessionSettings, true))
+	{
+		bSessionUpdatePending = false;
+		AdvertisedNumPlayers = INDEX_NONE;
+		return false;
+	}
+
+	return true;
+}
+
+void UOGameInstance::OnUpdateSessionComplete(FName arg_SessionName, bool arg_bWasSuccessful)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OUpdateSessionComplete);
+
+	if (arg_SessionName != SessionInfo.SessionName || !bSessionUpdatePending)
+	{
+		return;
+	}
+
+	bSessionUpdatePending = false;
+
+	if (!arg_bWasSuccessful)
+	{
+		O_DIAG(LogOSession, Warning, TEXT("Failed to advertise the load of %s"), *arg_SessionName.ToString());
+		AdvertisedNumPlayers = INDEX_NONE;
+	}
+}
+
+bool UOGameInstance::RequestPlacement(int32 arg_PartySize)
+{
+	if (IsPlacing() || IsRunningDedicatedServer() || !StartMatchmaking())
+	{
+		return false;
 	}
-	else
+
+	FString RegionPings;
+	for (const TPair<FString, int32>& RegionPing : MatchmakingRegionPings)
 	{
-		GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, TEXT("No OnlineSubsytem found!"));
+		RegionPings += FString::Printf(TEXT("%s%s:%d"), RegionPings.IsEmpty() ? TEXT("") : TEXT(","), *RegionPing.Key, RegionPing.Value);
 	}
-}
 
-bool UOGameInstance::HostSession(FName arg_SessionName, FName arg_Map, bool arg_bIsLAN, bool arg_bIsPresence, int32 arg_MaxNumPlayers)
-{
-	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
-	if (LocalPlayer->IsValidLowLevelFast())
+	if (RegionPings.IsEmpty())
 	{
-		FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(LocalPlayer->GetPreferredUniqueNetId());
-		return CreateSession(UniqueNetIdWrapper.GetUniqueNetId(), arg_SessionName, arg_Map, arg_bIsLAN, arg_bIsPresence, arg_MaxNumPlayers);
+		RegionPings = MatchmakingRegion + TEXT(":0");
 	}
 
-	return false;
+	PlacementStartTime = FPlatformTime::Seconds();
+	LastMatchmakingSendTime = PlacementStartTime;
+	PlacementMessage = FString::Printf(TEXT("PLACE %u %d %s"), ++PlacementRequestId, FMath::Max(arg_PartySize, 1), *RegionPings);
+
+	O_DIAG(LogOSession, Log, TEXT("Requesting placement %u from %s"), PlacementRequestId, *MatchmakerAddress);
+
+	// Repeated by TickMatchmaking until the service answers
+	MatchmakingSocket->Send(PlacementMessage, MatchmakerAddress);
+	return true;
 }
 
-bool UOGameInstance::FindSessions(bool arg_bIsLAN, bool arg_bIsPresence)
+void UOGameInstance::CancelPlacement()
 {
-	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
-	if (LocalPlayer->IsValidLowLevelFast())
+	if (!IsPlacing())
 	{
-		FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(LocalPlayer->GetPreferredUniqueNetId());
-		FindSessions(UniqueNetIdWrapper.GetUniqueNetId(), arg_bIsLAN, arg_bIsPresence);
+		return;
+	}
 
-		return true;
+	if (MatchmakingSocket.IsValid() && MatchmakingSocket->IsOpen())
+	{
+		MatchmakingSocket->Send(FString::Printf(TEXT("CANCEL %u"), PlacementRequestId), MatchmakerAddress);
 	}
 
-	return false;
+	PlacementMessage.Empty();
 }
 
-bool UOGameInstance::JoinSession()
+bool UOGameInstance::StartMatchmaking()
 {
-	const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
+	if (MatchmakerAddress.IsEmpty())
+	{
+		return false;
+	}
 
-	if (LocalPlayer->IsValidLowLevelFast())
+	if (!MatchmakingSocket.IsValid())
 	{
-		// Just a SearchResult where we can save the one we want to use, for the case we find more than one!
-		FOnlineSessionSearchResult SearchResult;
+		MatchmakingSocket = MakeShared<FOMatchmakingSocket>();
+	}
 
-		// If the Array is not empty, we can go through it
-		if (SessionSearch->SearchResults.Num() > 0)
-		{
-			for (int32 i = 0; i < SessionSearch->SearchResults.Num(); i++)
-			{
-				if (SessionSearch->SearchResults[i].Session.OwningUserId != LocalPlayer->GetPreferredUniqueNetId())
-				{
-					SearchResult = SessionSearch->SearchResults[i];
-					FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(LocalPlayer->GetPreferredUniqueNetId());
-					return JoinSession(UniqueNetIdWrapper.GetUniqueNetId(), GameSessionName, SearchResult);
+	if (!MatchmakingSocket->IsOpen() && !MatchmakingSocket->Open(0))
+	{
+		O_DIAG(LogOSession, Warning, TEXT("Failed to open a socket to the matchmaking service at %s"), *MatchmakerAddress);
+		return false;
+	}
 
-					break;
-				}
-			}
-		}
+	if (!MatchmakingTickHandle.IsValid())
+	{
+		LastMatchmakingSendTime = 0.0;
+		MatchmakingTickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UOGameInstance::TickMatchmaking), 0.1f);
 	}
 
-	return false;
+	return true;
 }
 
-void UOGameInstance::DestroySession()
+void UOGameInstance::StopMatchmaking()
 {
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
-	{
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+	CancelPlacement();
 
-		if (OnlineSessionInterface.IsValid())
-		{
-			OnlineSessionInterface->AddOnDestroySessionCompleteDelegate_Handle(OnDestroySessionCompleteDelegate);
-			OnlineSessionInterface->DestroySession(SessionInfo.SessionName);
-		}
+	if (MatchmakingTickHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(MatchmakingTickHandle);
+		MatchmakingTickHandle.Reset();
 	}
-}
 
-bool UOGameInstance::SendSessionInviteToFriend(const FString& arg_FriendUniqueNetId)
-{
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	if (MatchmakingSocket.IsValid())
 	{
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
-
-		if (OnlineSessionInterface.IsValid())
-		{
-			const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
-			if (LocalPlayer->IsValidLowLevelFast())
-			{
-				FUniqueNetId* FriendUniqueNetId = new FUniqueNetIdString(arg_FriendUniqueNetId);
-				return OnlineSessionInterface->SendSessionInviteToFriend(LocalPlayer->GetControllerId(), GameSessionName, *FriendUniqueNetId);
-			}
-		}
+		MatchmakingSocket->Close();
 	}
 
-	return false;
+	bMatchmakingHost = false;
 }
 
-bool UOGameInstance::CreateSession(TSharedPtr<const FUniqueNetId> arg_UserId, FName arg_SessionName, FName arg_Map, bool arg_bIsLAN, bool arg_bIsPresence, int32 arg_MaxNumPlayers)
+bool UOGameInstance::TickMatchmaking(float arg_DeltaTime)
 {
-	// Get the Online Subsystem to work with
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-
-	if (OnlineSubsystemInterface)
+	FString Message;
+	FString SenderAddress;
+	while (MatchmakingSocket->Receive(Message, SenderAddress))
 	{
-		// Get the Session Interface, so we can call the "CreateSession" function on it
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
-
-		if (OnlineSessionInterface.IsValid() && arg_UserId.IsValid())
+		// Anybody can send datagrams to the port, only the service may start matches or place this client
+		if (!FOMatchmakingSocket::IsSameAddress(SenderAddress, MatchmakerAddress))
 		{
-			SessionSettings = MakeShareable(new FOnlineSessionSettings());
-
-			SessionSettings->bIsLANMatch = arg_bIsLAN;
-			SessionSettings->bUsesPresence = arg_bIsPresence;
-			SessionSettings->NumPublicConnections = arg_MaxNumPlayers;
-			SessionSettings->NumPrivateConnections = 0;
-			SessionSettings->bAllowInvites = true;
-			SessionSettings->bAllowJoinInProgress = true;
-			SessionSettings->bShouldAdvertise = true;
-			SessionSettings->bAllowJoinViaPresence = true;
-			SessionSettings->bAllowJoinViaPresenceFriendsOnly = false;
+			O_DIAG(LogOSession, Verbose, TEXT("Ignoring matchmaking message from %s, the matchmaking service is %s"), *SenderAddress, *MatchmakerAddress);
+			continue;
+		}
 
-			if (!arg_Map.ToString().IsEmpty())
-			{
-				SessionInfo.GameMapName = arg_Map;
-				SessionSettings->Set(SETTING_MAPNAME, SessionInfo.GameMapName, EOnlineDataAdvertisementType::ViaOnlineService);
-			}
+		HandleMatchmakingMessage(Message);
+	}
 
-			// Set the delegate to the Handle of the SessionInterface
-			OnCreateSessionCompleteDelegateHandle = OnlineSessionInterface->AddOnCreateSessionCompleteDelegate_Handle(OnCreateSessionCompleteDelegate);
+	const double Now = FPlatformTime::Seconds();
+	if (Now - LastMatchmakingSendTime >= MatchmakingHeartbeatInterval)
+	{
+		LastMatchmakingSendTime = Now;
 
-			// Our delegate should get called when this is complete (doesn't need to be successful!)
-			return OnlineSessionInterface->CreateSession(*arg_UserId, arg_SessionName, *SessionSettings);
+		if (bMatchmakingHost)
+		{
+			SendMatchmakingHeartbeats();
 		}
-		else
+
+		// Datagrams get lost, the service answers a repeated request with the result it already has
+		if (IsPlacing())
 		{
-			return false;
+			MatchmakingSocket->Send(PlacementMessage, MatchmakerAddress);
 		}
 	}
-	else
+
+	if (IsPlacing() && Now - PlacementStartTime > PlacementTimeout)
 	{
-		GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, TEXT("No OnlineSubsytem found!"));
+		MatchmakingSocket->Send(FString::Printf(TEXT("CANCEL %u"), PlacementRequestId), MatchmakerAddress);
+		CompletePlacement(false, FString());
+	}
 
+	if (!bMatchmakingHost && !IsPlacing())
+	{
+		MatchmakingTickHandle.Reset();
+		MatchmakingSocket->Close();
 		return false;
 	}
+
+	return true;
 }
 
-bool UOGameInstance::JoinSession(TSharedPtr<const FUniqueNetId> arg_UserId, FName arg_SessionName, const FOnlineSessionSearchResult & arg_SearchResult)
+void UOGameInstance::SendMatchmakingHeartbeats()
 {
-	// Get OnlineSubsystem we want to work with
-	IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
+	// Tokens of the protocol are separated by whitespace
+	const FString HostId = FString::Printf(TEXT("%s-%u"), FPlatformProcess::ComputerName(), FPlatformProcess::GetCurrentProcessId()).Replace(TEXT(" "), TEXT("_"));
+	const FString Region = MatchmakingRegion.Replace(TEXT(" "), TEXT("_"));
+
+	FString PublicAddress = MatchmakingPublicAddress;
+	if (PublicAddress.IsEmpty())
+	{
+		bool bCanBindAll = false;
+		TSharedPtr<FInternetAddr> LocalAddress = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLocalHostAddr(*GLog, bCanBindAll);
+		PublicAddress = LocalAddress.IsValid() ? LocalAddress->ToString(false) : TEXT("127.0.0.1");
+	}
 
-	if (OnlineSubsystemInterface)
+	TArray<UOGameInstance*> Instances(MatchInstances);
+	Instances.Insert(this, 0);
+
+	for (const UOGameInstance* Instance : Instances)
 	{
-		// Get SessionInterface from the OnlineSubsystem
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+		const FOnlineSessionInfo* MatchInfo = Matches.Find(Instance->SessionInfo.SessionName);
+		const UWorld* World = Instance->GetWorld();
+		const AGameModeBase* GameMode = World ? World->GetAuthGameMode() : nullptr;
 
-		if (OnlineSessionInterface.IsValid() && arg_UserId.IsValid())
+		// Matches that are still starting register with their first heartbeat after that
+		if (Instance->SessionState != EOSessionState::InProgress || !Instance->SessionSettings.IsValid() || MatchInfo == nullptr || GameMode == nullptr)
 		{
-			// Call the "JoinSession" Function with the passed "SearchResult". The "SessionSearch->SearchResults" can be used to get such a
-			// "FOnlineSessionSearchResult" and pass it. Pretty straight forward!
-			return OnlineSessionInterface->JoinSession(*arg_UserId, arg_SessionName, arg_SearchResult);
+			continue;
 		}
-	}
 
-	return false;
+		const FString Message = FString::Printf(TEXT("SERVER %s %d %s/%s %s %s:%d %s %d %d"),
+			*HostId, MatchmakingMaxMatches, *HostId, *MatchInfo->SessionName.ToString(), *Region, *PublicAddress, MatchInfo->Port,
+			*MatchInfo->GameMapName.ToString(), Instance->SessionSettings->NumPublicConnections, GameMode->GetNumPlayers());
+
+		MatchmakingSocket->Send(Message, MatchmakerAddress);
+	}
 }
 
-void UOGameInstance::FindSessions(TSharedPtr<const FUniqueNetId> arg_UserId, bool arg_bIsLAN, bool arg_bIsPresence)
+void UOGameInstance::HandleMatchmakingMessage(const FString& arg_Message)
 {
-	// Get the OnlineSubsystem we want to work with
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
+	TArray<FString> Tokens;
+	arg_Message.ParseIntoArrayWS(Tokens);
 
-	if (OnlineSubsystemInterface)
+	if (Tokens.Num() == 2 && Tokens[0] == TEXT("STARTMATCH"))
 	{
-		// Get the SessionInterface from our OnlineSubsystem
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+		if (!bMatchmakingHost)
+		{
+			return;
+		}
 
-		if (OnlineSessionInterface.IsValid() && arg_UserId.IsValid())
+		if (Matches.Num() >= MatchmakingMaxMatches)
 		{
-			SessionSearch = MakeShareable(new FOnlineSessionSearch());
-			SessionSearch->bIsLanQuery = arg_bIsLAN;
-			SessionSearch->MaxSearchResults = 20;
-			SessionSearch->PingBucketSize = 50;
+			O_DIAG(LogOSession, Warning, TEXT("Matchmaking service asked for a match on %s, already running %d"), *Tokens[1], Matches.Num());
+			return;
+		}
 
-			if (arg_bIsPresence)
-			{
-				SessionSearch->QuerySettings.Set(SEARCH_PRESENCE, arg_bIsPresence, EOnlineComparisonOp::Equals);
-			}
+		StartAdditionalMatch(FName(*Tokens[1]), bMatchmakingLAN, MatchmakingMaxPlayers);
+		return;
+	}
+
+	if (!IsPlacing() || Tokens.Num() < 2 || static_cast<uint32>(FCString::Strtoui64(*Tokens[1], nullptr, 10)) != PlacementRequestId)
+	{
+		return;
+	}
 
-			TSharedRef<FOnlineSessionSearch> SearchSettingsRef = SessionSearch.ToSharedRef();
+	if (Tokens[0] == TEXT("PLACED") && Tokens.Num() == 3)
+	{
+		CompletePlacement(true, Tokens[2]);
+	}
+	else if (Tokens[0] == TEXT("FAILED"))
+	{
+		CompletePlacement(false, FString());
+	}
+	else if (Tokens[0] == TEXT("QUEUED") && Tokens.Num() == 3)
+	{
+		O_DIAG(LogOSession, Verbose, TEXT("Placement %u queued at position %s"), PlacementRequestId, *Tokens[2]);
+	}
+}
 
-			// Set the Delegate to the Delegate Handle of the FindSession function
-			OnFindSessionsCompleteDelegateHandle = OnlineSessionInterface->AddOnFindSessionsCompleteDelegate_Handle(OnFindSessionsCompleteDelegate);
+void UOGameInstance::CompletePlacement(bool arg_bWasSuccessful, const FString& arg_ServerAddress)
+{
+	const double PlacementSeconds = FPlatformTime::Seconds() - PlacementStartTime;
+	PlacementMessage.Empty();
 
-			// Finally call the SessionInterface function. The Delegate gets called once this is finished
-			OnlineSessionInterface->FindSessions(*arg_UserId, SearchSettingsRef);
-		}
+	if (arg_bWasSuccessful)
+	{
+		O_DIAG(LogOSession, Log, TEXT("Placement %u on %s after %.2f s"), PlacementRequestId, *arg_ServerAddress, PlacementSeconds);
+		FOTelemetry::Get().Record(EOTelemetryHistogram::PlacementMs, PlacementSeconds * 1000.0);
 	}
 	else
 	{
-		// If something goes wrong, just call the Delegate Function directly with "false".
-		OnFindSessionsComplete(false);
+		O_DIAG(LogOSession, Warning, TEXT("Placement %u failed after %.2f s"), PlacementRequestId, PlacementSeconds);
+	}
+
+	OnPlacementComplete.Broadcast(arg_bWasSuccessful, arg_ServerAddress);
+
+	APlayerController* PlayerController = GetFirstLocalPlayerController();
+	if (arg_bWasSuccessful && PlayerController)
+	{
+		PlayerController->ClientTravel(arg_ServerAddress, TRAVEL_Absolute);
 	}
 }
 
 void UOGameInstance::OnDestroySessionComplete(FName arg_SessionName, bool arg_bWasSuccessful)
 {
-	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OnDestroySessionComplete %s, %d"), *arg_SessionName.ToString(), arg_bWasSuccessful));
+	O_SCOPE_CYCLE_COUNTER(STAT_ODestroySessionComplete);
 
-	// Get the OnlineSubsystem we want to work with
-	IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	if (arg_SessionName != SessionInfo.SessionName)
 	{
-		// Get the SessionInterface from the OnlineSubsystem
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+		return;
+	}
 
-		if (OnlineSessionInterface.IsValid())
-		{
-			// Clear the Delegate
-			OnlineSessionInterface->ClearOnDestroySessionCompleteDelegate_Handle(OnDestroySessionCompleteDelegateHandle);
+	// A failed join attempt was cleaned up, go on with the next candidate
+	if (SessionState == EOSessionState::Joining)
+	{
+		TryNextJoinCandidate();
+		return;
+	}
 
-			// If it was successful, we just load another level
-			if (arg_bWasSuccessful)
-			{
-				UGameplayStatics::OpenLevel(GetWorld(), SessionInfo.EntryMapName, true);
-			}
-		}
+	if (SessionState != EOSessionState::Destroying)
+	{
+		return;
+	}
+
+	O_DIAG(LogOSession, Log, TEXT("OnDestroySessionComplete %s, %d"), *arg_SessionName.ToString(), arg_bWasSuccessful);
+
+	if (FOTelemetry::Get().EndTimer(EOTelemetryTimer::SessionDestroy, this, arg_SessionName, EOTelemetryHistogram::SessionDestroyMs) && arg_bWasSuccessful)
+	{
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionsDestroyed);
+	}
+
+#if O_DIAGNOSTICS
+	// Destroying closes a create or search, join and play cycle
+	FODiagnostics::LogAndResetCounts(TEXT("session cycle"));
+#endif
+
+	// If it was successful, we just load another level
+	if (arg_bWasSuccessful && bTravelToEntryMapOnDestroy)
+	{
+		UGameplayStatics::OpenLevel(GetWorld(), SessionInfo.EntryMapName, true);
 	}
+
+	SetSessionState(EOSessionState::Idle);
 }
 
 void UOGameInstance::OnReadFriendsListComplete(int32 arg_LocalUserNum, bool arg_bWasSuccessful, const FString& arg_FriendsListName, const FString& arg_ErrorString)
 {
-	if (arg_bWasSuccessful)
+	O_SCOPE_CYCLE_COUNTER(STAT_OReadFriendsListComplete);
+
+	// Reads of other game instances on the same friends interface
+	if (FriendsReadStartTime <= 0.0 || arg_LocalUserNum != FriendsLocalUserNum)
 	{
-		IOnlineFriendsPtr FriendInterface = Online::GetFriendsInterface();
+		return;
+	}
 
-		if (FriendInterface.IsValid())
-		{
-			FriendInterface->GetFriendsList(arg_LocalUserNum, arg_FriendsListName, FriendsList);
+	const double Now = FPlatformTime::Seconds();
+	FOTelemetry::Get().Record(EOTelemetryHistogram::FriendsReadMs, (Now - FriendsReadStartTime) * 1000.0);
+	FriendsReadStartTime = 0.0;
 
-			if (FriendsList.Num() > 0)
-			{
-				const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-				if (OnlineSubsystemInterface)
-				{
-					// Get the Session Interface to call the StartSession function
-					IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
-
-					for (size_t i = 0; i < FriendsList.Num(); i++)
-					{
-						if (FriendsList[i].Get().GetRealName().Contains("Pingu"))
-						{
-							FUniqueNetIdWrapper UniqueNetIdWrapper = FUniqueNetIdWrapper(FriendsList[i].Get().GetUserId());
-
-							const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
-
-							if (OnlineSessionInterface->SendSessionInviteToFriend(LocalPlayer->GetControllerId(), SessionInfo.SessionName, *UniqueNetIdWrapper.GetUniqueNetId()))
-							{
-								GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("Invited friend %d"), arg_bWasSuccessful));
-							}
-						}
-					}
-				}
-			}
-			else
-			{
-				GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, TEXT("No friends"));
-			}
-		}
+	const bool bAutoInvite = bAutoInviteOnFriendsRead;
+	bAutoInviteOnFriendsRead = false;
+
+	if (!arg_bWasSuccessful)
+	{
+		O_DIAG(LogOFriends, Warning, TEXT("Failed to read friends: %s"), *arg_ErrorString);
+		return;
 	}
-	else
+
+	const IOnlineSubsystem* OnlineSubsystemInterface = GetOnlineSubsystem();
+	IOnlineFriendsPtr FriendInterface = OnlineSubsystemInterface ? OnlineSubsystemInterface->GetFriendsInterface() : IOnlineFriendsPtr();
+	if (!FriendInterface.IsValid())
+	{
+		return;
+	}
+
+	TArray<TSharedRef<FOnlineFriend>> FriendsList;
+	FriendInterface->GetFriendsList(arg_LocalUserNum, arg_FriendsListName, FriendsList);
+
+	const FOFriendsCache::FApplyStats ApplyStats = FriendsCache.ApplyFriendsList(FriendsList, Now);
+	O_DIAG(LogOFriends, Log, TEXT("Friends read: %d friends | %d added | %d removed | %d renamed"),
+		FriendsCache.Num(), ApplyStats.NumAdded, ApplyStats.NumRemoved, ApplyStats.NumRenamed);
+
+	// Some backends complete the read before the session start finished, so only ask whether the session is still there
+	IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+	if (bAutoInvite && OnlineSessionInterface.IsValid() && OnlineSessionInterface->GetNamedSession(SessionInfo.SessionName) != nullptr)
 	{
-		GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("Failed to read friends: %s"), *arg_ErrorString));
+		InviteFriendsByName(AutoInviteFriendNames);
 	}
 }
 
+void UOGameInstance::OnFriendsChange()
+{
+	FriendsCache.MarkStale();
+}
+
 void UOGameInstance::OnSessionUserInviteAccepted(const bool arg_bWasSuccesful, const int32 arg_LocalUserNum, TSharedPtr<const FUniqueNetId> arg_NetId, const FOnlineSessionSearchResult& arg_SessionSearchResult)
 {
-	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OnSessionUserInviteAccepted: %d"), arg_bWasSuccesful));
+	O_DIAG(LogOSession, Log, TEXT("OnSessionUserInviteAccepted: %d"), arg_bWasSuccesful);
 
-	if (arg_bWasSuccesful)
+	// The request queue leaves the current session first if there is one
+	if (arg_bWasSuccesful && arg_SessionSearchResult.IsValid())
 	{
-		if (arg_SessionSearchResult.IsValid())
-		{
-			IOnlineSessionPtr SessionInt = IOnlineSubsystem::Get()->GetSessionInterface();
-			SessionInt->JoinSession(arg_LocalUserNum, GameSessionName, arg_SessionSearchResult);
-		}
+		JoinSession(arg_NetId, GameSessionName, arg_SessionSearchResult);
 	}
 }
 
 void UOGameInstance::OnCreateSessionComplete(FName arg_SessionName, bool arg_bWasSuccessful)
 {
-	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OnCreateSessionComplete %s, %d"), *arg_SessionName.ToString(), arg_bWasSuccessful));
+	O_SCOPE_CYCLE_COUNTER(STAT_OCreateSessionComplete);
 
-	// Get the OnlineSubsystem so we can get the Session Interface
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	// Every match game instance of the process listens to the same session interface
+	if (arg_SessionName != PendingSessionName || SessionState != EOSessionState::Creating)
 	{
-		// Get the Session Interface to call the StartSession function
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+		return;
+	}
 
-		if (OnlineSessionInterface.IsValid())
-		{
-			// Clear the SessionComplete delegate handle, since we finished this call
-			OnlineSessionInterface->ClearOnCreateSessionCompleteDelegate_Handle(OnCreateSessionCompleteDelegateHandle);
+	O_DIAG(LogOSession, Log, TEXT("OnCreateSessionComplete %s, %d"), *arg_SessionName.ToString(), arg_bWasSuccessful);
 
-			if (arg_bWasSuccessful)
-			{
-				// Set the StartSession delegate handle
-				OnStartSessionCompleteDelegateHandle = OnlineSessionInterface->AddOnStartSessionCompleteDelegate_Handle(OnStartSessionCompleteDelegate);
+	if (!arg_bWasSuccessful)
+	{
+		FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionCreate, this, arg_SessionName);
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionCreateFailures);
+		SetSessionState(EOSessionState::Idle);
+		return;
+	}
 
-				SessionInfo.SessionName = arg_SessionName;
-				OnlineSessionInterface->StartSession(SessionInfo.SessionName);
-			}
-		}
+	SessionInfo.SessionName = arg_SessionName;
+
+	// Cancelled while the backend was busy, the session is not wanted anymore
+	if (bSessionCancelRequested)
+	{
+		FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionCreate, this, arg_SessionName);
+		ExecuteDestroySession(false);
+		return;
+	}
+
+	// Get the Session Interface to call the StartSession function
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
+	if (OnlineSessionInterface.IsValid())
+	{
+		SetSessionState(EOSessionState::Starting);
+		OnlineSessionInterface->StartSession(SessionInfo.SessionName);
+	}
+	else
+	{
+		FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionCreate, this, arg_SessionName);
+		SetSessionState(EOSessionState::Idle);
 	}
 }
 
 void UOGameInstance::OnStartSessionComplete(FName arg_SessionName, bool arg_bWasSuccessful)
 {
-	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OnStartSessionComplete %s, %d"), *arg_SessionName.ToString(), arg_bWasSuccessful));
+	O_SCOPE_CYCLE_COUNTER(STAT_OStartSessionComplete);
 
-	// Get the Online Subsystem so we can get the Session Interface
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	if (arg_SessionName != SessionInfo.SessionName || SessionState != EOSessionState::Starting)
 	{
-		// Get the Session Interface to clear the Delegate
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
-		if (OnlineSessionInterface.IsValid())
-		{
-			// Clear the delegate, since we are done with this call
-			OnlineSessionInterface->ClearOnStartSessionCompleteDelegate_Handle(OnStartSessionCompleteDelegateHandle);
-		}
+		return;
 	}
 
-	// If the start was successful, we can open a NewMap if we want. Make sure to use "listen" as a parameter!
+	O_DIAG(LogOSession, Log, TEXT("OnStartSessionComplete %s, %d"), *arg_SessionName.ToString(), arg_bWasSuccessful);
+
+	// A session counts as created once it started, matching what players can find
 	if (arg_bWasSuccessful)
 	{
+		FOTelemetry::Get().EndTimer(EOTelemetryTimer::SessionCreate, this, arg_SessionName, EOTelemetryHistogram::SessionCreateToStartMs);
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionsCreated);
+	}
+	else
+	{
+		FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionCreate, this, arg_SessionName);
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionCreateFailures);
+	}
+
+	// A session that didn't start, or is not wanted anymore, would block the next one under its name
+	if (!arg_bWasSuccessful || bSessionCancelRequested)
+	{
+		ExecuteDestroySession(false);
+		return;
+	}
+
+	// Dedicated servers are already listening, they only have to travel to the game map. There are no friends to invite either
+	if (IsRunningDedicatedServer())
+	{
+		UWorld* World = GetWorld();
+		if (World && !SessionInfo.GameMapName.IsNone() && World->GetMapName() != SessionInfo.GameMapName.ToString())
+		{
+			ServerTravelStartTime = FPlatformTime::Seconds();
+			World->ServerTravel(SessionInfo.GameMapName.ToString(), true);
+		}
+		else
+		{
+			// Pool children and additional matches loaded the map before hosting, AOGameMode::StartPlay reports the others after the travel
+			FOServerPool::ReportMatchReady();
+		}
+	}
+	else
+	{
+		// We can open a NewMap if we want. Make sure to use "listen" as a parameter!
 		if (!SessionInfo.GameMapName.ToString().IsEmpty())
 		{
 			UGameplayStatics::OpenLevel(GetWorld(), SessionInfo.GameMapName, true, "listen");
 		}
 
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
-		const ULocalPlayer* LocalPlayer = GetFirstGamePlayer();
-
-		// Friend
-		IOnlineFriendsPtr FriendInterface = Online::GetFriendsInterface();
-		FriendInterface->ReadFriendsList(LocalPlayer->GetControllerId(), EFriendsLists::ToString(EFriendsLists::Default), OnReadFriendsListCompleteDelegate);
+		// The cached friends are invited right away, a stale cache invites once the new list is read
+		if (AutoInviteFriendNames.Num() > 0)
+		{
+			if (RefreshFriends() || FriendsReadStartTime > 0.0)
+			{
+				bAutoInviteOnFriendsRead = true;
+			}
+			else
+			{
+				InviteFriendsByName(AutoInviteFriendNames);
+			}
+		}
 	}
+
+	// Last, so queued requests start after the travel was set up
+	SetSessionState(EOSessionState::InProgress);
+
+	StartLoadAdvertisement();
 }
 
 void UOGameInstance::OnFindSessionsComplete(bool arg_bWasSuccessful)
 {
-	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OFindSessionsComplete bSuccess: %d"), arg_bWasSuccessful));
+	O_SCOPE_CYCLE_COUNTER(STAT_OFindSessionsComplete);
 
-	// Get OnlineSubsystem we want to work with
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	// Searches of other game instances on the same session interface, or one that was cancelled
+	if (SessionState != EOSessionState::Searching)
 	{
-		// Get SessionInterface of the OnlineSubsystem
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
-		if (OnlineSessionInterface.IsValid())
-		{
-			// Clear the Delegate handle, since we finished this call
-			OnlineSessionInterface->ClearOnFindSessionsCompleteDelegate_Handle(OnFindSessionsCompleteDelegateHandle);
+		return;
+	}
 
-			// Just debugging the Number of Search results. Can be displayed in UMG or something later on
-			GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("Num Search Results: %d"), SessionSearch->SearchResults.Num()));
+	O_DIAG(LogOSession, Log, TEXT("OnFindSessionsComplete bSuccess: %d"), arg_bWasSuccessful);
 
-			// If we have found at least 1 session, we just going to debug them. You could add them to a list of UMG Widgets, like it is done in the BP version!
-			if (SessionSearch->SearchResults.Num() > 0)
-			{
-				// "SessionSearch->SearchResults" is an Array that contains all the information. You can access the Session in this and get a lot of information.
-				// This can be customized later on with your own classes to add more information that can be set and displayed
-				for (int32 SearchIdx = 0; SearchIdx < SessionSearch->SearchResults.Num(); SearchIdx++)
-				{
-					// OwningUserName is just the SessionName for now. I guess you can create your own Host Settings class and GameSession Class and add a proper GameServer Name here.
-					// This is something you can't do in Blueprint for example!
-					GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("Session Number: %d | Sessionname: %s "), SearchIdx + 1, *(SessionSearch->SearchResults[SearchIdx].Session.OwningUserName)));
-				}
-			}
+	// Streams the rest of the results and hands the ranked list to the browser
+	CompleteSessionSearch(arg_bWasSuccessful);
+
+	if (SessionSearch.IsValid())
+	{
+		// Just debugging the Number of Search results. Can be displayed in UMG or something later on
+		O_DIAG(LogOSession, Log, TEXT("Num Search Results: %d"), SessionSearch->SearchResults.Num());
+
+		// If we have found at least 1 session, we just going to debug them. You could add them to a list of UMG Widgets, like it is done in the BP version!
+		for (int32 SearchIdx = 0; SearchIdx < SessionSearch->SearchResults.Num(); SearchIdx++)
+		{
+			// OwningUserName is just the SessionName for now. I guess you can create your own Host Settings class and GameSession Class and add a proper GameServer Name here.
+			// This is something you can't do in Blueprint for example!
+			O_DIAG(LogOSession, Verbose, TEXT("Session Number: %d | Sessionname: %s | Ping: %d"), SearchIdx + 1, *(SessionSearch->SearchResults[SearchIdx].Session.OwningUserName), SessionSearch->SearchResults[SearchIdx].PingInMs);
 		}
 	}
 }
 
 void UOGameInstance::OnJoinSessionComplete(FName arg_SessionName, EOnJoinSessionCompleteResult::Type arg_Result)
 {
-	GEngine->AddOnScreenDebugMessage(-1, 10.f, FColor::Red, FString::Printf(TEXT("OnJoinSessionComplete %s, %d"), *arg_SessionName.ToString(), static_cast<int32>(arg_Result)));
+	O_SCOPE_CYCLE_COUNTER(STAT_OJoinSessionComplete);
 
-	// Get the OnlineSubsystem we want to work with
-	const IOnlineSubsystem* OnlineSubsystemInterface = IOnlineSubsystem::Get();
-	if (OnlineSubsystemInterface)
+	// Joins of other game instances on the same session interface
+	if (SessionState != EOSessionState::Joining)
 	{
-		// Get SessionInterface from the OnlineSubsystem
-		IOnlineSessionPtr OnlineSessionInterface = OnlineSubsystemInterface->GetSessionInterface();
+		return;
+	}
 
-		if (OnlineSessionInterface.IsValid())
-		{
-			// Clear the Delegate again
-			OnlineSessionInterface->ClearOnJoinSessionCompleteDelegate_Handle(OnJoinSessionCompleteDelegateHandle);
+	O_DIAG(LogOSession, Log, TEXT("OnJoinSessionComplete %s, %d"), *arg_SessionName.ToString(), static_cast<int32>(arg_Result));
+
+	// A failed join is counted, not timed. The next candidate starts a timer of its own
+	if (arg_Result != EOnJoinSessionCompleteResult::Success || bSessionCancelRequested)
+	{
+		FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionJoin, this, arg_SessionName);
+	}
+
+	// Full or unreachable sessions fall back to the next best candidate without a new search
+	if (arg_Result == EOnJoinSessionCompleteResult::SessionIsFull || arg_Result == EOnJoinSessionCompleteResult::CouldNotRetrieveAddress)
+	{
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionJoinFailures);
+		RetryJoinWithNextCandidate(arg_SessionName);
+		return;
+	}
+
+	if (arg_Result != EOnJoinSessionCompleteResult::Success)
+	{
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionJoinFailures);
+		JoinCandidates.Reset();
+		SetSessionState(EOSessionState::Idle);
+		return;
+	}
 
-			// Get the first local PlayerController, so we can call "ClientTravel" to get to the Server Map
-			// This is something the Blueprint Node "Join Session" does automatically!
-			APlayerController* PlayerController = GetFirstLocalPlayerController();
+	SessionInfo.SessionName = arg_SessionName;
 
-			// We need a FString to use ClientTravel and we can let the SessionInterface contruct such a
-			// String for us by giving him the SessionName and an empty String. We want to do this, because
-			// Every OnlineSubsystem uses different TravelURLs
-			FString TravelURL;
-			SessionInfo.SessionName = arg_SessionName;
+	// Cancelled while the backend was busy, leave again instead of traveling
+	if (bSessionCancelRequested)
+	{
+		JoinCandidates.Reset();
+		ExecuteDestroySession(false);
+		return;
+	}
 
-			if (PlayerController && OnlineSessionInterface->GetResolvedConnectString(SessionInfo.SessionName, TravelURL))
-			{
+	// Get SessionInterface from the OnlineSubsystem
+	IOnlineSessionPtr OnlineSessionInterface = GetSessionInterface();
 
+	if (OnlineSessionInterface.IsValid())
+	{
+		// Get the first local PlayerController, so we can call "ClientTravel" to get to the Server Map
+		// This is something the Blueprint Node "Join Session" does automatically!
+		APlayerController* PlayerController = GetFirstLocalPlayerController();
+
+		// We need a FString to use ClientTravel and we can let the SessionInterface contruct such a
+		// String for us by giving him the SessionName and an empty String. We want to do this, because
+		// Every OnlineSubsystem uses different TravelURLs
+		FString TravelURL;
+
+		if (OnlineSessionInterface->GetResolvedConnectString(SessionInfo.SessionName, TravelURL))
+		{
+			JoinCandidates.Reset();
+
+			// Simulated clients have no player controller before they connect, they travel through the engine directly
+			if (PlayerController)
+			{
 				PlayerController->ClientTravel(TravelURL, ETravelType::TRAVEL_Absolute);
 			}
+			else
+			{
+				GetEngine()->SetClientTravel(GetWorld(), *TravelURL, ETravelType::TRAVEL_Absolute);
+			}
+
+			SetSessionState(EOSessionState::Joined);
+		}
+		else
+		{
+			FOTelemetry::Get().DiscardTimer(EOTelemetryTimer::SessionJoin, this, arg_SessionName);
+			FOTelemetry::Get().Increment(EOTelemetryCounter::SessionJoinFailures);
+			RetryJoinWithNextCandidate(arg_SessionName);
 		}
 	}
 }
+
+void UOGameInstance::LoadComplete(const float LoadTime, const FString& MapName)
+{
+	Super::LoadComplete(LoadTime, MapName);
+
+	// A join is done once the client arrived in the server's map
+	const UWorld* World = GetWorld();
+	if (World && World->GetNetMode() == NM_Client
+		&& FOTelemetry::Get().EndTimer(EOTelemetryTimer::SessionJoin, this, SessionInfo.SessionName, EOTelemetryHistogram::SessionJoinToTravelMs))
+	{
+		FOTelemetry::Get().Increment(EOTelemetryCounter::SessionsJoined);
+	}
+
+	if (JoinStartTime > 0.0 && World && World->GetNetMode() == NM_Client)
+	{
+		bJoinMapPreloaded = PreloadedMapPackage != nullptr;
+		ReleasePreloads();
+
+		FWorldDelegates::OnWorldPostActorTick.Remove(FirstFrameHandle);
+		FirstFrameHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &UOGameInstance::OnFirstFrameAfterJoin);
+	}
+}
+
+void UOGameInstance::OnFirstFrameAfterJoin(UWorld* arg_World, ELevelTick arg_TickType, float arg_DeltaSeconds)
+{
+	if (arg_World != GetWorld())
+	{
+		return;
+	}
+
+	FWorldDelegates::OnWorldPostActorTick.Remove(FirstFrameHandle);
+	FirstFrameHandle.Reset();
+
+	const double JoinToFirstFrame = FPlatformTime::Seconds() - JoinStartTime;
+	JoinStartTime = 0.0;
+
+	FOTelemetry::Get().Record(bJoinMapPreloaded ? EOTelemetryHistogram::SessionJoinToFirstFramePreloadedMs : EOTelemetryHistogram::SessionJoinToFirstFrameMs, JoinToFirstFrame * 1000.0);
+
+	UE_LOG(LogOGameInstance, Log, TEXT("Join to first frame %.3f s | map preloaded %d"), JoinToFirstFrame, bJoinMapPreloaded);
+}
@@ -3,12 +3,62 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "OFriendsCache.h"
 #include "UnrealNetwork.h"
 #include "Online.h"
 #include "OnlineSubsystemUtils.h"
 #include "Engine/GameInstance.h"
 #include "OGameInstance.generated.h"
 
+// Server load between 0 (idle) and 1 (saturated), advertised by hosts and used to rank sessions
+#define SETTING_OSERVERLOAD FName(TEXT("OSERVERLOAD"))
+
+// Players connected to the host
+#define SETTING_ONUMPLAYERS FName(TEXT("ONUMPLAYERS"))
+
+// Average server frame time in milliseconds since the previous advertisement
+#define SETTING_OFRAMEMS FName(TEXT("OFRAMEMS"))
+
+// Fraction of the frame budget of the net server tick rate the host has left, 0 if it can't keep up
+#define SETTING_OTICKHEADROOM FName(TEXT("OTICKHEADROOM"))
+
+// Match phase of the host: Starting, InProgress or Travelling
+#define SETTING_OMATCHPHASE FName(TEXT("OMATCHPHASE"))
+
+// Build version of the host, see UOGameInstance::GetBuildVersion. Clients only join hosts running their own version
+#define SETTING_OBUILDVERSION FName(TEXT("OBUILDVERSION"))
+
+// Region the host plays in, see UOGameInstance::MatchmakingRegion
+#define SETTING_OREGION FName(TEXT("OREGION"))
+
+UENUM(BlueprintType)
+enum class EOSessionState : uint8
+{
+	// No session and no request running.
+	Idle,
+
+	// Waiting for the backend to create the session.
+	Creating,
+
+	// Created, waiting for the backend to start the session.
+	Starting,
+
+	// Hosting a started session.
+	InProgress,
+
+	// A session search is running.
+	Searching,
+
+	// Joining a session, falling back to the next candidate if it fails.
+	Joining,
+
+	// Joined a session, traveling to or playing on its server.
+	Joined,
+
+	// Waiting for the backend to destroy the session.
+	Destroying
+};
+
 USTRUCT(BlueprintType)
 struct FOnlineSessionInfo
 {
@@ -23,9 +73,107 @@ public:
 
 	UPROPERTY(BlueprintReadWrite, Category = "Online|Session")
 	FName EntryMapName;
+
+	// Port the match of this session listens on, 0 for the default port.
+	UPROPERTY(BlueprintReadWrite, Category = "Online|Session")
+	int32 Port = 0;
+};
+
+// Filters of a session search. They are sent to the backend with the query, empty filters match every session.
+USTRUCT(BlueprintType)
+struct FOSessionQuery
+{
+	GENERATED_BODY()
+
+public:
+	// Map the session plays, as hosts advertise it.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Online|Session")
+	FString MapName;
+
+	// Short class name of the game mode of the session.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Online|Session")
+	FString GameMode;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Online|Session")
+	FString Region;
+
+	// Public slots the session must have open, 0 also finds full sessions.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Online|Session")
+	int32 MinFreeSlots = 1;
+
+	// Only finds sessions of hosts running the build version of this client.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Online|Session")
+	bool bSameBuildOnly = true;
 };
 
-UCLASS()
+USTRUCT(BlueprintType)
+struct FOSessionSearchEntry
+{
+	GENERATED_BODY()
+
+public:
+	// Index of the result in the current search, pass it to JoinSearchResult.
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	int32 SearchIndex = INDEX_NONE;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	FString OwningUserName;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	FString MapName;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	int32 PingInMs = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	int32 OpenPublicConnections = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	int32 MaxPublicConnections = 0;
+
+	// Load last advertised by the host, see SETTING_OSERVERLOAD.
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	float ServerLoad = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	int32 NumPlayers = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	FString MatchPhase;
+};
+
+USTRUCT(BlueprintType)
+struct FOSessionSearchTimings
+{
+	GENERATED_BODY()
+
+public:
+	// Seconds from starting the search until the first result arrived, negative if there was none.
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	float TimeToFirstResult = -1.0f;
+
+	// Seconds from starting the search until the full list was available.
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	float TimeToFullList = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	int32 NumResults = 0;
+
+	// Results the backend returned although they don't match the session query, they are not in the list.
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	int32 NumFiltered = 0;
+
+	// True if the results came from the search cache instead of the backend.
+	UPROPERTY(BlueprintReadOnly, Category = "Online|Session")
+	bool bFromCache = false;
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnOSessionSearchResult, const FOSessionSearchEntry&, Entry);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnOSessionStateChanged, EOSessionState, OldState, EOSessionState, NewState);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnOPlacementComplete, bool, bWasSuccessful, const FString&, ServerAddress);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnOSessionSearchComplete, bool, bWasSuccessful, const TArray<FOSessionSearchEntry>&, RankedEntries, const FOSessionSearchTimings&, Timings);
+
+UCLASS(config = Game)
 class UNREALONLINECPP_API UOGameInstance : public UGameInstance
 {
 	GENERATED_BODY()
@@ -35,23 +183,161 @@ public:
 
 	virtual void Init() override;
 
+	// Dedicated servers create and advertise their session here.
+	virtual void OnStart() override;
+
 	virtual void Shutdown() override;
 
+	// Finishes timing a session join once the client loaded the server's map.
+	virtual void LoadComplete(const float LoadTime, const FString& MapName) override;
+
 	UFUNCTION(BlueprintCallable, Category = "Online|Session")
 	bool HostSession(FName arg_SessionName, FName arg_Map, bool arg_bIsLAN, bool arg_bIsPresence, int32 arg_MaxNumPlayers);
 
 	UFUNCTION(BlueprintCallable, Category = "Online|Session")
-	bool FindSessions(bool arg_bIsLAN, bool arg_bIsPresence);
+	bool HostDedicatedSession(FName arg_SessionName, FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers);
+
+	/**
+	* Hosts another independent match in this dedicated server process, with its own world, net driver, port and session.
+	*
+	* @param Map: map the match plays on.
+	* @param bIsLAN: is this is LAN Game?
+	* @param MaxNumPlayers: number of Maximum allowed players in the match.
+	* @returns true if the match world is listening and its session is being created.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Match")
+	bool StartAdditionalMatch(FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers);
+
+	/**
+	* Moves the match of this game instance and its players to another map. Uses seamless travel, so clients stay
+	* connected and keep their player states while the server waits in the transition map.
+	*
+	* @param Map: map to play next.
+	* @returns true if the travel was started.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Match")
+	bool TravelToMap(FName arg_Map);
+
+	// Returns the time the last server travel started, 0 if there was none.
+	FORCEINLINE double GetServerTravelStartTime() const { return ServerTravelStartTime; }
+
+	/**
+	* Logs the resident memory the process used before and after every match was added.
+	*/
+	void LogMatchMemoryReport() const;
+
+	// Returns the session info of every match hosted by this process.
+	FORCEINLINE const TMap<FName, FOnlineSessionInfo>& GetMatches() const { return Matches; }
+
+	// Returns the online subsystem instance this game instance works with.
+	FORCEINLINE IOnlineSubsystem* GetOnlineSubsystem() const { return IOnlineSubsystem::Get(OnlineSubsystemName); }
+
+	// Returns the load generator, created on first use.
+	class UOLoadGenerator* GetLoadGenerator();
+
+	// Returns the gameplay benchmark, created on first use.
+	class UOBenchmark* GetBenchmark();
+
+	// Returns the pre-warmed server pool, only set in its parent and children, see FOServerPool.
+	FORCEINLINE class FOServerPool* GetServerPool() const { return ServerPool.Get(); }
+
+	// Returns true while a session search is running or queued.
+	bool IsSearchingSessions() const;
+
+	UFUNCTION(BlueprintPure, Category = "Online|Session")
+	EOSessionState GetSessionState() const { return SessionState; }
+
+	/**
+	* Drops every queued session request and cancels the running one. A running search stops right away, a session that
+	* is being created or joined is destroyed as soon as the backend reports back.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Session")
+	void CancelSessionRequests();
+
+	// Returns the number of results of the last completed session search that match the session query.
+	FORCEINLINE int32 GetNumSessionSearchResults() const { return RankedSearchIndices.Num(); }
+
+	UFUNCTION(BlueprintCallable, Category = "Online|Session")
+	bool FindSessions(bool arg_bIsLAN, bool arg_bIsPresence, bool arg_bForceRefresh = false);
+
+	/**
+	* Sets the filters of the following session searches. Cached results were found with the old filters and are dropped.
+	*
+	* @param Query: filters sent to the backend and checked again on every result.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Session")
+	void SetSessionQuery(const FOSessionQuery& arg_Query);
+
+	UFUNCTION(BlueprintPure, Category = "Online|Session")
+	const FOSessionQuery& GetSessionQuery() const { return SessionQuery; }
+
+	/**
+	* Checks if a host runs the build version of this client. Sessions of other builds are never joined.
+	*
+	* @param OutReason: why the session is incompatible, if given.
+	*/
+	bool IsSessionCompatible(const FOnlineSessionSearchResult& arg_SearchResult, FString* arg_OutReason = nullptr) const;
+
+	// Returns the build version hosts advertise and clients require: GameVersion of the Steam subsystem config, else ProjectVersion.
+	static FString GetBuildVersion();
 
 	UFUNCTION(BlueprintCallable, Category = "Online|Session")
 	bool JoinSession();
 
+	UFUNCTION(BlueprintCallable, Category = "Online|Session")
+	bool JoinSearchResult(int32 arg_SearchIndex);
+
 	UFUNCTION(BlueprintCallable, Category = "Online|Session")
 	void DestroySession();
 
+	/**
+	* Asks the matchmaking service at MatchmakerAddress for a match and travels there, without searching sessions.
+	*
+	* @param PartySize: slots to reserve, the other members of the party travel to the address OnPlacementComplete reports.
+	* @returns true if the request was sent.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Matchmaking")
+	bool RequestPlacement(int32 arg_PartySize = 1);
+
+	UFUNCTION(BlueprintCallable, Category = "Online|Matchmaking")
+	void CancelPlacement();
+
+	// Returns true while a placement request waits for its match.
+	UFUNCTION(BlueprintPure, Category = "Online|Matchmaking")
+	bool IsPlacing() const { return !PlacementMessage.IsEmpty(); }
+
 	UFUNCTION(BlueprintCallable, Category = "Online|Session")
 	bool SendSessionInviteToFriend(const FString& arg_FriendUniqueNetId);
 
+	/**
+	* Invites several friends to the current session with one request to the backend.
+	*
+	* @param FriendUniqueNetIds: unique net ids of the friends, as strings.
+	* @returns the number of friends invited.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Friends")
+	int32 SendSessionInviteToFriends(const TArray<FString>& arg_FriendUniqueNetIds);
+
+	/**
+	* Invites every cached friend with one of the names to the current session with one request to the backend.
+	*
+	* @param FriendNames: real or display names, case is ignored.
+	* @returns the number of friends invited.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Friends")
+	int32 InviteFriendsByName(const TArray<FString>& arg_FriendNames);
+
+	/**
+	* Reads the friends list of the first local player into the friends cache if it is stale.
+	*
+	* @param bForce: read it even if the cache is still fresh.
+	* @returns true if a read was started.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "Online|Friends")
+	bool RefreshFriends(bool arg_bForce = false);
+
+	FORCEINLINE const FOFriendsCache& GetFriendsCache() const { return FriendsCache; }
+
 	/**
 	* Function to call create session.
 	*
@@ -69,7 +355,7 @@ public:
 	* @param UserID: user that started the request.
 	* @param SessionName: name of session.
 	* @param SearchResult: session to join.
-	* @returns true if successful, false otherwise.
+	* @returns true if the join was started or queued behind the running request.
 	*/
 	bool JoinSession(TSharedPtr<const FUniqueNetId> arg_UserId, FName arg_SessionName, const FOnlineSessionSearchResult& arg_SearchResult);
 
@@ -79,10 +365,228 @@ public:
 	* @param UserId: user that initiated the request.
 	* @param bIsLAN: are we searching LAN matches.
 	* @param bIsPresence: are we searching presence sessions.
+	* @param bForceRefresh: query the backend even if the cached results are still fresh.
 	*/
-	void FindSessions(TSharedPtr<const FUniqueNetId> arg_UserId, bool arg_bIsLAN, bool arg_bIsPresence);
+	void FindSessions(TSharedPtr<const FUniqueNetId> arg_UserId, bool arg_bIsLAN, bool arg_bIsPresence, bool arg_bForceRefresh = false);
+
+public:
+	// Online subsystem instance to use, for example Null:Bot3 to give a simulated client its own sessions. None uses the default.
+	FName OnlineSubsystemName;
+
+	// Number of players a dedicated server accepts unless -MaxPlayers= is given.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	int32 DedicatedServerMaxNumPlayers;
+
+	// Port of the first match, additional matches listen on the ports after it.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Match")
+	int32 MatchBasePort;
+
+	// Fired for every session as soon as the backend reports it, before the search completes.
+	UPROPERTY(BlueprintAssignable, Category = "Online|Session")
+	FOnOSessionSearchResult OnSessionSearchResult;
+
+	// Fired once the search is complete, with every result ranked by ping.
+	UPROPERTY(BlueprintAssignable, Category = "Online|Session")
+	FOnOSessionSearchComplete OnSessionSearchComplete;
+
+	// Fired on every transition of the session state machine.
+	UPROPERTY(BlueprintAssignable, Category = "Online|Session")
+	FOnOSessionStateChanged OnSessionStateChanged;
+
+	// Seconds the cached friends list is used before a session start reads it again. Changes reported by the backend refresh it earlier.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Friends")
+	float FriendsRefreshInterval;
+
+	// Friends invited to every session this instance hosts, by real or display name.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Friends")
+	TArray<FString> AutoInviteFriendNames;
+
+	// Minimum seconds between two updates of the advertised server load, changes in between are sent together.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	float LoadAdvertisementInterval;
+
+	// Change of the server load that is worth an update. A changed player count or match phase is always sent.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	float LoadAdvertisementThreshold;
+
+	// Maximum number of sessions a search returns.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	int32 MaxSearchResults;
+
+	// Ping bucket size handed to the online subsystem, 0 disables bucketing.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	int32 PingBucketSize;
+
+	// Seconds search results stay cached before a refresh queries the backend again.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	float SearchCacheTimeToLive;
+
+	// Filters every session search sends to the backend, see SetSessionQuery.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	FOSessionQuery SessionQuery;
+
+	// Seconds between checks for newly arrived results while a search is running.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	float SearchPollInterval;
+
+	// Assets every match needs, streamed in while joining a session. The map advertised by the session is streamed as well.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Session")
+	TArray<FSoftObjectPath> JoinPreloadAssets;
+
+	// Map that gets a bonus when picking a session to join, none if empty.
+	UPROPERTY(BlueprintReadWrite, Category = "Online|Matchmaking")
+	FString PreferredMapName;
+
+	// Score lost per millisecond of ping.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	float PingWeight;
+
+	// Score gained by a completely empty session, scaled by the fraction of open public slots.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	float FreeSlotsWeight;
+
+	// Score lost by a fully loaded server, scaled by its advertised load.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	float ServerLoadWeight;
+
+	// Score gained by sessions running PreferredMapName.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	float PreferredMapWeight;
+
+	// Matchmaking service, <Ip>:<Port>. Dedicated servers register their matches with it, clients ask it for placements. -Matchmaker= overrides it.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	FString MatchmakerAddress;
+
+	// Region the matches of this server are placed in. -Region= overrides it.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	FString MatchmakingRegion;
+
+	// Ping of this client to every region it may play in, placement picks the lowest. Empty places it in MatchmakingRegion.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadWrite, Category = "Online|Matchmaking")
+	TMap<FString, int32> MatchmakingRegionPings;
+
+	// Ip clients reach this server at, the local host address if empty. -PublicAddress= overrides it.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	FString MatchmakingPublicAddress;
+
+	// Matches this server process may run when the matchmaking service asks for more. -MaxMatches= overrides it.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	int32 MatchmakingMaxMatches;
+
+	// Seconds between two heartbeats of a server, and between two repeats of an unanswered placement request.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	float MatchmakingHeartbeatInterval;
+
+	// Seconds a placement may wait for a match before it is given up.
+	UPROPERTY(config, EditDefaultsOnly, BlueprintReadOnly, Category = "Online|Matchmaking")
+	float PlacementTimeout;
+
+	// Fired once the matchmaking service placed this client, right before it travels, or gave up.
+	UPROPERTY(BlueprintAssignable, Category = "Online|Matchmaking")
+	FOnOPlacementComplete OnPlacementComplete;
 
 private:
+	enum class ESessionRequestType : uint8
+	{
+		Create,
+		Find,
+		Join,
+		Destroy
+	};
+
+	// Session operation waiting for the state machine to get to a state it can start from
+	struct FSessionRequest
+	{
+		ESessionRequestType Type;
+		TSharedPtr<const FUniqueNetId> UserId;
+		FName SessionName;
+		FName Map;
+		bool bIsLAN = false;
+		bool bIsPresence = false;
+		bool bIsDedicated = false;
+		bool bForceRefresh = false;
+		int32 MaxNumPlayers = 0;
+
+		// Session to join, invalid to join the best candidate of the last search
+		FOnlineSessionSearchResult SearchResult;
+	};
+
+	/**
+	* Starts a request right away if nothing is running, queues it otherwise. A queued request replaces a queued one
+	* of the same type, and a destroy drops queued creates and joins.
+	*
+	* @returns true if the request was started or queued.
+	*/
+	bool RequestSessionOperation(const FSessionRequest& arg_Request);
+
+	// Starts queued requests until one is running or the queue is empty.
+	void ProcessSessionRequests();
+
+	/**
+	* Starts a request, the state machine has to be in Idle, InProgress or Joined.
+	*
+	* @returns true if the request is running, false if it failed or there was nothing to do.
+	*/
+	bool ExecuteSessionRequest(const FSessionRequest& arg_Request);
+
+	bool ExecuteCreateSession(const FSessionRequest& arg_Request);
+
+	bool ExecuteFindSessions(const FSessionRequest& arg_Request);
+
+	bool ExecuteJoinSession(const FSessionRequest& arg_Request);
+
+	/**
+	* Destroys the current session.
+	*
+	* @param bTravelToEntryMap: open the entry map once the session is gone.
+	*/
+	bool ExecuteDestroySession(bool arg_bTravelToEntryMap);
+
+	void SetSessionState(EOSessionState arg_NewState);
+
+	// Returns true in the states new requests can start from.
+	bool IsSessionStateSettled() const;
+
+	// Binds the session callbacks once for the lifetime of the game instance.
+	void RegisterSessionDelegates();
+
+	void UnregisterSessionDelegates();
+
+	// Returns the session interface of the online subsystem instance, invalid if there is none.
+	IOnlineSessionPtr GetSessionInterface() const;
+
+	/**
+	* Starts streaming the map a session advertises and JoinPreloadAssets, so loading overlaps with the handshake.
+	*
+	* @param SearchResult: session that is about to be joined.
+	*/
+	void PreloadSessionAssets(const FOnlineSessionSearchResult& arg_SearchResult);
+
+	void OnMapPackagePreloaded(const FName& arg_PackageName, UPackage* arg_LoadedPackage, EAsyncLoadingResult::Type arg_Result);
+
+	// Lets go of the preloaded map and assets, the world holds on to what it uses.
+	void ReleasePreloads();
+
+	// Records the time from starting the join to the first frame of the server's map.
+	void OnFirstFrameAfterJoin(UWorld* arg_World, ELevelTick arg_TickType, float arg_DeltaSeconds);
+
+	/**
+	* Joins a session via a search result, without going through the request queue.
+	*
+	* @returns true if the join request was started.
+	*/
+	bool StartJoinSession(TSharedPtr<const FUniqueNetId> arg_UserId, FName arg_SessionName, const FOnlineSessionSearchResult& arg_SearchResult);
+
+	/**
+	* Fills SessionSettings for a new session.
+	*
+	* @param Map: map advertised with the session.
+	* @param bIsLAN: is this is LAN Game?
+	* @param bIsPresence: is the Session to create a presence session.
+	* @param MaxNumPlayers: number of Maximum allowed players on this session.
+	*/
+	void InitSessionSettings(FName arg_Map, bool arg_bIsLAN, bool arg_bIsPresence, int32 arg_MaxNumPlayers);
+
 	/**
 	* Function fired when a session create request has completed.
 	*
@@ -122,6 +626,76 @@ private:
 	*/
 	void OnDestroySessionComplete(FName arg_SessionName, bool arg_bWasSuccessful);
 
+	/**
+	 * Delegate fired when the advertised settings of a session were updated.
+	 *
+	 * @param SessionName: the name of the session this callback is for.
+	 * @param bWasSuccessful: true if the async action completed without error, false if there was an error.
+	 */
+	void OnUpdateSessionComplete(FName arg_SessionName, bool arg_bWasSuccessful);
+
+	// Starts sampling the server frame time and advertising the load of the hosted session.
+	void StartLoadAdvertisement();
+
+	void StopLoadAdvertisement();
+
+	/**
+	 * Samples the frame time and, once LoadAdvertisementInterval passed, advertises the load if it changed.
+	 *
+	 * @returns false once this instance stopped hosting.
+	 */
+	bool TickLoadAdvertisement(float arg_DeltaTime);
+
+	/**
+	 * Writes player count, frame time, tick rate headroom, match phase and server load into the session settings and
+	 * sends them with one UpdateSession if they changed enough since the last one.
+	 *
+	 * @returns true if an update was sent.
+	 */
+	bool AdvertiseSessionLoad();
+
+	// Opens the socket to MatchmakerAddress and starts TickMatchmaking, if it doesn't run yet.
+	bool StartMatchmaking();
+
+	void StopMatchmaking();
+
+	/**
+	 * Reads the messages of the matchmaking service and sends heartbeats and repeated placement requests.
+	 *
+	 * @returns false once there is neither a match to report nor a placement running.
+	 */
+	bool TickMatchmaking(float arg_DeltaTime);
+
+	// Reports every running match of this process to the matchmaking service.
+	void SendMatchmakingHeartbeats();
+
+	/**
+	 * Reports the matches of this dedicated server to MatchmakerAddress, with the region and address of the command line.
+	 *
+	 * @param NumMatches: matches already running, the process may always run as many.
+	 */
+	void StartMatchmakingHost(bool arg_bIsLAN, int32 arg_MaxNumPlayers, int32 arg_NumMatches);
+
+	/**
+	 * Loads the game map and JoinPreloadAssets once and starts forking a child server process per match.
+	 *
+	 * @param Size: children kept running.
+	 * @returns false if the map can't be loaded or this process can't fork.
+	 */
+	bool StartServerPool(FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers, int32 arg_Size);
+
+	// Runs in a new pool child: opens the warm map on the port of the child and hosts its session.
+	void HostPoolMatch(int32 arg_ChildIndex, FName arg_Map, bool arg_bIsLAN, int32 arg_MaxNumPlayers);
+
+	void HandleMatchmakingMessage(const FString& arg_Message);
+
+	/**
+	 * Ends the running placement and travels to the match it got.
+	 *
+	 * @param ServerAddress: match to travel to, empty if the placement failed.
+	 */
+	void CompletePlacement(bool arg_bWasSuccessful, const FString& arg_ServerAddress);
+
 	/**
 	 * Delegate used when reading friends list using query.
 	 *
@@ -132,6 +706,19 @@ private:
 	 */
 	void OnReadFriendsListComplete(int32 arg_LocalUserNum, bool arg_bWasSuccessful, const FString& arg_FriendsListName, const FString& arg_ErrorString);
 
+	// Marks the friends cache stale when the backend reports a changed friends list.
+	void OnFriendsChange();
+
+	void UnregisterFriendsDelegates();
+
+	/**
+	* Sends one invite request for a set of friends.
+	*
+	* @param FriendIds: friends to invite.
+	* @returns the number of friends invited.
+	*/
+	int32 SendSessionInvites(const TArray<TSharedRef<const FUniqueNetId>>& arg_FriendIds);
+
 	/**
 	 * Called when a user accepts a session invitation. Allows the game code a chance
 	 * to clean up any existing state before accepting the invite. The invite must be
@@ -144,12 +731,226 @@ private:
 	 */
 	void OnSessionUserInviteAccepted(const bool arg_bWasSuccesful, const int32 arg_LocalUserNum, TSharedPtr<const FUniqueNetId> arg_NetId, const FOnlineSessionSearchResult& arg_SessionSearchResult);
 
+	/**
+	 * Streams the results that arrived since the last poll while a search is running.
+	 *
+	 * @param DeltaTime: time since the last poll.
+	 * @returns true to keep polling.
+	 */
+	bool PollSessionSearch(float arg_DeltaTime);
+
+	/**
+	 * Broadcasts the results from the last streamed one onwards.
+	 */
+	void StreamNewSearchResults();
+
+	/**
+	 * Ranks the results of the current search by ping and broadcasts the complete list.
+	 *
+	 * @param bWasSuccessful: true if the search completed without error.
+	 */
+	void CompleteSessionSearch(bool arg_bWasSuccessful);
+
+	void StopSessionSearchPolling();
+
+	/**
+	 * Scores a session for matchmaking, higher is better.
+	 *
+	 * @param SearchResult: session to score.
+	 */
+	float ScoreSearchResult(const FOnlineSessionSearchResult& arg_SearchResult) const;
+
+	/**
+	 * Pushes the filters of SessionQuery into the settings of a search, so the backend only returns joinable sessions.
+	 *
+	 * @param bIsPresence: searches presence sessions instead of servers.
+	 */
+	void BuildSessionQuery(FOnlineSearchSettings& arg_QuerySettings, bool arg_bIsPresence) const;
+
+	// Checks a search result against SessionQuery, for backends that ignore the query settings like LAN searches.
+	bool MatchesSessionQuery(const FOnlineSessionSearchResult& arg_SearchResult) const;
+
+	// Short class name of the game mode a session on a map plays, as it is advertised and filtered by.
+	FString GetSessionGameModeName(FName arg_Map) const;
+
+	/**
+	 * Collects the joinable sessions of the current search, best score first.
+	 *
+	 * @param LocalUserId: user that wants to join, its own sessions are skipped.
+	 */
+	void BuildJoinCandidates(const FUniqueNetId& arg_LocalUserId);
+
+	/**
+	 * Joins the next session in the candidate list.
+	 *
+	 * @returns true if a join request was started.
+	 */
+	bool TryNextJoinCandidate();
+
+	/**
+	 * Falls back to the next candidate after a failed join.
+	 *
+	 * @returns true if another candidate is being tried.
+	 */
+	bool RetryJoinWithNextCandidate(FName arg_SessionName);
+
+private:
+	// Simulated clients and server load reports, only created for load tests
+	UPROPERTY(Transient)
+	class UOLoadGenerator* LoadGenerator;
+
+	// Gameplay benchmark, only created for benchmark runs
+	UPROPERTY(Transient)
+	class UOBenchmark* Benchmark;
+
+	// Matchmaking service of a local cluster, only created with -MatchmakingService
+	TSharedPtr<class FOMatchmakingService> MatchmakingService;
+
+	// Socket to MatchmakerAddress, open while reporting matches or placing
+	TSharedPtr<class FOMatchmakingSocket> MatchmakingSocket;
+
+	FDelegateHandle MatchmakingTickHandle;
+	double LastMatchmakingSendTime;
+
+	// Request of the running placement, empty if there is none
+	FString PlacementMessage;
+	uint32 PlacementRequestId;
+	double PlacementStartTime;
+
+	// Matches of this process are reported to the matchmaking service, new ones start with these settings
+	bool bMatchmakingHost;
+	bool bMatchmakingLAN;
+	int32 MatchmakingMaxPlayers;
+
+	// Pre-warmed server pool of this process, only created with -ServerPool
+	TSharedPtr<class FOServerPool> ServerPool;
+
+	// Map and assets the pool parent loaded for its children
+	UPROPERTY(Transient)
+	TArray<UObject*> ServerPoolWarmObjects;
+
+	// Game instances owning the worlds of the additional matches
+	UPROPERTY(Transient)
+	TArray<UOGameInstance*> MatchInstances;
+
+	// Every match hosted by this process, keyed by session name
+	TMap<FName, FOnlineSessionInfo> Matches;
+
+	// Resident memory before the first match and after each match was added, in bytes
+	TArray<uint64> MatchResidentMemory;
+
+	// Session this instance is creating, callbacks for other sessions of the process are ignored
+	FName PendingSessionName;
+
+	double ServerTravelStartTime;
+
+	// Map package streamed in for the session being joined, kept alive until the client traveled
+	UPROPERTY(Transient)
+	UPackage* PreloadedMapPackage;
+
+	FName PreloadingMapPackageName;
+	double PreloadStartTime;
+
+	// Keeps JoinPreloadAssets loaded until the client traveled
+	TSharedPtr<struct FStreamableHandle> PreloadAssetsHandle;
+
+	// Time the current join started, 0 when not joining
+	double JoinStartTime;
+
+	// The map of the current join was preloaded before the client started loading it
+	bool bJoinMapPreloaded;
+
+	FDelegateHandle FirstFrameHandle;
+
+	// Sessions to try in order when joining, copied from the search so refreshes don't change them
+	TArray<FOnlineSessionSearchResult> JoinCandidates;
+
+	// Index of the next candidate to try
+	int32 NextJoinCandidate;
+
+	struct FSessionSearchCacheEntry
+	{
+		TSharedPtr<class FOnlineSessionSearch> Search;
+		TArray<int32> RankedSearchIndices;
+		double Time;
+	};
+
+	// Finished searches keyed by their LAN and presence flags
+	TMap<uint8, FSessionSearchCacheEntry> SessionSearchCache;
+
+	// Cache key of the running search
+	uint8 SessionSearchCacheKey;
+
+	// Number of results of the current search that were already broadcast
+	int32 NumStreamedSearchResults;
+
+	// Results of the current search that match the session query, best ping first. The results themselves stay in
+	// arrival order, so the SearchIndex of an entry that was streamed before the search completed stays valid
+	TArray<int32> RankedSearchIndices;
+
+	// Timings of the current search
+	FOSessionSearchTimings SessionSearchTimings;
+	double SessionSearchStartTime;
+
+	// Handle to the ticker that polls a running search
+	FDelegateHandle SessionSearchPollHandle;
+
+	// Handle to the ticker that advertises the load of the hosted session
+	FDelegateHandle LoadAdvertisementTickHandle;
+
+	// Server frame time summed up since the last advertisement
+	double LoadFrameSeconds;
+	int32 LoadNumFrames;
+	double LastLoadAdvertisementTime;
+
+	// Values of the last update the backend accepted, INDEX_NONE players if there was none
+	int32 AdvertisedNumPlayers;
+	float AdvertisedServerLoad;
+	FString AdvertisedMatchPhase;
+
+	// An UpdateSession is running, the next one waits for it
+	bool bSessionUpdatePending;
+
+	EOSessionState SessionState;
+
+	// State to return to once a search is done
+	EOSessionState StateBeforeSearch;
+
+	// Requests waiting for the running one to finish, in order
+	TArray<FSessionRequest> SessionRequestQueue;
+
+	// Set while queued requests are being started, requests that complete right away don't start the next one again
+	bool bProcessingSessionRequests;
+
+	// The running create or join was cancelled, its session is destroyed once the backend reports back
+	bool bSessionCancelRequested;
+
+	// Open the entry map once the session being destroyed is gone
+	bool bTravelToEntryMapOnDestroy;
+
+	// The session callbacks are bound
+	bool bSessionDelegatesRegistered;
+
 private:
 	TSharedPtr<class FOnlineSessionSettings> SessionSettings;
 	TSharedPtr<class FOnlineSessionSearch> SessionSearch;
-	TArray<TSharedRef<FOnlineFriend>> FriendsList;
+
+	// Friends of the first local player, read when stale instead of on every session start
+	FOFriendsCache FriendsCache;
+
+	// Local user the friends cache and its change delegate belong to
+	int32 FriendsLocalUserNum;
+
+	// Time the running friends list read started, 0 when none is running
+	double FriendsReadStartTime;
+
+	// Invite AutoInviteFriendNames once the running friends list read completes
+	bool bAutoInviteOnFriendsRead;
 	FOnlineSessionInfo SessionInfo;
 
+	// Session callbacks, bound once in Init and cleared in Shutdown so they never pile up over session cycles.
+	// Several game instances of a process can share one session interface, so every callback checks it is meant for this one
+
 	// Delegate called when session created
 	FOnCreateSessionCompleteDelegate OnCreateSessionCompleteDelegate;
 
@@ -165,9 +966,15 @@ private:
 	// Delegate for destroying a session
 	FOnDestroySessionCompleteDelegate OnDestroySessionCompleteDelegate;
 
+	// Delegate for updating the advertised settings of a session
+	FOnUpdateSessionCompleteDelegate OnUpdateSessionCompleteDelegate;
+
 	// Delegate for reading friends list using query
 	FOnReadFriendsListComplete OnReadFriendsListCompleteDelegate;
 
+	// Delegate for changes of the friends list reported by the backend
+	FOnFriendsChangeDelegate OnFriendsChangeDelegate;
+
 	// Delegate for when an invite is accepted (including rich presence)
 	FOnSessionUserInviteAcceptedDelegate OnSessionUserInviteAcceptedDelegate;
 
@@ -186,6 +993,12 @@ private:
 	// Handle to registered delegate for destroying a session
 	FDelegateHandle OnDestroySessionCompleteDelegateHandle;
 
+	// Handle to registered delegate for updating a session
+	FDelegateHandle OnUpdateSessionCompleteDelegateHandle;
+
+	// Handle to registered delegate for friends list changes
+	FDelegateHandle OnFriendsChangeDelegateHandle;
+
 	// Handles to registered delegates for accepting an invite
 	FDelegateHandle OnSessionUserInviteAcceptedDelegateHandle;
 };
@@ -1,10 +1,17 @@
 // Copyright (c) 2019 Jasper Drescher.
 
 #include "OGameMode.h"
+#include "OGameInstance.h"
+#include "OServerPool.h"
 #include "../Gameplay/OPlayerHUD.h"
 #include "../Gameplay/OPlayerCharacter.h"
+#include "../Gameplay/OProjectilePool.h"
+#include "GameMapsSettings.h"
+#include "Misc/PackageName.h"
 #include "UObject/ConstructorHelpers.h"
 
+DEFINE_LOG_CATEGORY_STATIC(LogOGameMode, Log, All);
+
 AOGameMode::AOGameMode() : Super()
 {
 	// Set default pawn class to our Blueprinted character
@@ -20,4 +27,65 @@ AOGameMode::AOGameMode() : Super()
 
 	// Use our custom HUD class
 	HUDClass = AOPlayerHUD::StaticClass();
+
+	// Map changes of a running match keep the client connections, player states and the projectile pool
+	bUseSeamlessTravel = true;
+}
+
+void AOGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	// Seamless travel waits in the transition map, without one every client would hang in the old map
+	const FString TransitionMapName = GetDefault<UGameMapsSettings>()->TransitionMap.GetLongPackageName();
+	if (bUseSeamlessTravel && (TransitionMapName.IsEmpty() || !FPackageName::DoesPackageExist(TransitionMapName)))
+	{
+		UE_LOG(LogOGameMode, Warning, TEXT("Transition map '%s' not found, map changes fall back to hard travel"), *TransitionMapName);
+		bUseSeamlessTravel = false;
+	}
+}
+
+void AOGameMode::GetSeamlessTravelActorList(bool bToTransition, TArray<AActor*>& ActorList)
+{
+	Super::GetSeamlessTravelActorList(bToTransition, ActorList);
+
+	AOProjectilePool* ProjectilePool = AOProjectilePool::Get(GetWorld(), false);
+	if (ProjectilePool != nullptr)
+	{
+		ProjectilePool->GetSeamlessTravelActors(ActorList);
+	}
+}
+
+void AOGameMode::PostSeamlessTravel()
+{
+	Super::PostSeamlessTravel();
+
+	const UOGameInstance* GameInstance = Cast<UOGameInstance>(GetGameInstance());
+	if (GameInstance != nullptr && GameInstance->GetServerTravelStartTime() > 0.0)
+	{
+		UE_LOG(LogOGameMode, Log, TEXT("Seamless travel to %s loaded in %.2f s, %d players kept their connection"),
+			*GetWorld()->GetMapName(), FPlatformTime::Seconds() - GameInstance->GetServerTravelStartTime(), NumTravellingPlayers + GetNumPlayers());
+	}
+}
+
+void AOGameMode::StartPlay()
+{
+	Super::StartPlay();
+
+	// A dedicated server that hosted on the entry map is ready once it traveled to the map of its session
+	const UOGameInstance* GameInstance = Cast<UOGameInstance>(GetGameInstance());
+	if (IsRunningDedicatedServer() && GameInstance != nullptr && GameInstance->GetSessionState() == EOSessionState::InProgress)
+	{
+		FOServerPool::ReportMatchReady();
+	}
+
+	const AOPlayerCharacter* DefaultCharacter = DefaultPawnClass ? Cast<AOPlayerCharacter>(DefaultPawnClass->GetDefaultObject()) : nullptr;
+	if (DefaultCharacter != nullptr)
+	{
+		AOProjectilePool* ProjectilePool = AOProjectilePool::Get(GetWorld());
+		if (ProjectilePool != nullptr)
+		{
+			ProjectilePool->Prewarm(DefaultCharacter->ProjectileClass);
+		}
+	}
 }
@@ -13,4 +13,16 @@ class UNREALONLINECPP_API AOGameMode : public AGameModeBase
 	
 public:
 	AOGameMode();
+
+	// Prewarms the projectile pool for the default pawn before the first player fires.
+	virtual void StartPlay() override;
+
+	// Falls back to hard travel if the transition map is missing.
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+
+	// Keeps the projectile pool across seamless travel.
+	virtual void GetSeamlessTravelActorList(bool bToTransition, TArray<AActor*>& ActorList) override;
+
+	// Logs how long the map change took and how many players kept their connection.
+	virtual void PostSeamlessTravel() override;
 };
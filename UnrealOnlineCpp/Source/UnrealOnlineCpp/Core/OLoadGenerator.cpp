@@ -0,0 +1,533 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OLoadGenerator.h"
+#include "OGameInstance.h"
+#include "../Gameplay/OPlayerCharacter.h"
+#include "Containers/Ticker.h"
+#include "Engine/Engine.h"
+#include "Engine/LocalPlayer.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLoadTest, Log, All);
+
+static void LoadTestBotsCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UOGameInstance* GameInstance = World ? Cast<UOGameInstance>(World->GetGameInstance()) : nullptr;
+	if (GameInstance && Args.Num() > 0)
+	{
+		GameInstance->GetLoadGenerator()->StartBots(FCString::Atoi(*Args[0]), (Args.Num() > 1) ? Args[1] : FString());
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs LoadTestBotsConsoleCommand(
+	TEXT("o.LoadTest.Bots"),
+	TEXT("Adds simulated clients to this process. Usage: o.LoadTest.Bots <Count> [ServerAddress]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LoadTestBotsCommand));
+
+static void LoadTestReportCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UOGameInstance* GameInstance = World ? Cast<UOGameInstance>(World->GetGameInstance()) : nullptr;
+	if (GameInstance)
+	{
+		UOLoadGenerator* LoadGenerator = GameInstance->GetLoadGenerator();
+		if (World->GetNetMode() == NM_DedicatedServer || World->GetNetMode() == NM_ListenServer)
+		{
+			LoadGenerator->StartServerReport();
+		}
+
+		LoadGenerator->LogReport();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs LoadTestReportConsoleCommand(
+	TEXT("o.LoadTest.Report"),
+	TEXT("Logs bot join latencies and server load, and keeps reporting server load from then on."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LoadTestReportCommand));
+
+static void LoadTestStopCommand(const TArray<FString>& Args, UWorld* World)
+{
+	UOGameInstance* GameInstance = World ? Cast<UOGameInstance>(World->GetGameInstance()) : nullptr;
+	if (GameInstance)
+	{
+		GameInstance->GetLoadGenerator()->Stop();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs LoadTestStopConsoleCommand(
+	TEXT("o.LoadTest.Stop"),
+	TEXT("Disconnects every simulated client and stops the load reports."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&LoadTestStopCommand));
+
+UOLoadGenerator::UOLoadGenerator()
+{
+	BotSpawnInterval = 1.0f;
+	BotJoinTimeout = 30.0f;
+	BotFireInterval = 0.25f;
+	BotTurnRate = 0.5f;
+	ReportInterval = 5.0f;
+	FrameTimeBudgetMs = 1000.0f / 30.0f;
+
+	NumBotsToSpawn = 0;
+	TimeToNextBot = 0.0f;
+
+	bReportServer = false;
+	TimeToNextReport = 0.0f;
+	FrameTimeSum = 0.0;
+	FrameTimeMax = 0.0;
+	NumFrames = 0;
+	DegradedAtNumPlayers = INDEX_NONE;
+
+	NetTickStartTime = 0.0;
+	NetTickTimeSum = 0.0;
+	NumNetTickConnections = 0;
+	NumNetTicks = 0;
+}
+
+void UOLoadGenerator::BeginDestroy()
+{
+	if (TickHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+		TickHandle.Reset();
+	}
+
+	StopNetTickTiming();
+
+	Super::BeginDestroy();
+}
+
+void UOLoadGenerator::StartBots(int32 NumBots, const FString& ServerAddress)
+{
+	if (NumBots <= 0)
+	{
+		return;
+	}
+
+	UE_LOG(LogLoadTest, Log, TEXT("Adding %d bots, %s"), NumBots, ServerAddress.IsEmpty() ? TEXT("joining the best LAN session") : *FString::Printf(TEXT("connecting to %s"), *ServerAddress));
+
+	NumBotsToSpawn += NumBots;
+	BotServerAddress = ServerAddress;
+
+	StartTicking();
+}
+
+void UOLoadGenerator::StartServerReport()
+{
+	if (bReportServer)
+	{
+		return;
+	}
+
+	bReportServer = true;
+	TimeToNextReport = ReportInterval;
+
+	PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &UOLoadGenerator::OnWorldPostActorTick);
+
+	// -NetProfile records every replicated property and RPC to Saved/Profiling for the NetworkProfiler tool
+	if (FParse::Param(FCommandLine::Get(), TEXT("NetProfile")))
+	{
+		UOGameInstance* OwningGameInstance = GetTypedOuter<UOGameInstance>();
+		GEngine->Exec(OwningGameInstance ? OwningGameInstance->GetWorld() : nullptr, TEXT("netprofile enable"));
+	}
+
+	StartTicking();
+}
+
+void UOLoadGenerator::StartTicking()
+{
+	if (!TickHandle.IsValid())
+	{
+		TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UOLoadGenerator::Tick));
+	}
+}
+
+void UOLoadGenerator::Stop()
+{
+	if (TickHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+		TickHandle.Reset();
+	}
+
+	if (Bots.Num() > 0)
+	{
+		LogBotReport();
+	}
+
+	for (FOLoadTestBot& Bot : Bots)
+	{
+		if (Bot.GameInstance == nullptr)
+		{
+			continue;
+		}
+
+		// Tearing the world down closes the bot's connection
+		UWorld* BotWorld = Bot.GameInstance->GetWorld();
+		Bot.GameInstance->Shutdown();
+
+		if (BotWorld != nullptr)
+		{
+			GEngine->DestroyWorldContext(BotWorld);
+			BotWorld->DestroyWorld(false);
+		}
+	}
+
+	if (bReportServer && FParse::Param(FCommandLine::Get(), TEXT("NetProfile")))
+	{
+		UOGameInstance* OwningGameInstance = GetTypedOuter<UOGameInstance>();
+		GEngine->Exec(OwningGameInstance ? OwningGameInstance->GetWorld() : nullptr, TEXT("netprofile disable"));
+	}
+
+	StopNetTickTiming();
+
+	Bots.Empty();
+	NumBotsToSpawn = 0;
+	bReportServer = false;
+}
+
+int32 UOLoadGenerator::NumPlayingBots() const
+{
+	int32 NumPlaying = 0;
+	for (const FOLoadTestBot& Bot : Bots)
+	{
+		NumPlaying += (Bot.State == EOBotState::Playing) ? 1 : 0;
+	}
+
+	return NumPlaying;
+}
+
+bool UOLoadGenerator::Tick(float DeltaTime)
+{
+	if (NumBotsToSpawn > 0)
+	{
+		TimeToNextBot -= DeltaTime;
+		if (TimeToNextBot <= 0.0f)
+		{
+			SpawnBot();
+			NumBotsToSpawn--;
+			TimeToNextBot = BotSpawnInterval;
+		}
+	}
+
+	for (FOLoadTestBot& Bot : Bots)
+	{
+		TickBot(Bot);
+	}
+
+	if (bReportServer)
+	{
+		SampleServer();
+
+		TimeToNextReport -= DeltaTime;
+		if (TimeToNextReport <= 0.0f)
+		{
+			LogServerReport();
+			TimeToNextReport = ReportInterval;
+		}
+	}
+
+	return true;
+}
+
+void UOLoadGenerator::SpawnBot()
+{
+	UOGameInstance* OwningGameInstance = GetTypedOuter<UOGameInstance>();
+	if (OwningGameInstance == nullptr)
+	{
+		return;
+	}
+
+	const int32 BotIdx = Bots.Num();
+
+	// Every bot gets its own Null subsystem instance, so its search, session and join callbacks are its own
+	UOGameInstance* BotInstance = NewObject<UOGameInstance>(OwningGameInstance->GetEngine(), OwningGameInstance->GetClass());
+	BotInstance->OnlineSubsystemName = FName(*FString::Printf(TEXT("Null:Bot%d"), BotIdx));
+	BotInstance->InitializeStandalone();
+
+	FString Error;
+	ULocalPlayer* LocalPlayer = BotInstance->CreateLocalPlayer(0, Error, false);
+	if (LocalPlayer == nullptr)
+	{
+		UE_LOG(LogLoadTest, Error, TEXT("Failed to create the local player of bot %d: %s"), BotIdx, *Error);
+		BotInstance->Shutdown();
+		return;
+	}
+
+	const IOnlineSubsystem* OnlineSubsystemInterface = BotInstance->GetOnlineSubsystem();
+	IOnlineIdentityPtr OnlineIdentityInterface = OnlineSubsystemInterface ? OnlineSubsystemInterface->GetIdentityInterface() : IOnlineIdentityPtr();
+	if (OnlineIdentityInterface.IsValid())
+	{
+		LocalPlayer->SetCachedUniqueNetId(OnlineIdentityInterface->CreateUniquePlayerId(FString::Printf(TEXT("Bot%d"), BotIdx)));
+	}
+
+	FOLoadTestBot& Bot = Bots.AddDefaulted_GetRef();
+	Bot.GameInstance = BotInstance;
+	Bot.Pattern = BotIdx % NumPatterns;
+	Bot.Phase = FMath::FRandRange(0.0f, 2.0f * PI);
+	Bot.StartTime = FPlatformTime::Seconds();
+
+	if (BotServerAddress.IsEmpty())
+	{
+		Bot.State = EOBotState::Searching;
+		BotInstance->FindSessions(true, false, true);
+	}
+	else
+	{
+		Bot.State = EOBotState::Joining;
+		BotInstance->GetEngine()->SetClientTravel(BotInstance->GetWorld(), *BotServerAddress, TRAVEL_Absolute);
+	}
+}
+
+void UOLoadGenerator::TickBot(FOLoadTestBot& Bot)
+{
+	if (Bot.GameInstance == nullptr || Bot.State == EOBotState::Failed)
+	{
+		return;
+	}
+
+	const float TimeSinceStart = FPlatformTime::Seconds() - Bot.StartTime;
+
+	if (Bot.State == EOBotState::Searching && !Bot.GameInstance->IsSearchingSessions())
+	{
+		if (Bot.GameInstance->GetNumSessionSearchResults() > 0 && Bot.GameInstance->JoinSession())
+		{
+			Bot.State = EOBotState::Joining;
+		}
+		else
+		{
+			// Nothing found yet, the server may still be starting
+			Bot.GameInstance->FindSessions(true, false, true);
+		}
+	}
+
+	UWorld* BotWorld = Bot.GameInstance->GetWorld();
+	APlayerController* PlayerController = Bot.GameInstance->GetFirstLocalPlayerController(BotWorld);
+	AOPlayerCharacter* Character = (BotWorld && BotWorld->GetNetMode() == NM_Client && PlayerController) ? Cast<AOPlayerCharacter>(PlayerController->GetPawn()) : nullptr;
+
+	if (Bot.State != EOBotState::Playing)
+	{
+		if (Character != nullptr)
+		{
+			Bot.State = EOBotState::Playing;
+			Bot.JoinLatency = TimeSinceStart;
+
+			UE_LOG(LogLoadTest, Log, TEXT("%s joined in %.3f s (%d bots playing)"), *Bot.GameInstance->OnlineSubsystemName.ToString(), Bot.JoinLatency, NumPlayingBots());
+		}
+		else if (TimeSinceStart > BotJoinTimeout)
+		{
+			Bot.State = EOBotState::Failed;
+
+			UE_LOG(LogLoadTest, Warning, TEXT("%s failed to join within %.0f s"), *Bot.GameInstance->OnlineSubsystemName.ToString(), BotJoinTimeout);
+		}
+	}
+
+	if (Character != nullptr)
+	{
+		DriveBot(Bot, Character);
+	}
+}
+
+void UOLoadGenerator::DriveBot(FOLoadTestBot& Bot, AOPlayerCharacter* Character)
+{
+	const float Time = Character->GetWorld()->GetTimeSeconds();
+
+	DrivePattern(Character, Bot.Pattern, Time + Bot.Phase, BotTurnRate);
+
+	if (Time >= Bot.NextFireTime)
+	{
+		Character->OnFire();
+		Bot.NextFireTime = Time + BotFireInterval;
+	}
+}
+
+void UOLoadGenerator::DrivePattern(AOPlayerCharacter* Character, int32 Pattern, float PatternTime, float TurnRate)
+{
+	switch (Pattern)
+	{
+	case 0:
+		// Strafes from side to side, firing at whatever is in front
+		Character->MoveRight(FMath::Sign(FMath::Sin(PatternTime)));
+		break;
+
+	case 1:
+		// Runs in a circle
+		Character->MoveForward(1.0f);
+		Character->TurnAtRate(TurnRate);
+		break;
+
+	default:
+		// Wanders around, turning back and forth
+		Character->MoveForward(FMath::Sin(PatternTime * 0.7f));
+		Character->MoveRight(FMath::Cos(PatternTime * 1.3f));
+		Character->TurnAtRate(FMath::Sin(PatternTime * 0.5f) * TurnRate);
+		break;
+	}
+}
+
+void UOLoadGenerator::SampleServer()
+{
+	// Time spent working this frame, without the wait for the server tick rate
+	const double FrameTime = FMath::Max(FApp::GetDeltaTime() - FApp::GetIdleTime(), 0.0);
+
+	FrameTimeSum += FrameTime;
+	FrameTimeMax = FMath::Max(FrameTimeMax, FrameTime);
+	NumFrames++;
+}
+
+void UOLoadGenerator::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	UNetDriver* NetDriver = World->GetNetDriver();
+	if (NetDriver == nullptr || !NetDriver->IsServer())
+	{
+		return;
+	}
+
+	// Worlds tick one after the other, so the next post tick flush belongs to this world
+	if (!NetTickWorlds.Contains(World))
+	{
+		NetTickWorlds.Add(World);
+		World->PostTickFlushEvent.AddUObject(this, &UOLoadGenerator::OnPostTickFlush);
+	}
+
+	NetTickWorld = World;
+	NetTickStartTime = FPlatformTime::Seconds();
+}
+
+void UOLoadGenerator::OnPostTickFlush(float DeltaSeconds)
+{
+	UWorld* World = NetTickWorld.Get();
+	UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+	if (NetDriver == nullptr)
+	{
+		return;
+	}
+
+	NetTickTimeSum += FPlatformTime::Seconds() - NetTickStartTime;
+	NumNetTickConnections += NetDriver->ClientConnections.Num();
+	NumNetTicks++;
+
+	NetTickWorld.Reset();
+}
+
+void UOLoadGenerator::StopNetTickTiming()
+{
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+	PostActorTickHandle.Reset();
+
+	for (const TWeakObjectPtr<UWorld>& World : NetTickWorlds)
+	{
+		if (World.IsValid())
+		{
+			World->PostTickFlushEvent.RemoveAll(this);
+		}
+	}
+
+	NetTickWorlds.Empty();
+}
+
+void UOLoadGenerator::LogServerReport()
+{
+	const double AverageFrameTimeMs = (NumFrames > 0) ? FrameTimeSum * 1000.0 / NumFrames : 0.0;
+	int32 NumPlayers = 0;
+
+	// Every match of the process, see UOGameInstance::StartAdditionalMatch
+	for (const FWorldContext& WorldContext : GEngine->GetWorldContexts())
+	{
+		UWorld* World = WorldContext.World();
+		UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+		if (NetDriver == nullptr || !NetDriver->IsServer())
+		{
+			continue;
+		}
+
+		int32 OutBytesPerSecondSum = 0;
+		int32 OutBytesPerSecondMax = 0;
+		int32 InBytesPerSecondSum = 0;
+
+		for (const UNetConnection* Connection : NetDriver->ClientConnections)
+		{
+			OutBytesPerSecondSum += Connection->OutBytesPerSecond;
+			OutBytesPerSecondMax = FMath::Max(OutBytesPerSecondMax, Connection->OutBytesPerSecond);
+			InBytesPerSecondSum += Connection->InBytesPerSecond;
+		}
+
+		const int32 NumConnections = NetDriver->ClientConnections.Num();
+		NumPlayers += NumConnections;
+
+		UE_LOG(LogLoadTest, Log, TEXT("%s: %d connections | out %.2f KB/s per connection (max %.2f) | in %.2f KB/s per connection"),
+			*World->GetMapName(), NumConnections, OutBytesPerSecondSum / 1024.0f / FMath::Max(NumConnections, 1), OutBytesPerSecondMax / 1024.0f, InBytesPerSecondSum / 1024.0f / FMath::Max(NumConnections, 1));
+	}
+
+	UE_LOG(LogLoadTest, Log, TEXT("Server frame: %.2f ms average, %.2f ms max over %d frames with %d players | %s character replication"),
+		AverageFrameTimeMs, FrameTimeMax * 1000.0, NumFrames, NumPlayers, AOPlayerCharacter::UsesOptimizedReplication() ? TEXT("optimized") : TEXT("default"));
+
+	// Cost of the net driver flush, replication included, with the relevancy path it went through
+	bool bUsesReplicationGraph = false;
+	for (const TWeakObjectPtr<UWorld>& World : NetTickWorlds)
+	{
+		const UNetDriver* NetDriver = World.IsValid() ? World->GetNetDriver() : nullptr;
+		bUsesReplicationGraph |= (NetDriver != nullptr && NetDriver->GetReplicationDriver() != nullptr);
+	}
+
+	UE_LOG(LogLoadTest, Log, TEXT("Net tick: %.3f ms per world tick, %.2f us per connection | %s"),
+		(NumNetTicks > 0) ? NetTickTimeSum * 1000.0 / NumNetTicks : 0.0, (NumNetTickConnections > 0) ? NetTickTimeSum * 1.0e6 / NumNetTickConnections : 0.0,
+		bUsesReplicationGraph ? TEXT("replication graph") : TEXT("per actor relevancy"));
+
+	NetTickTimeSum = 0.0;
+	NumNetTickConnections = 0;
+	NumNetTicks = 0;
+
+	if (DegradedAtNumPlayers == INDEX_NONE && AverageFrameTimeMs > FrameTimeBudgetMs)
+	{
+		DegradedAtNumPlayers = NumPlayers;
+
+		UE_LOG(LogLoadTest, Warning, TEXT("Server frame time exceeded the %.2f ms budget at %d players"), FrameTimeBudgetMs, DegradedAtNumPlayers);
+	}
+
+	FrameTimeSum = 0.0;
+	FrameTimeMax = 0.0;
+	NumFrames = 0;
+}
+
+void UOLoadGenerator::LogBotReport() const
+{
+	int32 NumJoined = 0;
+	int32 NumFailed = 0;
+	float JoinLatencySum = 0.0f;
+	float JoinLatencyMin = MAX_flt;
+	float JoinLatencyMax = 0.0f;
+
+	for (const FOLoadTestBot& Bot : Bots)
+	{
+		NumFailed += (Bot.State == EOBotState::Failed) ? 1 : 0;
+
+		if (Bot.JoinLatency >= 0.0f)
+		{
+			NumJoined++;
+			JoinLatencySum += Bot.JoinLatency;
+			JoinLatencyMin = FMath::Min(JoinLatencyMin, Bot.JoinLatency);
+			JoinLatencyMax = FMath::Max(JoinLatencyMax, Bot.JoinLatency);
+		}
+	}
+
+	UE_LOG(LogLoadTest, Log, TEXT("Bots: %d added, %d playing, %d failed, %d still to add | join latency %.3f s average, %.3f s min, %.3f s max"),
+		Bots.Num(), NumPlayingBots(), NumFailed, NumBotsToSpawn, (NumJoined > 0) ? JoinLatencySum / NumJoined : 0.0f, (NumJoined > 0) ? JoinLatencyMin : 0.0f, JoinLatencyMax);
+}
+
+void UOLoadGenerator::LogReport()
+{
+	if (Bots.Num() > 0 || NumBotsToSpawn > 0)
+	{
+		LogBotReport();
+	}
+
+	if (bReportServer)
+	{
+		LogServerReport();
+	}
+}
@@ -0,0 +1,183 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "OLoadGenerator.generated.h"
+
+class AOPlayerCharacter;
+class UOGameInstance;
+
+UENUM()
+enum class EOBotState : uint8
+{
+	Searching,
+	Joining,
+	Playing,
+	Failed
+};
+
+USTRUCT()
+struct FOLoadTestBot
+{
+	GENERATED_BODY()
+
+public:
+	// Game instance owning the bot's world, local player and online subsystem instance.
+	UPROPERTY()
+	UOGameInstance* GameInstance = nullptr;
+
+	EOBotState State = EOBotState::Searching;
+
+	// Index of the scripted input pattern the bot plays.
+	int32 Pattern = 0;
+
+	// Offset into the pattern, so bots with the same pattern don't move in lockstep.
+	float Phase = 0.0f;
+
+	// Time the bot started searching or connecting.
+	double StartTime = 0.0;
+
+	// Seconds from starting until the bot possessed a character, negative until it has.
+	float JoinLatency = -1.0f;
+
+	// Bot world time of the next shot.
+	float NextFireTime = 0.0f;
+};
+
+/**
+ * Load generator for soak tests. On a client it runs simulated players in one process: every bot is a game instance
+ * with its own world, local player and Null online subsystem instance, so it can search, join and play like a human
+ * client while its input comes from a scripted pattern. On a server it reports frame time and bandwidth per connection
+ * and logs the player count at which a match first goes over its frame budget.
+ *
+ * Clients: -nullrhi -nosteam -Bots=<Count> [-ServerAddress=<Address>], or o.LoadTest.Bots <Count> [Address].
+ * Servers: -nosteam -LoadTest [-NetProfile], or o.LoadTest.Report. -NetProfile records the bytes of every replicated
+ * property, compare runs with o.Net.OptimizedCharacterReplication 0 and 1 at the same bot count.
+ */
+UCLASS(config = Game)
+class UNREALONLINECPP_API UOLoadGenerator : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UOLoadGenerator();
+
+	virtual void BeginDestroy() override;
+
+	/**
+	 * Adds simulated clients, one every BotSpawnInterval so the player count ramps up.
+	 *
+	 * @param NumBots: number of bots to add.
+	 * @param ServerAddress: address to connect to directly, empty to search LAN sessions and join the best one.
+	 */
+	void StartBots(int32 NumBots, const FString& ServerAddress);
+
+	// Starts logging server frame time and bandwidth every ReportInterval.
+	void StartServerReport();
+
+	// Disconnects every bot and stops reporting.
+	void Stop();
+
+	// Logs the join latencies of the bots and the load of every match this process hosts.
+	void LogReport();
+
+	// Returns the number of bots that are in a match.
+	int32 NumPlayingBots() const;
+
+	/**
+	 * Feeds one frame of a scripted input pattern to a character, the same input always gives the same movement.
+	 *
+	 * @param Pattern: index of the pattern, every index past the last one plays the last one.
+	 * @param PatternTime: seconds into the pattern.
+	 * @param TurnRate: normalized turn rate of turning patterns.
+	 */
+	static void DrivePattern(AOPlayerCharacter* Character, int32 Pattern, float PatternTime, float TurnRate);
+
+	static const int32 NumPatterns = 3;
+
+private:
+	bool Tick(float DeltaTime);
+
+	void SpawnBot();
+
+	// Advances a bot through searching and joining, and drives its character once it plays.
+	void TickBot(FOLoadTestBot& Bot);
+
+	void DriveBot(FOLoadTestBot& Bot, AOPlayerCharacter* Character);
+
+	// Accumulates the server frame time of this frame.
+	void SampleServer();
+
+	void LogServerReport();
+
+	// Net tick timing: actor ticking ends right before the world flushes its net drivers.
+	void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	void OnPostTickFlush(float DeltaSeconds);
+
+	void StopNetTickTiming();
+
+	void LogBotReport() const;
+
+	void StartTicking();
+
+public:
+	// Seconds between two bots being added.
+	UPROPERTY(config, EditDefaultsOnly, Category = "LoadTest")
+	float BotSpawnInterval;
+
+	// Seconds a bot may take to find, join and possess a character before it counts as failed.
+	UPROPERTY(config, EditDefaultsOnly, Category = "LoadTest")
+	float BotJoinTimeout;
+
+	// Seconds between two shots of a bot.
+	UPROPERTY(config, EditDefaultsOnly, Category = "LoadTest")
+	float BotFireInterval;
+
+	// Normalized turn rate of turning bots.
+	UPROPERTY(config, EditDefaultsOnly, Category = "LoadTest")
+	float BotTurnRate;
+
+	// Seconds between two server load reports.
+	UPROPERTY(config, EditDefaultsOnly, Category = "LoadTest")
+	float ReportInterval;
+
+	// Server frame time in milliseconds above which a match counts as degraded.
+	UPROPERTY(config, EditDefaultsOnly, Category = "LoadTest")
+	float FrameTimeBudgetMs;
+
+private:
+	UPROPERTY(Transient)
+	TArray<FOLoadTestBot> Bots;
+
+	// Bots still to be added
+	int32 NumBotsToSpawn;
+
+	// Address bots connect to, empty to search sessions
+	FString BotServerAddress;
+
+	float TimeToNextBot;
+
+	// Server reporting state
+	bool bReportServer;
+	float TimeToNextReport;
+	double FrameTimeSum;
+	double FrameTimeMax;
+	int32 NumFrames;
+
+	// Net tick timing state
+	double NetTickStartTime;
+	TWeakObjectPtr<UWorld> NetTickWorld;
+	double NetTickTimeSum;
+	int64 NumNetTickConnections;
+	int32 NumNetTicks;
+	TArray<TWeakObjectPtr<UWorld>> NetTickWorlds;
+	FDelegateHandle PostActorTickHandle;
+
+	// Player count at which the frame budget was first exceeded, INDEX_NONE if it never was
+	int32 DegradedAtNumPlayers;
+
+	FDelegateHandle TickHandle;
+};
@@ -0,0 +1,853 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OMatchmaking.h"
+#include "OStats.h"
+#include "Containers/Ticker.h"
+#include "HAL/IConsoleManager.h"
+#include "IPAddress.h"
+#include "Math/RandomStream.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogOMatchmaking, Log, All);
+
+O_DECLARE_CYCLE_STAT("Matchmaking Tick", STAT_OMatchmakingTick);
+
+namespace
+{
+	// Key of a request, unique per client
+	FString GetRequestKey(uint32 RequestId, const FString& ReplyAddress)
+	{
+		return FString::Printf(TEXT("%s#%u"), *ReplyAddress, RequestId);
+	}
+
+	struct FOMatchmakingBenchmarkResult
+	{
+		int32 NumParties = 0;
+		int32 NumPlayers = 0;
+		double TickSeconds = 0.0;
+		int32 NumUsedMatches = 0;
+		int32 NumPlayersInMatches = 0;
+		int32 NumSlotsOfUsedMatches = 0;
+	};
+
+	// Places NumPlayers queued players on simulated hosts that start with one partly filled match each
+	FOMatchmakingBenchmarkResult RunPlacementSimulation(EOPlacementPolicy Policy, int32 NumPlayers, int32 NumHosts, FOMatchmakingRegistry& Registry)
+	{
+		const TCHAR* Regions[] = { TEXT("eu"), TEXT("us"), TEXT("asia") };
+		const int32 NumRegions = ARRAY_COUNT(Regions);
+		const int32 MatchMaxPlayers = 16;
+		const int32 HostMaxMatches = FMath::Max(FMath::DivideAndRoundUp(NumPlayers * 2, NumHosts * MatchMaxPlayers), 2);
+		const double TickInterval = 0.1;
+
+		FOMatchmakingBenchmarkResult Result;
+		FRandomStream Random(1234);
+		double Now = 1.0;
+
+		Registry.Policy = Policy;
+
+		TMap<FString, int32> NumMatchesByHost;
+		TMap<FString, int32> HostIndices;
+		auto AddMatch = [&](const FString& HostId, int32 HostIdx, int32 NumMatchPlayers)
+		{
+			HostIndices.Add(HostId, HostIdx);
+			int32& NumMatches = NumMatchesByHost.FindOrAdd(HostId);
+
+			FOMatchServer Server;
+			Server.HostId = HostId;
+			Server.ServerId = FString::Printf(TEXT("%s/Match_%d"), *HostId, NumMatches);
+			Server.Region = Regions[HostIdx % NumRegions];
+			Server.Address = FString::Printf(TEXT("10.0.%d.%d:%d"), HostIdx / 256, HostIdx % 256, 7777 + NumMatches);
+			Server.Map = TEXT("FirstPersonExampleMap");
+			Server.MaxPlayers = MatchMaxPlayers;
+			Server.NumPlayers = NumMatchPlayers;
+			Server.HostMaxMatches = HostMaxMatches;
+			Registry.UpdateServer(Server, Now);
+
+			NumMatches++;
+		};
+
+		for (int32 HostIdx = 0; HostIdx < NumHosts; HostIdx++)
+		{
+			AddMatch(FString::Printf(TEXT("Host%d"), HostIdx), HostIdx, Random.RandRange(0, MatchMaxPlayers / 2));
+		}
+
+		// Mostly solo players, some parties, every one close to one region and far from the others
+		while (Result.NumPlayers < NumPlayers)
+		{
+			const float PartyRoll = Random.FRand();
+
+			FOPlacementRequest Request;
+			Request.RequestId = Result.NumParties;
+			Request.ReplyAddress = TEXT("Benchmark");
+			Request.PartySize = FMath::Min((PartyRoll < 0.7f) ? 1 : (PartyRoll < 0.9f) ? 2 : 4, NumPlayers - Result.NumPlayers);
+
+			const int32 HomeRegion = Random.RandHelper(NumRegions);
+			for (int32 RegionIdx = 0; RegionIdx < NumRegions; RegionIdx++)
+			{
+				Request.RegionPings.Emplace(Regions[RegionIdx], (RegionIdx == HomeRegion) ? Random.RandRange(20, 80) : Random.RandRange(100, 250));
+			}
+
+			Registry.EnqueueRequest(Request, Now);
+
+			Result.NumParties++;
+			Result.NumPlayers += Request.PartySize;
+		}
+
+		TArray<FOPlacement> Placements;
+		TArray<FString> MatchStartHostIds;
+		double NextHeartbeatTime = Now + 1.0;
+
+		for (int32 TickIdx = 0; TickIdx < 3000 && Registry.GetNumQueued() > 0; TickIdx++)
+		{
+			Placements.Reset();
+			MatchStartHostIds.Reset();
+
+			const double StartTime = FPlatformTime::Seconds();
+			Registry.Tick(Now, Placements, MatchStartHostIds);
+			Result.TickSeconds += FPlatformTime::Seconds() - StartTime;
+
+			// Hosts come up with their new match by the next tick
+			for (const FString& HostId : MatchStartHostIds)
+			{
+				AddMatch(HostId, HostIndices.FindChecked(HostId), 0);
+			}
+
+			// Placed players arrive and show up in the next heartbeat
+			if (Now >= NextHeartbeatTime)
+			{
+				TArray<FOMatchServer> Heartbeats;
+				Registry.GetServers().GenerateValueArray(Heartbeats);
+
+				for (FOMatchServer& Server : Heartbeats)
+				{
+					Server.NumPlayers += Server.Reservations.Num();
+					Registry.UpdateServer(Server, Now);
+				}
+
+				NextHeartbeatTime = Now + 1.0;
+			}
+
+			Now += TickInterval;
+		}
+
+		for (const TPair<FString, FOMatchServer>& Server : Registry.GetServers())
+		{
+			const int32 NumMatchPlayers = Server.Value.NumPlayers + Server.Value.Reservations.Num();
+			if (NumMatchPlayers > 0)
+			{
+				Result.NumUsedMatches++;
+				Result.NumPlayersInMatches += NumMatchPlayers;
+				Result.NumSlotsOfUsedMatches += Server.Value.MaxPlayers;
+			}
+		}
+
+		return Result;
+	}
+
+	void RunMatchmakingBenchmark(const TArray<FString>& Args)
+	{
+		const int32 NumPlayers = (Args.Num() > 0) ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 5000;
+		const int32 NumHosts = (Args.Num() > 1) ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 24;
+
+		const EOPlacementPolicy Policies[] = { EOPlacementPolicy::BestFit, EOPlacementPolicy::FirstFit };
+		for (EOPlacementPolicy Policy : Policies)
+		{
+			FOMatchmakingRegistry Registry;
+			const FOMatchmakingBenchmarkResult Result = RunPlacementSimulation(Policy, NumPlayers, NumHosts, Registry);
+
+			UE_LOG(LogOMatchmaking, Log, TEXT("%s: %d players in %d parties on %d hosts | %.0f placements/s | %lld placed | %lld failed | %d queued | %d matches used, %.1f%% full | %lld matches started"),
+				(Policy == EOPlacementPolicy::BestFit) ? TEXT("Best fit") : TEXT("First fit"),
+				Result.NumPlayers, Result.NumParties, NumHosts,
+				(Result.TickSeconds > 0.0) ? Registry.NumPlaced / Result.TickSeconds : 0.0,
+				Registry.NumPlaced, Registry.NumFailed, Registry.GetNumQueued(),
+				Result.NumUsedMatches, (Result.NumSlotsOfUsedMatches > 0) ? 100.0f * Result.NumPlayersInMatches / Result.NumSlotsOfUsedMatches : 0.0f,
+				Registry.NumMatchStarts);
+		}
+	}
+
+	FAutoConsoleCommand MatchmakingBenchmarkCommand(
+		TEXT("o.Matchmaking.Benchmark"),
+		TEXT("Places queued players on simulated hosts, packed and first fit, and logs placements per second and match fill. Args: [Players] [Hosts]"),
+		FConsoleCommandWithArgsDelegate::CreateStatic(&RunMatchmakingBenchmark));
+}
+
+FOMatchmakingRegistry::FOMatchmakingRegistry()
+	: Policy(EOPlacementPolicy::BestFit)
+	, ServerTimeout(10.0f)
+	, ReservationTimeout(30.0f)
+	, MaxPlacementPing(150)
+	, MaxQueueSeconds(60.0f)
+	, MatchStartTimeout(30.0f)
+	, NumPlaced(0)
+	, NumFailed(0)
+	, NumMatchStarts(0)
+{
+}
+
+void FOMatchmakingRegistry::UpdateServer(const FOMatchServer& Server, double Now)
+{
+	FOMatchServer* ExistingServer = Servers.Find(Server.ServerId);
+	if (ExistingServer == nullptr)
+	{
+		FOMatchServer& NewServer = Servers.Add(Server.ServerId, Server);
+		NewServer.Reservations.Reset();
+		NewServer.LastHeartbeatTime = Now;
+		ServerIdsByRegion.FindOrAdd(Server.Region).Add(Server.ServerId);
+
+		// The match the host was asked for is up
+		TArray<double>* HostMatchStarts = PendingMatchStarts.Find(Server.HostId);
+		if (HostMatchStarts != nullptr)
+		{
+			HostMatchStarts->RemoveAt(0);
+			if (HostMatchStarts->Num() == 0)
+			{
+				PendingMatchStarts.Remove(Server.HostId);
+			}
+		}
+		return;
+	}
+
+	if (ExistingServer->Region != Server.Region)
+	{
+		ServerIdsByRegion.FindChecked(ExistingServer->Region).RemoveSingleSwap(Server.ServerId);
+		ServerIdsByRegion.FindOrAdd(Server.Region).Add(Server.ServerId);
+	}
+
+	// Every player that arrived takes over the oldest reservation
+	const int32 NumArrived = FMath::Clamp(Server.NumPlayers - ExistingServer->NumPlayers, 0, ExistingServer->Reservations.Num());
+	ExistingServer->Reservations.RemoveAt(0, NumArrived, false);
+
+	ExistingServer->HostId = Server.HostId;
+	ExistingServer->Region = Server.Region;
+	ExistingServer->Address = Server.Address;
+	ExistingServer->Map = Server.Map;
+	ExistingServer->MaxPlayers = Server.MaxPlayers;
+	ExistingServer->NumPlayers = Server.NumPlayers;
+	ExistingServer->HostMaxMatches = Server.HostMaxMatches;
+	ExistingServer->LastHeartbeatTime = Now;
+}
+
+void FOMatchmakingRegistry::RemoveServer(const FString& ServerId)
+{
+	FOMatchServer Server;
+	if (Servers.RemoveAndCopyValue(ServerId, Server))
+	{
+		ServerIdsByRegion.FindChecked(Server.Region).RemoveSingleSwap(ServerId);
+	}
+}
+
+void FOMatchmakingRegistry::EnqueueRequest(const FOPlacementRequest& Request, double Now)
+{
+	bool bAlreadyQueued = false;
+	QueuedRequestKeys.Add(GetRequestKey(Request.RequestId, Request.ReplyAddress), &bAlreadyQueued);
+
+	if (bAlreadyQueued)
+	{
+		return;
+	}
+
+	FOPlacementRequest& QueuedRequest = Queue.Add_GetRef(Request);
+	QueuedRequest.EnqueueTime = Now;
+
+	// Lowest ping first, placement stops at the first region that is too far away
+	QueuedRequest.RegionPings.Sort([](const TPair<FString, int32>& A, const TPair<FString, int32>& B)
+	{
+		return A.Value < B.Value;
+	});
+}
+
+bool FOMatchmakingRegistry::CancelRequest(uint32 RequestId, const FString& ReplyAddress)
+{
+	if (QueuedRequestKeys.Remove(GetRequestKey(RequestId, ReplyAddress)) == 0)
+	{
+		return false;
+	}
+
+	Queue.RemoveAll([RequestId, &ReplyAddress](const FOPlacementRequest& Request)
+	{
+		return Request.RequestId == RequestId && Request.ReplyAddress == ReplyAddress;
+	});
+
+	return true;
+}
+
+int32 FOMatchmakingRegistry::GetQueuePosition(uint32 RequestId, const FString& ReplyAddress) const
+{
+	return Queue.IndexOfByPredicate([RequestId, &ReplyAddress](const FOPlacementRequest& Request)
+	{
+		return Request.RequestId == RequestId && Request.ReplyAddress == ReplyAddress;
+	});
+}
+
+void FOMatchmakingRegistry::Tick(double Now, TArray<FOPlacement>& OutPlacements, TArray<FString>& OutMatchStartHostIds)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OMatchmakingTick);
+
+	// Matches that stopped sending heartbeats are gone, with the slots reserved on them
+	for (auto It = Servers.CreateIterator(); It; ++It)
+	{
+		FOMatchServer& Server = It.Value();
+		if (Now - Server.LastHeartbeatTime > ServerTimeout)
+		{
+			UE_LOG(LogOMatchmaking, Log, TEXT("Match %s timed out"), *It.Key());
+			ServerIdsByRegion.FindChecked(Server.Region).RemoveSingleSwap(It.Key());
+			It.RemoveCurrent();
+			continue;
+		}
+
+		int32 NumExpired = 0;
+		while (NumExpired < Server.Reservations.Num() && Server.Reservations[NumExpired] <= Now)
+		{
+			NumExpired++;
+		}
+		Server.Reservations.RemoveAt(0, NumExpired, false);
+	}
+
+	// Hosts that did not come up with their match in time can be asked again
+	for (auto It = PendingMatchStarts.CreateIterator(); It; ++It)
+	{
+		It.Value().RemoveAll([this, Now](double RequestTime) { return Now - RequestTime > MatchStartTimeout; });
+		if (It.Value().Num() == 0)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	// Largest party every region can still take, most requests of a full region are skipped without looking at its matches
+	TMap<FString, int32> MaxFreeSlotsByRegion;
+	for (const TPair<FString, TArray<FString>>& Region : ServerIdsByRegion)
+	{
+		MaxFreeSlotsByRegion.Add(Region.Key, GetMaxFreeSlots(Region.Key));
+	}
+
+	TMap<FString, int32> UnplacedPlayersByRegion;
+	int32 NumKept = 0;
+
+	// Parties queued before the matches registered may not fit into any of them, they would only ask hosts for matches
+	const int32 MaxMatchPlayers = GetMaxMatchPlayers();
+
+	for (int32 RequestIdx = 0; RequestIdx < Queue.Num(); RequestIdx++)
+	{
+		FOPlacementRequest& Request = Queue[RequestIdx];
+
+		FOMatchServer* Server = nullptr;
+		const FString* HomeRegion = nullptr;
+		const bool bPartyTooLarge = MaxMatchPlayers > 0 && Request.PartySize > MaxMatchPlayers;
+
+		for (const TPair<FString, int32>& RegionPing : Request.RegionPings)
+		{
+			if (bPartyTooLarge)
+			{
+				break;
+			}
+
+			if (RegionPing.Value > MaxPlacementPing)
+			{
+				break;
+			}
+
+			if (HomeRegion == nullptr)
+			{
+				HomeRegion = &RegionPing.Key;
+			}
+
+			int32* MaxFreeSlots = MaxFreeSlotsByRegion.Find(RegionPing.Key);
+			if (MaxFreeSlots == nullptr || *MaxFreeSlots < Request.PartySize)
+			{
+				continue;
+			}
+
+			Server = FindMatchFor(RegionPing.Key, Request.PartySize);
+			if (Server != nullptr)
+			{
+				const bool bHadMaxFreeSlots = Server->GetFreeSlots() == *MaxFreeSlots;
+
+				for (int32 PlayerIdx = 0; PlayerIdx < Request.PartySize; PlayerIdx++)
+				{
+					Server->Reservations.Add(Now + ReservationTimeout);
+				}
+
+				if (bHadMaxFreeSlots)
+				{
+					*MaxFreeSlots = GetMaxFreeSlots(RegionPing.Key);
+				}
+				break;
+			}
+		}
+
+		if (Server != nullptr || HomeRegion == nullptr || bPartyTooLarge || Now - Request.EnqueueTime > MaxQueueSeconds)
+		{
+			FOPlacement& Placement = OutPlacements.AddDefaulted_GetRef();
+			if (Server != nullptr)
+			{
+				Placement.ServerId = Server->ServerId;
+				Placement.Address = Server->Address;
+				NumPlaced++;
+			}
+			else
+			{
+				NumFailed++;
+			}
+
+			QueuedRequestKeys.Remove(GetRequestKey(Request.RequestId, Request.ReplyAddress));
+			Placement.Request = MoveTemp(Request);
+			continue;
+		}
+
+		UnplacedPlayersByRegion.FindOrAdd(*HomeRegion) += Request.PartySize;
+
+		if (NumKept != RequestIdx)
+		{
+			Queue[NumKept] = MoveTemp(Request);
+		}
+		NumKept++;
+	}
+
+	Queue.SetNum(NumKept, false);
+
+	RequestMatchStarts(Now, UnplacedPlayersByRegion, OutMatchStartHostIds);
+}
+
+void FOMatchmakingRegistry::LogStats() const
+{
+	int32 NumPlayers = 0;
+	int32 NumReserved = 0;
+	int32 NumSlots = 0;
+
+	for (const TPair<FString, FOMatchServer>& Server : Servers)
+	{
+		NumPlayers += Server.Value.NumPlayers;
+		NumReserved += Server.Value.Reservations.Num();
+		NumSlots += Server.Value.MaxPlayers;
+	}
+
+	UE_LOG(LogOMatchmaking, Log, TEXT("Matchmaking stats: Matches %d | Players %d | Reserved %d | Slots %d | Queued %d | Placed %lld | Failed %lld | MatchStarts %lld"),
+		Servers.Num(), NumPlayers, NumReserved, NumSlots, Queue.Num(), NumPlaced, NumFailed, NumMatchStarts);
+}
+
+int32 FOMatchmakingRegistry::GetMaxMatchPlayers() const
+{
+	int32 MaxMatchPlayers = 0;
+	for (const TPair<FString, FOMatchServer>& Server : Servers)
+	{
+		MaxMatchPlayers = FMath::Max(MaxMatchPlayers, Server.Value.MaxPlayers);
+	}
+
+	return MaxMatchPlayers;
+}
+
+FOMatchServer* FOMatchmakingRegistry::FindMatchFor(const FString& Region, int32 PartySize)
+{
+	const TArray<FString>* ServerIds = ServerIdsByRegion.Find(Region);
+	if (ServerIds == nullptr)
+	{
+		return nullptr;
+	}
+
+	FOMatchServer* BestServer = nullptr;
+	int32 BestFreeSlots = MAX_int32;
+
+	for (const FString& ServerId : *ServerIds)
+	{
+		FOMatchServer& Server = Servers.FindChecked(ServerId);
+		const int32 FreeSlots = Server.GetFreeSlots();
+		if (FreeSlots < PartySize)
+		{
+			continue;
+		}
+
+		if (Policy == EOPlacementPolicy::FirstFit)
+		{
+			return &Server;
+		}
+
+		if (FreeSlots < BestFreeSlots)
+		{
+			BestServer = &Server;
+			BestFreeSlots = FreeSlots;
+
+			// Fills the match completely, nothing fits better
+			if (FreeSlots == PartySize)
+			{
+				break;
+			}
+		}
+	}
+
+	return BestServer;
+}
+
+int32 FOMatchmakingRegistry::GetMaxFreeSlots(const FString& Region) const
+{
+	int32 MaxFreeSlots = 0;
+
+	const TArray<FString>* ServerIds = ServerIdsByRegion.Find(Region);
+	if (ServerIds != nullptr)
+	{
+		for (const FString& ServerId : *ServerIds)
+		{
+			MaxFreeSlots = FMath::Max(MaxFreeSlots, Servers.FindChecked(ServerId).GetFreeSlots());
+		}
+	}
+
+	return MaxFreeSlots;
+}
+
+void FOMatchmakingRegistry::RequestMatchStarts(double Now, const TMap<FString, int32>& UnplacedPlayersByRegion, TArray<FString>& OutMatchStartHostIds)
+{
+	if (UnplacedPlayersByRegion.Num() == 0)
+	{
+		return;
+	}
+
+	struct FHost
+	{
+		FString Region;
+		int32 MaxMatches = 0;
+		int32 NumMatches = 0;
+		int32 MatchMaxPlayers = 0;
+	};
+
+	TMap<FString, FHost> Hosts;
+	for (const TPair<FString, FOMatchServer>& Server : Servers)
+	{
+		FHost& Host = Hosts.FindOrAdd(Server.Value.HostId);
+		Host.Region = Server.Value.Region;
+		Host.MaxMatches = Server.Value.HostMaxMatches;
+		Host.NumMatches++;
+		Host.MatchMaxPlayers = FMath::Max(Host.MatchMaxPlayers, Server.Value.MaxPlayers);
+	}
+
+	auto GetNumPendingMatches = [this](const FString& HostId)
+	{
+		const TArray<double>* HostMatchStarts = PendingMatchStarts.Find(HostId);
+		return HostMatchStarts ? HostMatchStarts->Num() : 0;
+	};
+
+	for (const TPair<FString, int32>& Unplaced : UnplacedPlayersByRegion)
+	{
+		// Matches that are already starting take their share of the queue
+		int32 NumMissingSlots = Unplaced.Value;
+		for (const TPair<FString, FHost>& Host : Hosts)
+		{
+			if (Host.Value.Region == Unplaced.Key)
+			{
+				NumMissingSlots -= GetNumPendingMatches(Host.Key) * Host.Value.MatchMaxPlayers;
+			}
+		}
+
+		while (NumMissingSlots > 0)
+		{
+			// The host running the fewest matches spreads them over the processes
+			const TPair<FString, FHost>* BestHost = nullptr;
+			int32 BestNumMatches = MAX_int32;
+
+			for (const TPair<FString, FHost>& Host : Hosts)
+			{
+				const int32 NumMatches = Host.Value.NumMatches + GetNumPendingMatches(Host.Key);
+				if (Host.Value.Region == Unplaced.Key && Host.Value.MatchMaxPlayers > 0 && NumMatches < Host.Value.MaxMatches && NumMatches < BestNumMatches)
+				{
+					BestHost = &Host;
+					BestNumMatches = NumMatches;
+				}
+			}
+
+			if (BestHost == nullptr)
+			{
+				break;
+			}
+
+			PendingMatchStarts.FindOrAdd(BestHost->Key).Add(Now);
+			OutMatchStartHostIds.Add(BestHost->Key);
+			NumMatchStarts++;
+
+			NumMissingSlots -= BestHost->Value.MatchMaxPlayers;
+		}
+	}
+}
+
+FOMatchmakingSocket::~FOMatchmakingSocket()
+{
+	Close();
+}
+
+bool FOMatchmakingSocket::Open(int32 Port)
+{
+	Close();
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (SocketSubsystem == nullptr)
+	{
+		return false;
+	}
+
+	Socket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("Matchmaking"), false);
+	if (Socket == nullptr)
+	{
+		return false;
+	}
+
+	Socket->SetNonBlocking(true);
+
+	if (Port > 0)
+	{
+		TSharedRef<FInternetAddr> Address = SocketSubsystem->CreateInternetAddr();
+		Address->SetAnyAddress();
+		Address->SetPort(Port);
+
+		if (!Socket->Bind(*Address))
+		{
+			UE_LOG(LogOMatchmaking, Error, TEXT("Failed to bind the matchmaking socket to port %d"), Port);
+			Close();
+			return false;
+		}
+	}
+
+	ReceiveBuffer.SetNumUninitialized(2048);
+
+	return true;
+}
+
+void FOMatchmakingSocket::Close()
+{
+	if (Socket != nullptr)
+	{
+		Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Socket);
+		Socket = nullptr;
+	}
+}
+
+TSharedPtr<FInternetAddr> FOMatchmakingSocket::ParseAddress(const FString& Address)
+{
+	FString Ip;
+	FString Port;
+	if (!Address.Split(TEXT(":"), &Ip, &Port, ESearchCase::IgnoreCase, ESearchDir::FromEnd))
+	{
+		return nullptr;
+	}
+
+	bool bIsValid = false;
+	TSharedRef<FInternetAddr> InternetAddress = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+	InternetAddress->SetIp(*Ip, bIsValid);
+	InternetAddress->SetPort(FCString::Atoi(*Port));
+
+	return bIsValid ? TSharedPtr<FInternetAddr>(InternetAddress) : nullptr;
+}
+
+bool FOMatchmakingSocket::Send(const FString& Message, const FString& Address)
+{
+	TSharedPtr<FInternetAddr> Destination = ParseAddress(Address);
+	if (Socket == nullptr || !Destination.IsValid())
+	{
+		return false;
+	}
+
+	const FTCHARToUTF8 Utf8Message(*Message);
+
+	int32 BytesSent = 0;
+	return Socket->SendTo(reinterpret_cast<const uint8*>(Utf8Message.Get()), Utf8Message.Length(), BytesSent, *Destination);
+}
+
+bool FOMatchmakingSocket::IsSameAddress(const FString& SenderAddress, const FString& Address)
+{
+	// Compared in the form the socket subsystem prints received addresses in, not as typed on the command line
+	TSharedPtr<FInternetAddr> ParsedAddress = ParseAddress(Address);
+	return ParsedAddress.IsValid() && ParsedAddress->ToString(true) == SenderAddress;
+}
+
+bool FOMatchmakingSocket::Receive(FString& OutMessage, FString& OutSenderAddress)
+{
+	if (Socket == nullptr)
+	{
+		return false;
+	}
+
+	TSharedRef<FInternetAddr> Sender = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+
+	int32 BytesRead = 0;
+	if (!Socket->RecvFrom(ReceiveBuffer.GetData(), ReceiveBuffer.Num(), BytesRead, *Sender) || BytesRead <= 0)
+	{
+		return false;
+	}
+
+	const FUTF8ToTCHAR Message(reinterpret_cast<const ANSICHAR*>(ReceiveBuffer.GetData()), BytesRead);
+	OutMessage = FString(Message.Length(), Message.Get());
+	OutSenderAddress = Sender->ToString(true);
+
+	return true;
+}
+
+FOMatchmakingService::~FOMatchmakingService()
+{
+	Stop();
+}
+
+bool FOMatchmakingService::Start(int32 Port)
+{
+	Stop();
+
+	if (!Socket.Open(Port))
+	{
+		return false;
+	}
+
+	LastStatsTime = FPlatformTime::Seconds();
+	NumPlacedAtLastStats = Registry.NumPlaced;
+
+	// Every frame, a placement waits at most one frame of the service process
+	TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FOMatchmakingService::Tick), 0.0f);
+
+	UE_LOG(LogOMatchmaking, Log, TEXT("Matchmaking service listening on port %d"), Port);
+
+	return true;
+}
+
+void FOMatchmakingService::Stop()
+{
+	if (TickHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+		TickHandle.Reset();
+
+		Registry.LogStats();
+	}
+
+	Socket.Close();
+}
+
+bool FOMatchmakingService::Tick(float DeltaTime)
+{
+	const double Now = FPlatformTime::Seconds();
+
+	// A burst of messages is spread over frames instead of stalling one
+	FString Message;
+	FString SenderAddress;
+	for (int32 MessageIdx = 0; MessageIdx < 4096 && Socket.Receive(Message, SenderAddress); MessageIdx++)
+	{
+		HandleMessage(Message, SenderAddress, Now);
+	}
+
+	TArray<FOPlacement> Placements;
+	TArray<FString> MatchStartHostIds;
+	Registry.Tick(Now, Placements, MatchStartHostIds);
+
+	for (const FOPlacement& Placement : Placements)
+	{
+		const FString Result = Placement.ServerId.IsEmpty()
+			? FString::Printf(TEXT("FAILED %u"), Placement.Request.RequestId)
+			: FString::Printf(TEXT("PLACED %u %s"), Placement.Request.RequestId, *Placement.Address);
+
+		Socket.Send(Result, Placement.Request.ReplyAddress);
+		RecentResults.Add(GetRequestKey(Placement.Request.RequestId, Placement.Request.ReplyAddress), TPair<FString, double>(Result, Now));
+	}
+
+	for (const FString& HostId : MatchStartHostIds)
+	{
+		const FString* HostAddress = HostAddresses.Find(HostId);
+		const FString* HostMap = HostMaps.Find(HostId);
+		if (HostAddress != nullptr && HostMap != nullptr)
+		{
+			UE_LOG(LogOMatchmaking, Log, TEXT("Asking %s to start a match of %s"), *HostId, **HostMap);
+			Socket.Send(FString::Printf(TEXT("STARTMATCH %s"), **HostMap), *HostAddress);
+		}
+	}
+
+	if (Now - LastStatsTime >= 10.0)
+	{
+		UE_LOG(LogOMatchmaking, Log, TEXT("Matchmaking: %d matches | %d queued | %.1f placements/s"),
+			Registry.GetNumServers(), Registry.GetNumQueued(), (Registry.NumPlaced - NumPlacedAtLastStats) / (Now - LastStatsTime));
+
+		LastStatsTime = Now;
+		NumPlacedAtLastStats = Registry.NumPlaced;
+
+		// A client repeating its request gets the result, it never waits this long for it
+		for (auto It = RecentResults.CreateIterator(); It; ++It)
+		{
+			if (Now - It.Value().Value > 30.0)
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	return true;
+}
+
+void FOMatchmakingService::HandleMessage(const FString& Message, const FString& SenderAddress, double Now)
+{
+	TArray<FString> Tokens;
+	Message.ParseIntoArrayWS(Tokens);
+
+	if (Tokens.Num() == 9 && Tokens[0] == TEXT("SERVER"))
+	{
+		FOMatchServer Server;
+		Server.HostId = Tokens[1];
+		Server.HostMaxMatches = FCString::Atoi(*Tokens[2]);
+		Server.ServerId = Tokens[3];
+		Server.Region = Tokens[4];
+		Server.Address = Tokens[5];
+		Server.Map = Tokens[6];
+		Server.MaxPlayers = FCString::Atoi(*Tokens[7]);
+		Server.NumPlayers = FCString::Atoi(*Tokens[8]);
+
+		HostAddresses.Add(Server.HostId, SenderAddress);
+		HostMaps.Add(Server.HostId, Server.Map);
+		Registry.UpdateServer(Server, Now);
+	}
+	else if (Tokens.Num() == 4 && Tokens[0] == TEXT("PLACE"))
+	{
+		const uint32 RequestId = static_cast<uint32>(FCString::Strtoui64(*Tokens[1], nullptr, 10));
+
+		// The result got lost on the way
+		const TPair<FString, double>* RecentResult = RecentResults.Find(GetRequestKey(RequestId, SenderAddress));
+		if (RecentResult != nullptr)
+		{
+			Socket.Send(RecentResult->Key, SenderAddress);
+			return;
+		}
+
+		// No match can take a bigger party, queueing it would only make hosts start matches for it
+		const int32 MaxMatchPlayers = Registry.GetMaxMatchPlayers();
+		const int32 PartySize = FCString::Atoi(*Tokens[2]);
+		if (MaxMatchPlayers > 0 && PartySize > MaxMatchPlayers)
+		{
+			UE_LOG(LogOMatchmaking, Log, TEXT("Party of %d from %s does not fit into a match of %d"), PartySize, *SenderAddress, MaxMatchPlayers);
+
+			const FString Result = FString::Printf(TEXT("FAILED %u"), RequestId);
+			Socket.Send(Result, SenderAddress);
+			RecentResults.Add(GetRequestKey(RequestId, SenderAddress), TPair<FString, double>(Result, Now));
+			Registry.NumFailed++;
+			return;
+		}
+
+		FOPlacementRequest Request;
+		Request.RequestId = RequestId;
+		Request.PartySize = FMath::Max(PartySize, 1);
+		Request.ReplyAddress = SenderAddress;
+
+		TArray<FString> RegionPings;
+		Tokens[3].ParseIntoArray(RegionPings, TEXT(","));
+		for (const FString& RegionPing : RegionPings)
+		{
+			FString Region;
+			FString Ping;
+			if (RegionPing.Split(TEXT(":"), &Region, &Ping))
+			{
+				Request.RegionPings.Emplace(Region, FCString::Atoi(*Ping));
+			}
+		}
+
+		Registry.EnqueueRequest(Request, Now);
+		Socket.Send(FString::Printf(TEXT("QUEUED %u %d"), RequestId, Registry.GetQueuePosition(RequestId, SenderAddress)), SenderAddress);
+	}
+	else if (Tokens.Num() == 2 && Tokens[0] == TEXT("CANCEL"))
+	{
+		Registry.CancelRequest(static_cast<uint32>(FCString::Strtoui64(*Tokens[1], nullptr, 10)), SenderAddress);
+	}
+	else
+	{
+		UE_LOG(LogOMatchmaking, Verbose, TEXT("Ignoring matchmaking message '%s' from %s"), *Message, *SenderAddress);
+	}
+}
@@ -0,0 +1,251 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FInternetAddr;
+class FSocket;
+
+// Match a server process hosts, as it reports itself to the matchmaking service.
+struct FOMatchServer
+{
+	// Unique per match, <HostId>/<SessionName>
+	FString ServerId;
+
+	// Server process hosting the match, it can be asked to start more matches
+	FString HostId;
+
+	FString Region;
+
+	// Address clients travel to, <Ip>:<Port>
+	FString Address;
+
+	FString Map;
+
+	int32 MaxPlayers = 0;
+	int32 NumPlayers = 0;
+
+	// Matches the host process may run at once
+	int32 HostMaxMatches = 1;
+
+	// Expiry times of the slots promised to placed players that did not show up in a heartbeat yet, oldest first
+	TArray<double> Reservations;
+
+	double LastHeartbeatTime = 0.0;
+
+	FORCEINLINE int32 GetFreeSlots() const { return MaxPlayers - NumPlayers - Reservations.Num(); }
+};
+
+// Players that want to be placed into a match together.
+struct FOPlacementRequest
+{
+	// Chosen by the requesting client, unique together with ReplyAddress
+	uint32 RequestId = 0;
+
+	int32 PartySize = 1;
+
+	// Ping of the party to every region it can play in, in milliseconds
+	TArray<TPair<FString, int32>> RegionPings;
+
+	// Where the service sends the result to
+	FString ReplyAddress;
+
+	double EnqueueTime = 0.0;
+};
+
+// Result of a placement request, ServerId is empty if it failed.
+struct FOPlacement
+{
+	FOPlacementRequest Request;
+	FString ServerId;
+	FString Address;
+};
+
+enum class EOPlacementPolicy : uint8
+{
+	// The fullest match that still fits the party, so matches fill up before new ones are used
+	BestFit,
+
+	// The first match with room, like joining the first search result
+	FirstFit
+};
+
+/**
+ * Server registry and placement queue of the matchmaking service. Match servers report their player count with
+ * every heartbeat and disappear after ServerTimeout without one. Queued parties are packed into the running matches of
+ * their lowest ping region, the fullest match that fits first, and the slots they got stay reserved until a heartbeat
+ * shows them or ReservationTimeout runs out. Only when the queue of a region does not fit into its matches and the
+ * matches already starting there, hosts of that region with room are asked to start another match.
+ * Runs on any thread, as long as it is only one.
+ *
+ * o.Matchmaking.Benchmark [Players] [Hosts] places thousands of queued players on simulated hosts and logs the
+ * placements per second and how full the used matches are, packed and first fit.
+ */
+class UNREALONLINECPP_API FOMatchmakingRegistry
+{
+public:
+	FOMatchmakingRegistry();
+
+	// Registers a match or refreshes it with a heartbeat.
+	void UpdateServer(const FOMatchServer& Server, double Now);
+
+	void RemoveServer(const FString& ServerId);
+
+	// Queues a request, a request that is already queued is kept in its place.
+	void EnqueueRequest(const FOPlacementRequest& Request, double Now);
+
+	// Returns true if the request was still queued.
+	bool CancelRequest(uint32 RequestId, const FString& ReplyAddress);
+
+	// Returns the position of a request in the queue, INDEX_NONE if it is not queued.
+	int32 GetQueuePosition(uint32 RequestId, const FString& ReplyAddress) const;
+
+	/**
+	 * Places as many queued requests as possible and drops timed out servers, reservations and requests.
+	 *
+	 * @param OutPlacements: placed and failed requests.
+	 * @param OutMatchStartHostIds: hosts that should start another match, once per match.
+	 */
+	void Tick(double Now, TArray<FOPlacement>& OutPlacements, TArray<FString>& OutMatchStartHostIds);
+
+	FORCEINLINE int32 GetNumServers() const { return Servers.Num(); }
+
+	FORCEINLINE int32 GetNumQueued() const { return Queue.Num(); }
+
+	FORCEINLINE const TMap<FString, FOMatchServer>& GetServers() const { return Servers; }
+
+	// Returns the most players any registered match takes, bigger parties can never be placed. 0 without matches.
+	int32 GetMaxMatchPlayers() const;
+
+	// Logs servers, queue and totals since the registry was created.
+	void LogStats() const;
+
+public:
+	EOPlacementPolicy Policy;
+
+	// Seconds without heartbeat after which a match is dropped
+	float ServerTimeout;
+
+	// Seconds a placed player has to show up in a heartbeat of its match
+	float ReservationTimeout;
+
+	// Regions with a higher ping are never used for a party
+	int32 MaxPlacementPing;
+
+	// Seconds a request may wait for room before it fails
+	float MaxQueueSeconds;
+
+	// Seconds a match start may take before the host is asked again
+	float MatchStartTimeout;
+
+	int64 NumPlaced;
+	int64 NumFailed;
+	int64 NumMatchStarts;
+
+private:
+	// Returns the best match of a region for a party, nullptr if none has room.
+	FOMatchServer* FindMatchFor(const FString& Region, int32 PartySize);
+
+	int32 GetMaxFreeSlots(const FString& Region) const;
+
+	// Asks hosts for more matches where the queue does not fit into running and starting matches.
+	void RequestMatchStarts(double Now, const TMap<FString, int32>& UnplacedPlayersByRegion, TArray<FString>& OutMatchStartHostIds);
+
+	TMap<FString, FOMatchServer> Servers;
+
+	// Ids of the matches of every region
+	TMap<FString, TArray<FString>> ServerIdsByRegion;
+
+	TArray<FOPlacementRequest> Queue;
+
+	// Keys of the queued requests, <ReplyAddress>#<RequestId>
+	TSet<FString> QueuedRequestKeys;
+
+	// Request times of the match starts every host was asked for and did not register yet
+	TMap<FString, TArray<double>> PendingMatchStarts;
+};
+
+/**
+ * UDP socket speaking the line based protocol of the matchmaking service, one message per datagram:
+ *
+ *   SERVER <HostId> <HostMaxMatches> <ServerId> <Region> <Address> <Map> <MaxPlayers> <NumPlayers>  (server heartbeat)
+ *   PLACE <RequestId> <PartySize> <Region>:<Ping>[,<Region>:<Ping>...]                               (client)
+ *   CANCEL <RequestId>                                                                               (client)
+ *   PLACED <RequestId> <Address> | QUEUED <RequestId> <Position> | FAILED <RequestId>                (to clients)
+ *   STARTMATCH <Map>                                                                                 (to hosts)
+ */
+class UNREALONLINECPP_API FOMatchmakingSocket
+{
+public:
+	~FOMatchmakingSocket();
+
+	/**
+	 * Opens a non-blocking socket.
+	 *
+	 * @param Port: port to listen on, 0 for any.
+	 */
+	bool Open(int32 Port);
+
+	void Close();
+
+	FORCEINLINE bool IsOpen() const { return Socket != nullptr; }
+
+	// Sends a message to <Ip>:<Port>.
+	bool Send(const FString& Message, const FString& Address);
+
+	// Reads the next waiting message, false if there is none.
+	bool Receive(FString& OutMessage, FString& OutSenderAddress);
+
+	// Returns true if a sender address Receive reported is the <Ip>:<Port> address.
+	static bool IsSameAddress(const FString& SenderAddress, const FString& Address);
+
+private:
+	// Returns nullptr if the address is not <Ip>:<Port>.
+	static TSharedPtr<FInternetAddr> ParseAddress(const FString& Address);
+
+	FSocket* Socket = nullptr;
+	TArray<uint8> ReceiveBuffer;
+};
+
+/**
+ * Matchmaking and server registry of a local cluster, run by a process started with -MatchmakingService[=<Port>].
+ * Servers started with -Matchmaker=<Ip>:<Port> register their matches and clients call
+ * UOGameInstance::RequestPlacement instead of searching sessions. Needs nothing but UDP on the local network.
+ */
+class UNREALONLINECPP_API FOMatchmakingService
+{
+public:
+	~FOMatchmakingService();
+
+	bool Start(int32 Port);
+
+	void Stop();
+
+	FORCEINLINE bool IsRunning() const { return TickHandle.IsValid(); }
+
+	FORCEINLINE FOMatchmakingRegistry& GetRegistry() { return Registry; }
+
+	static const int32 DefaultPort = 7900;
+
+private:
+	bool Tick(float DeltaTime);
+
+	void HandleMessage(const FString& Message, const FString& SenderAddress, double Now);
+
+	FOMatchmakingRegistry Registry;
+	FOMatchmakingSocket Socket;
+	FDelegateHandle TickHandle;
+
+	// Address heartbeats of every host came from, match starts are sent there
+	TMap<FString, FString> HostAddresses;
+
+	// Map of the matches of every host, new matches play the same
+	TMap<FString, FString> HostMaps;
+
+	// Results sent for recent requests by <ReplyAddress>#<RequestId>, repeated requests get them again
+	TMap<FString, TPair<FString, double>> RecentResults;
+
+	double LastStatsTime = 0.0;
+	int64 NumPlacedAtLastStats = 0;
+};
@@ -0,0 +1,237 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OReplicationGraph.h"
+#include "OStats.h"
+#include "../Gameplay/OPlayerCharacter.h"
+#include "../Gameplay/OProjectileBatch.h"
+#include "../Gameplay/OProjectilePool.h"
+#include "../Gameplay/OWeaponProjectile.h"
+#include "Engine/LevelScriptActor.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "GameFramework/GameStateBase.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/PlayerState.h"
+
+O_DECLARE_CYCLE_STAT("Replicate Actors", STAT_OReplicateActors);
+
+UOReplicationGraph::UOReplicationGraph()
+{
+	GridCellSize = 10000.0f;
+	SpatialBiasX = -150000.0f;
+	SpatialBiasY = -200000.0f;
+
+	GridNode = nullptr;
+	AlwaysRelevantNode = nullptr;
+}
+
+void UOReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	// Projectiles are simulated on every machine from the fire batches, the pool and the batch are local as well
+	ClassRepNodePolicies.Set(AOWeaponProjectile::StaticClass(), EOClassRepNodeMapping::NotRouted);
+	ClassRepNodePolicies.Set(AOProjectilePool::StaticClass(), EOClassRepNodeMapping::NotRouted);
+	ClassRepNodePolicies.Set(AOProjectileBatch::StaticClass(), EOClassRepNodeMapping::NotRouted);
+	ClassRepNodePolicies.Set(ALevelScriptActor::StaticClass(), EOClassRepNodeMapping::NotRouted);
+
+	ClassRepNodePolicies.Set(AGameStateBase::StaticClass(), EOClassRepNodeMapping::RelevantAllConnections);
+	ClassRepNodePolicies.Set(APlayerState::StaticClass(), EOClassRepNodeMapping::RelevantAllConnections);
+	ClassRepNodePolicies.Set(APlayerController::StaticClass(), EOClassRepNodeMapping::RelevantOwnerConnection);
+	ClassRepNodePolicies.Set(AOPlayerCharacter::StaticClass(), EOClassRepNodeMapping::Spatialize_Dynamic);
+
+	const float ServerMaxTickRate = (NetDriver != nullptr) ? NetDriver->NetServerMaxTickRate : 30.0f;
+
+	// Everything without its own settings replicates at its net update frequency within its cull distance
+	const AActor* ActorCDO = GetDefault<AActor>();
+	FClassReplicationInfo ActorClassInfo;
+	ActorClassInfo.CullDistanceSquared = ActorCDO->NetCullDistanceSquared;
+	ActorClassInfo.ReplicationPeriodFrame = FMath::Max<uint32>(FMath::RoundToInt(ServerMaxTickRate / ActorCDO->NetUpdateFrequency), 1);
+	GlobalActorReplicationInfoMap.SetClassInfo(AActor::StaticClass(), ActorClassInfo);
+
+	// Characters use the cull distance and nearest update rate of the optimized replication profile
+	const AOPlayerCharacter* CharacterCDO = GetDefault<AOPlayerCharacter>();
+	FClassReplicationInfo CharacterClassInfo;
+	CharacterClassInfo.CullDistanceSquared = FMath::Square(CharacterCDO->CharacterNetCullDistance);
+	CharacterClassInfo.ReplicationPeriodFrame = FMath::Max<uint32>(FMath::RoundToInt(ServerMaxTickRate / CharacterCDO->NearNetUpdateFrequency), 1);
+	GlobalActorReplicationInfoMap.SetClassInfo(AOPlayerCharacter::StaticClass(), CharacterClassInfo);
+
+	// Player states only carry names, scores and pings, a few updates per second are plenty
+	FClassReplicationInfo PlayerStateClassInfo;
+	PlayerStateClassInfo.DistancePriorityScale = 0.0f;
+	PlayerStateClassInfo.ReplicationPeriodFrame = FMath::Max<uint32>(FMath::RoundToInt(ServerMaxTickRate / 2.0f), 1);
+	GlobalActorReplicationInfoMap.SetClassInfo(APlayerState::StaticClass(), PlayerStateClassInfo);
+}
+
+void UOReplicationGraph::InitGlobalGraphNodes()
+{
+	// Lists of the sizes the gather pass asks for, so it does not allocate during replication
+	PreAllocateRepList(3, 12);
+	PreAllocateRepList(6, 12);
+	PreAllocateRepList(128, 64);
+
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = GridCellSize;
+	GridNode->SpatialBias = FVector2D(SpatialBiasX, SpatialBiasY);
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+}
+
+void UOReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	UReplicationGraphNode_AlwaysRelevant_ForConnection* OwnerOnlyNode = CreateNewNode<UReplicationGraphNode_AlwaysRelevant_ForConnection>();
+	AddConnectionGraphNode(OwnerOnlyNode, RepGraphConnection);
+
+	OwnerOnlyNodes.Add(RepGraphConnection->NetConnection, OwnerOnlyNode);
+}
+
+void UOReplicationGraph::RemoveClientConnection(UNetConnection* NetConnection)
+{
+	UReplicationGraphNode_AlwaysRelevant_ForConnection* OwnerOnlyNode = nullptr;
+	if (OwnerOnlyNodes.RemoveAndCopyValue(NetConnection, OwnerOnlyNode))
+	{
+		// The node goes away with the connection, its actors have nothing left to be removed from
+		for (auto It = OwnerOnlyActorNodes.CreateIterator(); It; ++It)
+		{
+			if (It.Value() == OwnerOnlyNode)
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	Super::RemoveClientConnection(NetConnection);
+}
+
+EOClassRepNodeMapping UOReplicationGraph::GetMappingPolicy(const AActor* Actor)
+{
+	const EOClassRepNodeMapping* Policy = ClassRepNodePolicies.Get(Actor->GetClass());
+	if (Policy != nullptr)
+	{
+		return *Policy;
+	}
+
+	// Classes without a policy of their own get one from their flags, the same way the engine would judge them
+	EOClassRepNodeMapping Mapping = EOClassRepNodeMapping::Spatialize_Dynamic;
+	if (Actor->bAlwaysRelevant)
+	{
+		Mapping = EOClassRepNodeMapping::RelevantAllConnections;
+	}
+	else if (Actor->bOnlyRelevantToOwner)
+	{
+		Mapping = EOClassRepNodeMapping::RelevantOwnerConnection;
+	}
+	else if (Actor->NetDormancy > DORM_Awake)
+	{
+		Mapping = EOClassRepNodeMapping::Spatialize_Dormancy;
+	}
+	else if (!Actor->IsRootComponentMovable())
+	{
+		Mapping = EOClassRepNodeMapping::Spatialize_Static;
+	}
+
+	ClassRepNodePolicies.Set(Actor->GetClass(), Mapping);
+
+	return Mapping;
+}
+
+void UOReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	switch (GetMappingPolicy(ActorInfo.Actor))
+	{
+	case EOClassRepNodeMapping::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+
+	case EOClassRepNodeMapping::RelevantOwnerConnection:
+		// The owner is usually set after spawning, the actor is routed on the next net tick
+		ActorsWithoutNetConnection.Add(ActorInfo.Actor);
+		break;
+
+	case EOClassRepNodeMapping::Spatialize_Static:
+		GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+		break;
+
+	case EOClassRepNodeMapping::Spatialize_Dynamic:
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		break;
+
+	case EOClassRepNodeMapping::Spatialize_Dormancy:
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void UOReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	switch (GetMappingPolicy(ActorInfo.Actor))
+	{
+	case EOClassRepNodeMapping::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+
+	case EOClassRepNodeMapping::RelevantOwnerConnection:
+		if (ActorsWithoutNetConnection.RemoveSwap(ActorInfo.Actor) == 0)
+		{
+			// Unpossessed or disconnected actors have no connection anymore, they are removed from the node they were added to
+			UReplicationGraphNode_AlwaysRelevant_ForConnection* OwnerOnlyNode = nullptr;
+			if (OwnerOnlyActorNodes.RemoveAndCopyValue(ActorInfo.Actor, OwnerOnlyNode))
+			{
+				OwnerOnlyNode->NotifyRemoveNetworkActor(ActorInfo);
+			}
+		}
+		break;
+
+	case EOClassRepNodeMapping::Spatialize_Static:
+		GridNode->RemoveActor_Static(ActorInfo);
+		break;
+
+	case EOClassRepNodeMapping::Spatialize_Dynamic:
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		break;
+
+	case EOClassRepNodeMapping::Spatialize_Dormancy:
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void UOReplicationGraph::RouteOwnerOnlyActors()
+{
+	for (int32 ActorIdx = ActorsWithoutNetConnection.Num() - 1; ActorIdx >= 0; ActorIdx--)
+	{
+		AActor* Actor = ActorsWithoutNetConnection[ActorIdx];
+		if (Actor == nullptr || Actor->IsPendingKill())
+		{
+			ActorsWithoutNetConnection.RemoveAtSwap(ActorIdx);
+			continue;
+		}
+
+		UReplicationGraphNode_AlwaysRelevant_ForConnection** OwnerOnlyNode = OwnerOnlyNodes.Find(Actor->GetNetConnection());
+		if (OwnerOnlyNode != nullptr)
+		{
+			(*OwnerOnlyNode)->NotifyAddNetworkActor(FNewReplicatedActorInfo(Actor));
+			OwnerOnlyActorNodes.Add(Actor, *OwnerOnlyNode);
+			ActorsWithoutNetConnection.RemoveAtSwap(ActorIdx);
+		}
+	}
+}
+
+int32 UOReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OReplicateActors);
+
+	RouteOwnerOnlyActors();
+
+	return Super::ServerReplicateActors(DeltaSeconds);
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "OReplicationGraph.generated.h"
+
+class UReplicationGraphNode_AlwaysRelevant_ForConnection;
+class UReplicationGraphNode_GridSpatialization2D;
+
+UENUM()
+enum class EOClassRepNodeMapping : uint8
+{
+	// Never replicates through the graph.
+	NotRouted,
+
+	// Replicates to every connection.
+	RelevantAllConnections,
+
+	// Replicates only to the connection that owns it.
+	RelevantOwnerConnection,
+
+	// Placed in the grid once, never moves.
+	Spatialize_Static,
+
+	// Placed in the grid every frame.
+	Spatialize_Dynamic,
+
+	// Moves while awake, placed in the grid once while dormant.
+	Spatialize_Dormancy
+};
+
+/**
+ * Replication graph of the game. Instead of testing every actor against every connection each net tick, actors are
+ * routed once to a node by class policy: moving actors go into a 2D grid and a connection only gathers the cells
+ * around its viewer, game state actors go into one list that is relevant to everyone, and owner-only actors go into
+ * a list per connection.
+ *
+ * Wired in through ReplicationDriverClassName of the net drivers in DefaultEngine.ini.
+ */
+UCLASS(transient, config = Engine)
+class UNREALONLINECPP_API UOReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+	UOReplicationGraph();
+
+	virtual void InitGlobalActorClassSettings() override;
+
+	virtual void InitGlobalGraphNodes() override;
+
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+
+	virtual void RemoveClientConnection(UNetConnection* NetConnection) override;
+
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+public:
+	// Size of a grid cell in world units.
+	UPROPERTY(config)
+	float GridCellSize;
+
+	// Lowest world X and Y the grid covers without growing towards negative coordinates.
+	UPROPERTY(config)
+	float SpatialBiasX;
+
+	UPROPERTY(config)
+	float SpatialBiasY;
+
+private:
+	// Returns the policy of an actor's class, derived from its replication flags if the class has none.
+	EOClassRepNodeMapping GetMappingPolicy(const AActor* Actor);
+
+	// Moves owner-only actors whose connection became known to the list of that connection.
+	void RouteOwnerOnlyActors();
+
+	UPROPERTY()
+	UReplicationGraphNode_GridSpatialization2D* GridNode;
+
+	UPROPERTY()
+	UReplicationGraphNode_ActorList* AlwaysRelevantNode;
+
+	// Owner-only actors of every connection
+	UPROPERTY()
+	TMap<UNetConnection*, UReplicationGraphNode_AlwaysRelevant_ForConnection*> OwnerOnlyNodes;
+
+	// Owner-only actors that don't have a connection yet, routed once they have one
+	UPROPERTY()
+	TArray<AActor*> ActorsWithoutNetConnection;
+
+	// Node every routed owner-only actor was added to, its connection may be gone by the time it is removed
+	UPROPERTY()
+	TMap<AActor*, UReplicationGraphNode_AlwaysRelevant_ForConnection*> OwnerOnlyActorNodes;
+
+	TClassMap<EOClassRepNodeMapping> ClassRepNodePolicies;
+};
@@ -0,0 +1,298 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OServerPool.h"
+#include "OTelemetry.h"
+#include "Containers/Ticker.h"
+#include "HAL/PlatformProcess.h"
+
+#if PLATFORM_LINUX
+#include <signal.h>
+#include <stdio.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+DEFINE_LOG_CATEGORY_STATIC(LogOServerPool, Log, All);
+
+namespace
+{
+	// Seconds a slot stays free before its child is forked again
+	const double MinRespawnSeconds = 1.0;
+
+	// Seconds terminated children get to shut down before they are killed
+	const double StopTimeoutSeconds = 5.0;
+
+	// Time the fork of this process returned, 0 if it was not forked
+	double ForkTime = 0.0;
+
+	bool bMatchReadyReported = false;
+
+	const double BytesPerMegabyte = 1024.0 * 1024.0;
+}
+
+FOServerPool::~FOServerPool()
+{
+	Stop();
+}
+
+bool FOServerPool::Start(int32 Size, TFunction<void(int32)> InOnForked)
+{
+#if PLATFORM_LINUX
+	if (FPlatformProcess::SupportsMultithreading())
+	{
+		UE_LOG(LogOServerPool, Error, TEXT("Forked children would only keep the game thread, start the server pool with -nothreading"));
+		return false;
+	}
+
+	OnForked = MoveTemp(InOnForked);
+	ParentProcessId = getpid();
+	Grow(Size);
+
+	TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FOServerPool::Tick), 0.1f);
+
+	return true;
+#else
+	UE_LOG(LogOServerPool, Error, TEXT("The server pool forks its children, it only runs on Linux"));
+	return false;
+#endif
+}
+
+void FOServerPool::Stop()
+{
+	if (TickHandle.IsValid())
+	{
+		FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+		TickHandle.Reset();
+	}
+
+#if PLATFORM_LINUX
+	for (uint32 ChildProcessId : ChildProcessIds)
+	{
+		if (ChildProcessId != 0)
+		{
+			kill(ChildProcessId, SIGTERM);
+		}
+	}
+
+	const double StopStartTime = FPlatformTime::Seconds();
+	for (uint32 ChildProcessId : ChildProcessIds)
+	{
+		while (ChildProcessId != 0 && waitpid(ChildProcessId, nullptr, WNOHANG) == 0)
+		{
+			if (FPlatformTime::Seconds() - StopStartTime > StopTimeoutSeconds)
+			{
+				kill(ChildProcessId, SIGKILL);
+				waitpid(ChildProcessId, nullptr, 0);
+				break;
+			}
+
+			FPlatformProcess::Sleep(0.01f);
+		}
+	}
+#endif
+
+	ChildProcessIds.Empty();
+	SlotFreeTimes.Empty();
+}
+
+void FOServerPool::Grow(int32 Count)
+{
+	if (IsChild() || Count <= 0)
+	{
+		return;
+	}
+
+	ChildProcessIds.AddZeroed(Count);
+	SlotFreeTimes.AddZeroed(Count);
+}
+
+bool FOServerPool::Tick(float DeltaTime)
+{
+#if PLATFORM_LINUX
+	const double Now = FPlatformTime::Seconds();
+
+	// Children are only reaped by pid, other child processes belong to whoever started them
+	for (int32 SlotIdx = 0; SlotIdx < ChildProcessIds.Num(); SlotIdx++)
+	{
+		int Status = 0;
+		if (ChildProcessIds[SlotIdx] != 0 && waitpid(ChildProcessIds[SlotIdx], &Status, WNOHANG) == static_cast<pid_t>(ChildProcessIds[SlotIdx]))
+		{
+			UE_LOG(LogOServerPool, Log, TEXT("Pool child %d (process %u) exited with %d"), SlotIdx, ChildProcessIds[SlotIdx],
+				WIFEXITED(Status) ? WEXITSTATUS(Status) : -WTERMSIG(Status));
+
+			ChildProcessIds[SlotIdx] = 0;
+			SlotFreeTimes[SlotIdx] = Now;
+		}
+	}
+
+	for (int32 SlotIdx = 0; SlotIdx < ChildProcessIds.Num(); SlotIdx++)
+	{
+		if (ChildProcessIds[SlotIdx] != 0 || Now - SlotFreeTimes[SlotIdx] < MinRespawnSeconds)
+		{
+			continue;
+		}
+
+		// Buffered log lines would be written by parent and child
+		GLog->Flush();
+
+		const double ForkStartTime = FPlatformTime::Seconds();
+		const pid_t ChildProcessId = fork();
+
+		if (ChildProcessId == 0)
+		{
+			ForkTime = ForkStartTime;
+			BecomeChild(SlotIdx);
+
+			// Removes this ticker from the copy of the core ticker the child got
+			return false;
+		}
+
+		if (ChildProcessId < 0)
+		{
+			UE_LOG(LogOServerPool, Error, TEXT("Failed to fork pool child %d, errno %d"), SlotIdx, errno);
+			SlotFreeTimes[SlotIdx] = Now;
+			continue;
+		}
+
+		ChildProcessIds[SlotIdx] = ChildProcessId;
+		NumForks++;
+
+		UE_LOG(LogOServerPool, Log, TEXT("Forked pool child %d as process %d in %.3f ms (%d forks)"), SlotIdx, ChildProcessId, (FPlatformTime::Seconds() - ForkStartTime) * 1000.0, NumForks);
+	}
+#endif
+
+	return true;
+}
+
+void FOServerPool::BecomeChild(int32 SlotIdx)
+{
+#if PLATFORM_LINUX
+	// A child goes down with the parent instead of holding on to its port
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	if (getppid() != static_cast<pid_t>(ParentProcessId))
+	{
+		FPlatformMisc::RequestExit(true);
+		return;
+	}
+
+	// Every child would play the random sequence of the parent
+	FMath::RandInit(getpid());
+	FMath::SRandInit(getpid());
+#endif
+
+	ChildIndex = SlotIdx;
+	ChildProcessIds.Empty();
+	SlotFreeTimes.Empty();
+	TickHandle.Reset();
+
+	UE_LOG(LogOServerPool, Log, TEXT("Pool child %d running as process %u"), ChildIndex, FPlatformProcess::GetCurrentProcessId());
+
+	FOTelemetry::Get().OnForked();
+
+	if (OnForked)
+	{
+		OnForked(ChildIndex);
+	}
+}
+
+void FOServerPool::LogReport() const
+{
+	FOProcessMemory Memory;
+	if (!ReadProcessMemory(FPlatformProcess::GetCurrentProcessId(), Memory))
+	{
+		UE_LOG(LogOServerPool, Warning, TEXT("Process memory can't be read on this platform"));
+		return;
+	}
+
+	UE_LOG(LogOServerPool, Log, TEXT("%s: RSS %.1f MB | PSS %.1f MB | private %.1f MB"), IsChild() ? TEXT("Pool child") : TEXT("Pool parent"),
+		Memory.Rss / BytesPerMegabyte, Memory.Pss / BytesPerMegabyte, Memory.Private / BytesPerMegabyte);
+
+	FOProcessMemory Total = Memory;
+	int32 NumChildren = 0;
+
+	for (int32 SlotIdx = 0; SlotIdx < ChildProcessIds.Num(); SlotIdx++)
+	{
+		FOProcessMemory ChildMemory;
+		if (ChildProcessIds[SlotIdx] == 0 || !ReadProcessMemory(ChildProcessIds[SlotIdx], ChildMemory))
+		{
+			continue;
+		}
+
+		UE_LOG(LogOServerPool, Log, TEXT("Child %d (process %u): RSS %.1f MB | PSS %.1f MB | private %.1f MB"), SlotIdx, ChildProcessIds[SlotIdx],
+			ChildMemory.Rss / BytesPerMegabyte, ChildMemory.Pss / BytesPerMegabyte, ChildMemory.Private / BytesPerMegabyte);
+
+		Total.Rss += ChildMemory.Rss;
+		Total.Pss += ChildMemory.Pss;
+		Total.Private += ChildMemory.Private;
+		NumChildren++;
+	}
+
+	// Without sharing every child would need its whole RSS, the PSS sum is what the pool really takes
+	if (NumChildren > 0)
+	{
+		UE_LOG(LogOServerPool, Log, TEXT("%d children: RSS sum %.1f MB | PSS sum %.1f MB | %.1f MB private per child"), NumChildren,
+			Total.Rss / BytesPerMegabyte, Total.Pss / BytesPerMegabyte, (Total.Private - Memory.Private) / BytesPerMegabyte / NumChildren);
+	}
+}
+
+void FOServerPool::ReportMatchReady()
+{
+	if (bMatchReadyReported)
+	{
+		return;
+	}
+
+	bMatchReadyReported = true;
+
+	const bool bForked = ForkTime > 0.0;
+	const double ReadySeconds = FPlatformTime::Seconds() - (bForked ? ForkTime : GStartTime);
+
+	FOProcessMemory Memory;
+	ReadProcessMemory(FPlatformProcess::GetCurrentProcessId(), Memory);
+
+	UE_LOG(LogOServerPool, Log, TEXT("%s: match ready %.3f s after %s | RSS %.1f MB | PSS %.1f MB | private %.1f MB"),
+		bForked ? TEXT("Forked child") : TEXT("Cold boot"), ReadySeconds, bForked ? TEXT("fork") : TEXT("process start"),
+		Memory.Rss / BytesPerMegabyte, Memory.Pss / BytesPerMegabyte, Memory.Private / BytesPerMegabyte);
+
+	FOTelemetry::Get().Record(bForked ? EOTelemetryHistogram::ForkedMatchReadyMs : EOTelemetryHistogram::ColdMatchReadyMs, ReadySeconds * 1000.0);
+}
+
+bool FOServerPool::ReadProcessMemory(uint32 ProcessId, FOProcessMemory& OutMemory)
+{
+	OutMemory = FOProcessMemory();
+
+#if PLATFORM_LINUX
+	// Sums of all mappings of the process in kB, since Linux 4.14
+	FILE* File = fopen(TCHAR_TO_ANSI(*FString::Printf(TEXT("/proc/%u/smaps_rollup"), ProcessId)), "r");
+	if (File == nullptr)
+	{
+		return false;
+	}
+
+	char Line[256];
+	unsigned long long Kilobytes = 0;
+
+	while (fgets(Line, sizeof(Line), File) != nullptr)
+	{
+		if (sscanf(Line, "Rss: %llu kB", &Kilobytes) == 1)
+		{
+			OutMemory.Rss = Kilobytes * 1024;
+		}
+		else if (sscanf(Line, "Pss: %llu kB", &Kilobytes) == 1)
+		{
+			OutMemory.Pss = Kilobytes * 1024;
+		}
+		else if (sscanf(Line, "Private_Clean: %llu kB", &Kilobytes) == 1 || sscanf(Line, "Private_Dirty: %llu kB", &Kilobytes) == 1)
+		{
+			OutMemory.Private += Kilobytes * 1024;
+		}
+	}
+
+	fclose(File);
+
+	return OutMemory.Rss > 0;
+#else
+	return false;
+#endif
+}
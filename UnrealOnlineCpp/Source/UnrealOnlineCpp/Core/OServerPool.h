@@ -0,0 +1,91 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Resident memory of a process, as the kernel accounts it.
+struct FOProcessMemory
+{
+	// Resident bytes, pages shared with other processes counted in full
+	uint64 Rss = 0;
+
+	// Resident bytes, shared pages divided by the number of processes mapping them
+	uint64 Pss = 0;
+
+	// Resident bytes no other process maps, what one more process really costs
+	uint64 Private = 0;
+};
+
+/**
+ * Pre-warmed dedicated server pool, Linux only. The parent process boots once and loads the game map and the assets
+ * every match needs, then forks one child server process per match. A child starts with everything the parent loaded,
+ * shares the pages it doesn't write with the parent and its siblings copy-on-write, and only has to open the map on
+ * its own port and create its session. Children that exit are forked again, so the pool keeps its size.
+ *
+ * Fork only keeps the calling thread, so the pool needs -nothreading and its children run single-threaded. Online
+ * subsystem state doesn't survive a fork either: start the pool with -nosteam, every child hosts through its own Null
+ * subsystem instance.
+ *
+ * Dedicated server: -ServerPool=<Size> -GameMap=<Map> [-MaxPlayers=<Count>] [-LAN] -nothreading -nosteam.
+ * o.Pool.Grow [Count] adds children, o.Pool.Report logs the memory of the parent and every child. Every dedicated
+ * server logs the seconds from its start, or fork, until its first match is ready together with its memory, so a
+ * cold boot without the pool and a forked child compare directly.
+ */
+class UNREALONLINECPP_API FOServerPool
+{
+public:
+	~FOServerPool();
+
+	/**
+	 * Starts forking children from the next frame on. The caller loads what the children share before.
+	 *
+	 * @param Size: children kept running.
+	 * @param OnForked: called in every new child with its index, has to host the match of the child.
+	 * @returns false if this platform or process can't fork.
+	 */
+	bool Start(int32 Size, TFunction<void(int32)> OnForked);
+
+	// Terminates the children and stops forking, nothing to do in a child.
+	void Stop();
+
+	// Adds Count children to the pool.
+	void Grow(int32 Count);
+
+	FORCEINLINE bool IsRunning() const { return TickHandle.IsValid(); }
+
+	FORCEINLINE bool IsChild() const { return ChildIndex != INDEX_NONE; }
+
+	// Index of this child, from 0 up to the pool size. Unique among running children, so its port and session name are.
+	FORCEINLINE int32 GetChildIndex() const { return ChildIndex; }
+
+	// Logs the memory of this process and of every child.
+	void LogReport() const;
+
+	// Logs the seconds since process start, or fork, and the memory of this process. Only the first call per process logs.
+	static void ReportMatchReady();
+
+	// Returns false if the memory of the process can't be read, always on other platforms than Linux.
+	static bool ReadProcessMemory(uint32 ProcessId, FOProcessMemory& OutMemory);
+
+private:
+	// Reaps exited children and forks new ones into free slots.
+	bool Tick(float DeltaTime);
+
+	// Called in a new child, right after the fork.
+	void BecomeChild(int32 SlotIdx);
+
+	TFunction<void(int32)> OnForked;
+
+	FDelegateHandle TickHandle;
+
+	// Process id of the child of every slot, 0 if the slot is free
+	TArray<uint32> ChildProcessIds;
+
+	// Time every slot became free, a crashing child is forked again at most once per MinRespawnSeconds
+	TArray<double> SlotFreeTimes;
+
+	uint32 ParentProcessId = 0;
+	int32 ChildIndex = INDEX_NONE;
+	int32 NumForks = 0;
+};
@@ -0,0 +1,37 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OStats.h"
+
+namespace
+{
+	// Zero initialized before any counter constructor runs
+	FOCycleCounter* FirstCounter = nullptr;
+}
+
+bool FOCycleCounter::bRecording = false;
+
+FOCycleCounter::FOCycleCounter(const TCHAR* InName)
+	: Name(InName)
+	, Next(FirstCounter)
+{
+	FirstCounter = this;
+}
+
+FOCycleCounter* FOCycleCounter::GetFirst()
+{
+	return FirstCounter;
+}
+
+void FOCycleCounter::SetRecording(bool bInRecording)
+{
+	bRecording = bInRecording;
+}
+
+void FOCycleCounter::ResetAll()
+{
+	for (FOCycleCounter* Counter = FirstCounter; Counter != nullptr; Counter = Counter->Next)
+	{
+		Counter->TotalCycles.Reset();
+		Counter->NumCalls.Reset();
+	}
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeCounter64.h"
+#include "Stats/Stats.h"
+
+// Benchmark totals are compiled out of shipping builds unless the target defines O_BENCHMARK_COUNTERS=1
+#ifndef O_BENCHMARK_COUNTERS
+#define O_BENCHMARK_COUNTERS !UE_BUILD_SHIPPING
+#endif
+
+// Everything this module times shows up under "stat UnrealOnlineCpp".
+DECLARE_STATS_GROUP(TEXT("UnrealOnlineCpp"), STATGROUP_UnrealOnlineCpp, STATCAT_Advanced);
+
+/**
+ * Total cycles and calls of one cycle stat while a benchmark records. The stats system only keeps per-frame values,
+ * the benchmark needs totals over a run that it can write to a file, also in builds without stats.
+ * Counters register themselves during static initialization and are never destroyed before exit.
+ */
+struct UNREALONLINECPP_API FOCycleCounter
+{
+public:
+	explicit FOCycleCounter(const TCHAR* InName);
+
+	void Add(uint64 Cycles)
+	{
+		TotalCycles.Add(static_cast<int64>(Cycles));
+		NumCalls.Increment();
+	}
+
+	const TCHAR* GetName() const { return Name; }
+
+	int64 GetTotalCycles() const { return TotalCycles.GetValue(); }
+
+	int64 GetNumCalls() const { return NumCalls.GetValue(); }
+
+	// Returns the first registered counter, the others follow through GetNext.
+	static FOCycleCounter* GetFirst();
+
+	FOCycleCounter* GetNext() const { return Next; }
+
+	// Starts or stops accumulating, counters only cost a flag check while this is off.
+	static void SetRecording(bool bInRecording);
+
+	static bool IsRecording() { return bRecording; }
+
+	// Zeroes every counter.
+	static void ResetAll();
+
+private:
+	const TCHAR* Name;
+	FThreadSafeCounter64 TotalCycles;
+	FThreadSafeCounter64 NumCalls;
+	FOCycleCounter* Next;
+
+	static bool bRecording;
+};
+
+// Adds the cycles of its scope to a counter, if a benchmark records.
+struct FOScopeCycleCounter
+{
+public:
+	explicit FOScopeCycleCounter(FOCycleCounter& InCounter)
+		: Counter(FOCycleCounter::IsRecording() ? &InCounter : nullptr)
+		, StartCycles(Counter ? FPlatformTime::Cycles64() : 0)
+	{
+	}
+
+	~FOScopeCycleCounter()
+	{
+		if (Counter != nullptr)
+		{
+			Counter->Add(FPlatformTime::Cycles64() - StartCycles);
+		}
+	}
+
+private:
+	FOCycleCounter* Counter;
+	uint64 StartCycles;
+};
+
+#if O_BENCHMARK_COUNTERS
+
+// Declares a cycle stat in STATGROUP_UnrealOnlineCpp, CounterName is a string literal.
+#define O_DECLARE_CYCLE_STAT(CounterName, StatId) \
+	DECLARE_CYCLE_STAT(TEXT(CounterName), StatId, STATGROUP_UnrealOnlineCpp); \
+	static FOCycleCounter StatId##_OCounter(TEXT(CounterName))
+
+// Times the rest of the scope for the stats system and the benchmark totals.
+#define O_SCOPE_CYCLE_COUNTER(StatId) \
+	SCOPE_CYCLE_COUNTER(StatId); \
+	FOScopeCycleCounter StatId##_OScope(StatId##_OCounter)
+
+#else
+
+#define O_DECLARE_CYCLE_STAT(CounterName, StatId) DECLARE_CYCLE_STAT(TEXT(CounterName), StatId, STATGROUP_UnrealOnlineCpp)
+
+#define O_SCOPE_CYCLE_COUNTER(StatId) SCOPE_CYCLE_COUNTER(StatId)
+
+#endif
@@ -0,0 +1,429 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OTelemetry.h"
+#include "Containers/Ticker.h"
+#include "Engine/Engine.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformAtomics.h"
+#include "IPAddress.h"
+#include "Misc/App.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/DateTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogOTelemetry, Log, All);
+
+static TAutoConsoleVariable<int32> CVarTelemetryEnabled(
+	TEXT("o.Telemetry.Enabled"),
+	1,
+	TEXT("Records session, connection and server frame telemetry. Read when the game instance starts."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarTelemetryFlushInterval(
+	TEXT("o.Telemetry.FlushInterval"),
+	30.0f,
+	TEXT("Seconds between two telemetry flushes."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<FString> CVarTelemetryEndpoint(
+	TEXT("o.Telemetry.Endpoint"),
+	TEXT(""),
+	TEXT("<ip>:<port> the flushed rows are also sent to over UDP, empty to only write the file."),
+	ECVF_Default);
+
+static FAutoConsoleCommand TelemetryFlushCommand(
+	TEXT("o.Telemetry.Flush"),
+	TEXT("Writes the telemetry recorded since the last flush."),
+	FConsoleCommandDelegate::CreateLambda([]() { FOTelemetry::Get().Flush(); }));
+
+namespace
+{
+	const TCHAR* HistogramNames[] =
+	{
+		TEXT("SessionCreateToStartMs"),
+		TEXT("SessionFindMs"),
+		TEXT("SessionJoinToTravelMs"),
+		TEXT("SessionDestroyMs"),
+		TEXT("SessionJoinToFirstFrameMs"),
+		TEXT("SessionJoinToFirstFramePreloadedMs"),
+		TEXT("ConnectionRttMs"),
+		TEXT("ConnectionPacketLossPermille"),
+		TEXT("ConnectionInBytesPerSecond"),
+		TEXT("ConnectionOutBytesPerSecond"),
+		TEXT("ServerFrameMs"),
+		TEXT("FriendsReadMs"),
+		TEXT("FriendInviteUs"),
+		TEXT("PlacementMs"),
+		TEXT("ColdMatchReadyMs"),
+		TEXT("ForkedMatchReadyMs")
+	};
+
+	const TCHAR* CounterNames[] =
+	{
+		TEXT("SessionsCreated"),
+		TEXT("SessionCreateFailures"),
+		TEXT("SessionSearches"),
+		TEXT("SessionSearchFailures"),
+		TEXT("SessionsJoined"),
+		TEXT("SessionJoinFailures"),
+		TEXT("SessionsDestroyed"),
+		TEXT("FriendInvitesSent"),
+		TEXT("SessionLoadUpdates"),
+		TEXT("IncompatibleJoinsRejected")
+	};
+
+	static_assert(ARRAY_COUNT(HistogramNames) == static_cast<int32>(EOTelemetryHistogram::Count), "Every histogram needs a name");
+	static_assert(ARRAY_COUNT(CounterNames) == static_cast<int32>(EOTelemetryCounter::Count), "Every counter needs a name");
+
+	// Returns the largest value of a bucket
+	int64 GetBucketUpperBound(int32 BucketIdx)
+	{
+		return (BucketIdx == 0) ? 0 : (int64(1) << BucketIdx) - 1;
+	}
+}
+
+FOTelemetry& FOTelemetry::Get()
+{
+	static FOTelemetry Telemetry;
+	return Telemetry;
+}
+
+FOTelemetry::FOTelemetry()
+	: EndpointSocket(nullptr)
+	, LastFlushTime(0.0)
+	, LastSampleTime(0.0)
+	, bHasServerWorld(false)
+{
+}
+
+void FOTelemetry::Start()
+{
+	if (TickHandle.IsValid() || CVarTelemetryEnabled.GetValueOnGameThread() == 0)
+	{
+		return;
+	}
+
+	OpenFile();
+
+	LastFlushTime = FPlatformTime::Seconds();
+	LastSampleTime = LastFlushTime;
+
+	TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FOTelemetry::Tick));
+
+	// Whatever is left when the process exits still gets written
+	FCoreDelegates::OnPreExit.AddRaw(this, &FOTelemetry::Stop);
+}
+
+void FOTelemetry::Stop()
+{
+	if (!TickHandle.IsValid())
+	{
+		return;
+	}
+
+	FTicker::GetCoreTicker().RemoveTicker(TickHandle);
+	TickHandle.Reset();
+
+	FCoreDelegates::OnPreExit.RemoveAll(this);
+
+	Flush();
+	CloseEndpointSocket();
+}
+
+void FOTelemetry::OnForked()
+{
+	for (FHistogram& Histogram : Histograms)
+	{
+		for (FThreadSafeCounter64& Bucket : Histogram.Buckets)
+		{
+			Bucket.Reset();
+		}
+
+		Histogram.Count.Reset();
+		Histogram.Sum.Reset();
+		Histogram.Max = 0;
+	}
+
+	for (FThreadSafeCounter64& Counter : Counters)
+	{
+		Counter.Reset();
+	}
+
+	// Steps the parent started complete in the parent
+	for (TMap<TPair<const void*, FName>, double>& StartTimes : TimerStartTimes)
+	{
+		StartTimes.Reset();
+	}
+
+	// The socket is a copy of the parent's, the child opens its own on the next flush
+	CloseEndpointSocket();
+
+	if (TickHandle.IsValid())
+	{
+		OpenFile();
+		LastFlushTime = FPlatformTime::Seconds();
+	}
+}
+
+void FOTelemetry::OpenFile()
+{
+	FilePath = FPaths::ProjectSavedDir() / TEXT("Telemetry") / FString::Printf(TEXT("Telemetry-%s-%u.csv"), *FDateTime::Now().ToString(), FPlatformProcess::GetCurrentProcessId());
+	FFileHelper::SaveStringToFile(TEXT("Time,Metric,Count,Mean,P50,P95,Max\n"), *FilePath);
+}
+
+void FOTelemetry::Record(EOTelemetryHistogram Histogram, double Value)
+{
+	FHistogram& Target = Histograms[static_cast<int32>(Histogram)];
+	const int64 IntValue = FMath::Max<int64>(FMath::RoundToInt(Value), 0);
+
+	const int32 BucketIdx = (IntValue == 0) ? 0 : FMath::Min<int32>(FPlatformMath::FloorLog2_64(static_cast<uint64>(IntValue)) + 1, NumBuckets - 1);
+	Target.Buckets[BucketIdx].Increment();
+	Target.Count.Increment();
+	Target.Sum.Add(IntValue);
+
+	int64 CurrentMax = Target.Max;
+	while (IntValue > CurrentMax)
+	{
+		const int64 PreviousMax = FPlatformAtomics::InterlockedCompareExchange(&Target.Max, IntValue, CurrentMax);
+		if (PreviousMax == CurrentMax)
+		{
+			break;
+		}
+
+		CurrentMax = PreviousMax;
+	}
+}
+
+void FOTelemetry::Increment(EOTelemetryCounter Counter)
+{
+	Counters[static_cast<int32>(Counter)].Increment();
+}
+
+void FOTelemetry::BeginTimer(EOTelemetryTimer Timer, const void* Owner, FName SessionName)
+{
+	TimerStartTimes[static_cast<int32>(Timer)].Add(MakeTuple(Owner, SessionName), FPlatformTime::Seconds());
+}
+
+bool FOTelemetry::EndTimer(EOTelemetryTimer Timer, const void* Owner, FName SessionName, EOTelemetryHistogram Histogram)
+{
+	double StartTime = 0.0;
+	if (!TimerStartTimes[static_cast<int32>(Timer)].RemoveAndCopyValue(MakeTuple(Owner, SessionName), StartTime))
+	{
+		return false;
+	}
+
+	Record(Histogram, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+	return true;
+}
+
+void FOTelemetry::DiscardTimer(EOTelemetryTimer Timer, const void* Owner, FName SessionName)
+{
+	TimerStartTimes[static_cast<int32>(Timer)].Remove(MakeTuple(Owner, SessionName));
+}
+
+bool FOTelemetry::Tick(float DeltaTime)
+{
+	const double CurrentTime = FPlatformTime::Seconds();
+
+	// Time spent working this frame, without the wait for the server tick rate
+	if (bHasServerWorld)
+	{
+		Record(EOTelemetryHistogram::ServerFrameMs, FMath::Max(FApp::GetDeltaTime() - FApp::GetIdleTime(), 0.0) * 1000.0);
+	}
+
+	if (CurrentTime - LastSampleTime >= 1.0)
+	{
+		LastSampleTime = CurrentTime;
+		SampleConnections();
+	}
+
+	if (CurrentTime - LastFlushTime >= CVarTelemetryFlushInterval.GetValueOnGameThread())
+	{
+		Flush();
+	}
+
+	return true;
+}
+
+void FOTelemetry::SampleConnections()
+{
+	bHasServerWorld = false;
+
+	if (GEngine == nullptr)
+	{
+		return;
+	}
+
+	for (const FWorldContext& WorldContext : GEngine->GetWorldContexts())
+	{
+		UWorld* World = WorldContext.World();
+		UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+		if (NetDriver == nullptr)
+		{
+			continue;
+		}
+
+		bHasServerWorld |= NetDriver->IsServer();
+
+		auto SampleConnection = [this](const UNetConnection* Connection)
+		{
+			const int32 NumPackets = Connection->InPacketsPerSecond + Connection->OutPacketsPerSecond;
+			const int32 NumPacketsLost = Connection->InPacketsLost + Connection->OutPacketsLost;
+
+			Record(EOTelemetryHistogram::ConnectionRttMs, Connection->AvgLag * 1000.0f);
+			Record(EOTelemetryHistogram::ConnectionPacketLossPermille, (NumPackets > 0) ? NumPacketsLost * 1000.0 / NumPackets : 0.0);
+			Record(EOTelemetryHistogram::ConnectionInBytesPerSecond, Connection->InBytesPerSecond);
+			Record(EOTelemetryHistogram::ConnectionOutBytesPerSecond, Connection->OutBytesPerSecond);
+		};
+
+		if (NetDriver->ServerConnection != nullptr)
+		{
+			SampleConnection(NetDriver->ServerConnection);
+		}
+
+		for (const UNetConnection* Connection : NetDriver->ClientConnections)
+		{
+			SampleConnection(Connection);
+		}
+	}
+}
+
+void FOTelemetry::Flush()
+{
+	LastFlushTime = FPlatformTime::Seconds();
+
+	const FString Time = FDateTime::UtcNow().ToIso8601();
+	FString Rows;
+
+	for (int32 HistogramIdx = 0; HistogramIdx < static_cast<int32>(EOTelemetryHistogram::Count); HistogramIdx++)
+	{
+		FHistogram& Histogram = Histograms[HistogramIdx];
+
+		// Swap the values out, anything recorded meanwhile goes into the next flush
+		int64 BucketCounts[NumBuckets];
+		for (int32 BucketIdx = 0; BucketIdx < NumBuckets; BucketIdx++)
+		{
+			BucketCounts[BucketIdx] = Histogram.Buckets[BucketIdx].Set(0);
+		}
+
+		const int64 Count = Histogram.Count.Set(0);
+		const int64 Sum = Histogram.Sum.Set(0);
+		const int64 Max = FPlatformAtomics::InterlockedExchange(&Histogram.Max, 0);
+
+		if (Count == 0)
+		{
+			continue;
+		}
+
+		int64 P50 = 0;
+		int64 P95 = 0;
+		int64 NumBelow = 0;
+		for (int32 BucketIdx = 0; BucketIdx < NumBuckets; BucketIdx++)
+		{
+			NumBelow += BucketCounts[BucketIdx];
+			if (P50 == 0 && NumBelow * 2 >= Count)
+			{
+				P50 = FMath::Min(GetBucketUpperBound(BucketIdx), Max);
+			}
+			if (NumBelow * 20 >= Count * 19)
+			{
+				P95 = FMath::Min(GetBucketUpperBound(BucketIdx), Max);
+				break;
+			}
+		}
+
+		Rows += FString::Printf(TEXT("%s,%s,%lld,%.1f,%lld,%lld,%lld\n"), *Time, HistogramNames[HistogramIdx], Count, static_cast<double>(Sum) / Count, P50, P95, Max);
+	}
+
+	for (int32 CounterIdx = 0; CounterIdx < static_cast<int32>(EOTelemetryCounter::Count); CounterIdx++)
+	{
+		const int64 Count = Counters[CounterIdx].Set(0);
+		if (Count > 0)
+		{
+			Rows += FString::Printf(TEXT("%s,%s,%lld,,,,\n"), *Time, CounterNames[CounterIdx], Count);
+		}
+	}
+
+	if (Rows.IsEmpty())
+	{
+		return;
+	}
+
+	if (!FilePath.IsEmpty())
+	{
+		FFileHelper::SaveStringToFile(Rows, *FilePath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+	}
+
+	SendToEndpoint(Rows);
+}
+
+void FOTelemetry::SendToEndpoint(const FString& Rows)
+{
+	const FString Endpoint = CVarTelemetryEndpoint.GetValueOnGameThread();
+	if (Endpoint != OpenEndpoint)
+	{
+		CloseEndpointSocket();
+		OpenEndpointSocket(Endpoint);
+	}
+
+	if (EndpointSocket == nullptr)
+	{
+		return;
+	}
+
+	const FTCHARToUTF8 Utf8Rows(*Rows);
+	int32 BytesSent = 0;
+	EndpointSocket->SendTo(reinterpret_cast<const uint8*>(Utf8Rows.Get()), Utf8Rows.Length(), BytesSent, *EndpointAddress);
+}
+
+void FOTelemetry::OpenEndpointSocket(const FString& Endpoint)
+{
+	// Remembered even if it can't be opened, an invalid endpoint is reported once and not on every flush
+	OpenEndpoint = Endpoint;
+
+	FString Host;
+	FString Port;
+	if (Endpoint.IsEmpty() || !Endpoint.Split(TEXT(":"), &Host, &Port))
+	{
+		return;
+	}
+
+	ISocketSubsystem* SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
+	if (SocketSubsystem == nullptr)
+	{
+		return;
+	}
+
+	bool bIsValid = false;
+	TSharedRef<FInternetAddr> Address = SocketSubsystem->CreateInternetAddr();
+	Address->SetIp(*Host, bIsValid);
+	Address->SetPort(FCString::Atoi(*Port));
+	if (!bIsValid)
+	{
+		UE_LOG(LogOTelemetry, Warning, TEXT("Invalid telemetry endpoint %s"), *Endpoint);
+		return;
+	}
+
+	EndpointSocket = SocketSubsystem->CreateSocket(NAME_DGram, TEXT("Telemetry"), false);
+	EndpointAddress = Address;
+}
+
+void FOTelemetry::CloseEndpointSocket()
+{
+	if (EndpointSocket != nullptr)
+	{
+		EndpointSocket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(EndpointSocket);
+		EndpointSocket = nullptr;
+	}
+
+	EndpointAddress.Reset();
+	OpenEndpoint.Empty();
+}
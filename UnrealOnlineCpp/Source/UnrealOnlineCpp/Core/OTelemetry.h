@@ -0,0 +1,147 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeCounter64.h"
+
+// Values recorded into histograms, in the unit of their name.
+enum class EOTelemetryHistogram : uint8
+{
+	SessionCreateToStartMs,
+	SessionFindMs,
+	SessionJoinToTravelMs,
+	SessionDestroyMs,
+	SessionJoinToFirstFrameMs,
+	SessionJoinToFirstFramePreloadedMs,
+	ConnectionRttMs,
+	ConnectionPacketLossPermille,
+	ConnectionInBytesPerSecond,
+	ConnectionOutBytesPerSecond,
+	ServerFrameMs,
+	FriendsReadMs,
+	FriendInviteUs,
+	PlacementMs,
+	ColdMatchReadyMs,
+	ForkedMatchReadyMs,
+	Count
+};
+
+// Events that are only counted.
+enum class EOTelemetryCounter : uint8
+{
+	SessionsCreated,
+	SessionCreateFailures,
+	SessionSearches,
+	SessionSearchFailures,
+	SessionsJoined,
+	SessionJoinFailures,
+	SessionsDestroyed,
+	FriendInvitesSent,
+	SessionLoadUpdates,
+	IncompatibleJoinsRejected,
+	Count
+};
+
+// Session lifecycle steps that are timed from their start call to their completion.
+enum class EOTelemetryTimer : uint8
+{
+	SessionCreate,
+	SessionJoin,
+	SessionDestroy,
+	Count
+};
+
+/**
+ * Process wide telemetry. Recording is a few atomic adds into fixed counters and power of two histograms, so it stays
+ * on in shipping builds. Every o.Telemetry.FlushInterval seconds the game thread swaps the values out and appends one
+ * CSV row per metric to Saved/Telemetry, and sends the same rows to o.Telemetry.Endpoint if one is set.
+ * Connection and server frame statistics are sampled from the net drivers once per second.
+ */
+class UNREALONLINECPP_API FOTelemetry
+{
+public:
+	static FOTelemetry& Get();
+
+	// Starts sampling and flushing, does nothing if o.Telemetry.Enabled is 0 or it already runs.
+	void Start();
+
+	// Flushes what was recorded and stops.
+	void Stop();
+
+	// Records a value into a histogram, callable from any thread.
+	void Record(EOTelemetryHistogram Histogram, double Value);
+
+	// Counts an event, callable from any thread.
+	void Increment(EOTelemetryCounter Counter);
+
+	/**
+	 * Remembers the start of a lifecycle step of a session.
+	 *
+	 * @param Owner: object running the step, several game instances of a process can use the same session name.
+	 */
+	void BeginTimer(EOTelemetryTimer Timer, const void* Owner, FName SessionName);
+
+	/**
+	 * Records the milliseconds since the matching BeginTimer into a histogram.
+	 *
+	 * @returns false if the step was never started.
+	 */
+	bool EndTimer(EOTelemetryTimer Timer, const void* Owner, FName SessionName, EOTelemetryHistogram Histogram);
+
+	// Forgets a lifecycle step that failed, failures are counted instead of timed.
+	void DiscardTimer(EOTelemetryTimer Timer, const void* Owner, FName SessionName);
+
+	// Writes everything recorded since the last flush.
+	void Flush();
+
+	// Drops the values a forked child copied from its parent, they are the parent's to flush, and moves to a file of the child's own.
+	void OnForked();
+
+private:
+	// Values are bucketed by their highest set bit, bucket 0 holds zeros.
+	static const int32 NumBuckets = 33;
+
+	struct FHistogram
+	{
+		FThreadSafeCounter64 Buckets[NumBuckets];
+		FThreadSafeCounter64 Count;
+		FThreadSafeCounter64 Sum;
+		volatile int64 Max = 0;
+	};
+
+	FOTelemetry();
+
+	bool Tick(float DeltaTime);
+
+	// Starts a new CSV file named after the current process.
+	void OpenFile();
+
+	// Reads RTT, packet loss and bandwidth of every connection of every world.
+	void SampleConnections();
+
+	void SendToEndpoint(const FString& Rows);
+
+	// Opens the socket rows are sent to o.Telemetry.Endpoint with, leaves it closed if the endpoint is empty or invalid.
+	void OpenEndpointSocket(const FString& Endpoint);
+
+	void CloseEndpointSocket();
+
+	FHistogram Histograms[static_cast<int32>(EOTelemetryHistogram::Count)];
+	FThreadSafeCounter64 Counters[static_cast<int32>(EOTelemetryCounter::Count)];
+
+	// Start times of running lifecycle steps, game thread only
+	TMap<TPair<const void*, FName>, double> TimerStartTimes[static_cast<int32>(EOTelemetryTimer::Count)];
+
+	FString FilePath;
+
+	// Endpoint the socket was opened for, it stays open until the endpoint changes or telemetry stops
+	FString OpenEndpoint;
+	class FSocket* EndpointSocket;
+	TSharedPtr<class FInternetAddr> EndpointAddress;
+
+	FDelegateHandle TickHandle;
+	double LastFlushTime;
+	double LastSampleTime;
+	bool bHasServerWorld;
+};
@@ -0,0 +1,263 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OCharacterSignificance.h"
+#include "OPlayerCharacter.h"
+#include "../Core/OStats.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/CapsuleComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogSignificance, Log, All);
+
+O_DECLARE_CYCLE_STAT("Significance Update", STAT_OSignificanceUpdate);
+
+static TAutoConsoleVariable<int32> CVarSignificanceEnabled(
+	TEXT("o.Significance.Enabled"),
+	1,
+	TEXT("0: every character ticks and animates at full rate\n")
+	TEXT("1: characters far away or out of view tick and animate less often (default)"),
+	ECVF_Default);
+
+static void SignificanceReport(const TArray<FString>& Args, UWorld* World)
+{
+	const AOCharacterSignificance* Significance = AOCharacterSignificance::Get(World, false);
+	if (Significance != nullptr)
+	{
+		Significance->LogStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs SignificanceReportCommand(
+	TEXT("o.Significance.Report"),
+	TEXT("Logs how many characters run at full, reduced and minimal rate."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&SignificanceReport));
+
+AOCharacterSignificance::AOCharacterSignificance()
+{
+	PrimaryActorTick.bCanEverTick = true;
+
+	// Every machine rates the characters its own player sees
+	bReplicates = false;
+
+	MaxFullCharacters = 8;
+	MaxReducedCharacters = 16;
+	MinFullScreenSize = 0.05f;
+	MinReducedScreenSize = 0.01f;
+	OutOfViewScoreScale = 0.25f;
+	MaxSignificanceDistance = 10000.0f;
+	ReducedTickInterval = 1.0f / 30.0f;
+	MinimalTickInterval = 0.2f;
+	UpdateInterval = 0.25f;
+
+	FMemory::Memzero(NumPerSignificance);
+}
+
+AOCharacterSignificance* AOCharacterSignificance::Get(UWorld* World, bool bCreateIfMissing)
+{
+	if (World == nullptr || World->GetNetMode() == NM_DedicatedServer)
+	{
+		return nullptr;
+	}
+
+	for (TActorIterator<AOCharacterSignificance> It(World); It; ++It)
+	{
+		if (!It->IsPendingKill())
+		{
+			return *It;
+		}
+	}
+
+	if (!bCreateIfMissing || World->bIsTearingDown)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	return World->SpawnActor<AOCharacterSignificance>(SpawnParams);
+}
+
+bool AOCharacterSignificance::IsEnabled()
+{
+	return CVarSignificanceEnabled.GetValueOnGameThread() != 0;
+}
+
+void AOCharacterSignificance::RegisterCharacter(AOPlayerCharacter* Character)
+{
+	if (Character == nullptr || Characters.ContainsByPredicate([Character](const FOSignificantCharacter& Entry) { return Entry.Character == Character; }))
+	{
+		return;
+	}
+
+	FOSignificantCharacter& Entry = Characters.AddDefaulted_GetRef();
+	Entry.Character = Character;
+}
+
+void AOCharacterSignificance::UnregisterCharacter(AOPlayerCharacter* Character)
+{
+	Characters.RemoveAllSwap([Character](const FOSignificantCharacter& Entry) { return Entry.Character == Character; });
+}
+
+void AOCharacterSignificance::LogStats() const
+{
+	UE_LOG(LogSignificance, Log, TEXT("Character significance: Full %d | Reduced %d | Minimal %d | Enabled %d"),
+		NumPerSignificance[0], NumPerSignificance[1], NumPerSignificance[2], IsEnabled() ? 1 : 0);
+}
+
+void AOCharacterSignificance::BeginPlay()
+{
+	Super::BeginPlay();
+
+	SetActorTickInterval(UpdateInterval);
+}
+
+void AOCharacterSignificance::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	UpdateSignificance();
+}
+
+bool AOCharacterSignificance::GetViewPoint(FVector& OutLocation, FRotator& OutRotation, float& OutFOV) const
+{
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if (PlayerController == nullptr || !PlayerController->IsLocalController() || PlayerController->PlayerCameraManager == nullptr)
+	{
+		return false;
+	}
+
+	PlayerController->GetPlayerViewPoint(OutLocation, OutRotation);
+	OutFOV = PlayerController->PlayerCameraManager->GetFOVAngle();
+
+	return true;
+}
+
+void AOCharacterSignificance::UpdateSignificance()
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OSignificanceUpdate);
+
+	Characters.RemoveAllSwap([](const FOSignificantCharacter& Entry)
+	{
+		return Entry.Character == nullptr || Entry.Character->IsPendingKill();
+	});
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	float FOV = 90.0f;
+	const bool bRateCharacters = IsEnabled() && GetViewPoint(ViewLocation, ViewRotation, FOV);
+
+	const FVector ViewDirection = ViewRotation.Vector();
+	const float HalfFOVRadians = FMath::DegreesToRadians(FMath::Clamp(FOV, 1.0f, 170.0f) * 0.5f);
+	const float TanHalfFOV = FMath::Tan(HalfFOVRadians);
+
+	for (FOSignificantCharacter& Entry : Characters)
+	{
+		const AOPlayerCharacter* Character = Entry.Character;
+		Entry.bIsViewer = Character->IsLocallyControlled() && Character->IsPlayerControlled();
+
+		if (Entry.bIsViewer || !bRateCharacters)
+		{
+			Entry.Score = MAX_flt;
+			Entry.bInView = true;
+			continue;
+		}
+
+		const FVector ToCharacter = Character->GetActorLocation() - ViewLocation;
+		const float Distance = ToCharacter.Size();
+		const float Radius = Character->GetCapsuleComponent()->GetScaledCapsuleHalfHeight();
+
+		// A cone around the view direction stands in for the frustum, widened by the angle the capsule covers
+		const float CapsuleAngle = FMath::Atan2(Radius, FMath::Max(Distance, 1.0f));
+		const float ViewAngle = FMath::Acos(FMath::Clamp(ToCharacter.GetSafeNormal() | ViewDirection, -1.0f, 1.0f));
+		Entry.bInView = Distance <= Radius || ViewAngle <= HalfFOVRadians + CapsuleAngle;
+
+		const float ScreenSize = Radius / FMath::Max(Distance * TanHalfFOV, 1.0f);
+		Entry.Score = (Distance > MaxSignificanceDistance) ? 0.0f : ScreenSize * (Entry.bInView ? 1.0f : OutOfViewScoreScale);
+	}
+
+	Characters.Sort([](const FOSignificantCharacter& A, const FOSignificantCharacter& B)
+	{
+		return A.Score > B.Score;
+	});
+
+	FMemory::Memzero(NumPerSignificance);
+
+	int32 NumFull = 0;
+	int32 NumReduced = 0;
+
+	for (FOSignificantCharacter& Entry : Characters)
+	{
+		EOCharacterSignificance NewSignificance = EOCharacterSignificance::Minimal;
+
+		if (Entry.bIsViewer || !bRateCharacters)
+		{
+			NewSignificance = EOCharacterSignificance::Full;
+		}
+		else if (Entry.bInView && Entry.Score >= MinFullScreenSize && NumFull < MaxFullCharacters)
+		{
+			NewSignificance = EOCharacterSignificance::Full;
+			NumFull++;
+		}
+		else if (Entry.Score >= MinReducedScreenSize && NumReduced < MaxReducedCharacters)
+		{
+			NewSignificance = EOCharacterSignificance::Reduced;
+			NumReduced++;
+		}
+
+		ApplySignificance(Entry, NewSignificance);
+		NumPerSignificance[static_cast<int32>(NewSignificance)]++;
+	}
+}
+
+void AOCharacterSignificance::ApplySignificance(FOSignificantCharacter& Entry, EOCharacterSignificance NewSignificance)
+{
+	AOPlayerCharacter* Character = Entry.Character;
+
+	// Arms and gun are only ever seen through the first person view of the player controlling the character
+	USkeletalMeshComponent* FirstPersonMeshes[] = { Character->GetMesh1P(), Character->GetFP_Gun() };
+	for (USkeletalMeshComponent* FirstPersonMesh : FirstPersonMeshes)
+	{
+		if (FirstPersonMesh != nullptr && FirstPersonMesh->IsComponentTickEnabled() != Entry.bIsViewer)
+		{
+			FirstPersonMesh->SetComponentTickEnabled(Entry.bIsViewer);
+		}
+	}
+
+	if (Entry.bApplied && Entry.Significance == NewSignificance)
+	{
+		return;
+	}
+
+	Entry.Significance = NewSignificance;
+	Entry.bApplied = true;
+
+	const float TickInterval = (NewSignificance == EOCharacterSignificance::Full) ? 0.0f
+		: (NewSignificance == EOCharacterSignificance::Reduced) ? ReducedTickInterval : MinimalTickInterval;
+
+	Character->SetActorTickInterval(TickInterval);
+
+	USkeletalMeshComponent* Mesh = Character->GetMesh();
+	if (Mesh != nullptr)
+	{
+		// Update rate optimizations interpolate the animation frames the longer interval skips
+		Mesh->SetComponentTickInterval(TickInterval);
+		Mesh->bEnableUpdateRateOptimizations = NewSignificance != EOCharacterSignificance::Full;
+	}
+
+	// Only replicated movement is simulated locally, authoritative movement stays exact
+	UCharacterMovementComponent* Movement = Character->GetCharacterMovement();
+	if (Movement != nullptr && Character->Role == ROLE_SimulatedProxy)
+	{
+		const UCharacterMovementComponent* DefaultMovement = CastChecked<UCharacterMovementComponent>(Movement->GetArchetype());
+
+		Movement->SetComponentTickInterval(TickInterval);
+		Movement->NetworkSmoothingMode = (NewSignificance == EOCharacterSignificance::Minimal) ? ENetworkSmoothingMode::Disabled : DefaultMovement->NetworkSmoothingMode;
+	}
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "OCharacterSignificance.generated.h"
+
+class AOPlayerCharacter;
+
+UENUM()
+enum class EOCharacterSignificance : uint8
+{
+	// Ticks, animates and smooths movement every frame
+	Full,
+	// Ticks and animates at ReducedTickInterval, skipped animation frames are interpolated
+	Reduced,
+	// Ticks and animates at MinimalTickInterval, remote movement is not smoothed
+	Minimal
+};
+
+USTRUCT()
+struct FOSignificantCharacter
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	AOPlayerCharacter* Character = nullptr;
+
+	EOCharacterSignificance Significance = EOCharacterSignificance::Full;
+
+	// Screen size, scaled down if the character is outside the view.
+	float Score = 0.0f;
+
+	bool bInView = true;
+
+	// The character belongs to the local player, it always runs at full rate.
+	bool bIsViewer = false;
+
+	// The significance settings were applied at least once.
+	bool bApplied = false;
+};
+
+/**
+ * Per-world significance of the characters a local player sees. Every UpdateInterval it scores each character by its
+ * screen size, from distance and capsule size, and whether it is inside the view cone, then hands out the significance
+ * levels by score: the MaxFullCharacters best characters in view run at full rate, the next MaxReducedCharacters at a
+ * reduced rate, everything else at a minimal rate. First person meshes only tick for the local player's character.
+ * Not spawned on dedicated servers, which have nobody looking.
+ */
+UCLASS(config = Game, notplaceable)
+class UNREALONLINECPP_API AOCharacterSignificance : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AOCharacterSignificance();
+
+	/**
+	 * Returns the character significance of a world.
+	 *
+	 * @param World: world the significance lives in.
+	 * @param bCreateIfMissing: spawn one if the world does not have one yet.
+	 * @returns nullptr on dedicated servers.
+	 */
+	static AOCharacterSignificance* Get(UWorld* World, bool bCreateIfMissing = true);
+
+	// Returns true if low significance characters are throttled, see o.Significance.Enabled.
+	static bool IsEnabled();
+
+	void RegisterCharacter(AOPlayerCharacter* Character);
+
+	void UnregisterCharacter(AOPlayerCharacter* Character);
+
+	// Logs how many characters are at each significance level.
+	void LogStats() const;
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void Tick(float DeltaSeconds) override;
+
+private:
+	void UpdateSignificance();
+
+	// View of the local player, false if there is none.
+	bool GetViewPoint(FVector& OutLocation, FRotator& OutRotation, float& OutFOV) const;
+
+	void ApplySignificance(FOSignificantCharacter& Entry, EOCharacterSignificance NewSignificance);
+
+public:
+	// Characters in view that may run at full rate, besides the local player's own.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	int32 MaxFullCharacters;
+
+	// Characters that may run at reduced rate, all others run at minimal rate.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	int32 MaxReducedCharacters;
+
+	// Smallest screen size, as a fraction of half the view width, of a full rate character.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	float MinFullScreenSize;
+
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	float MinReducedScreenSize;
+
+	// Score factor of characters outside the view cone.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	float OutOfViewScoreScale;
+
+	// Characters further away than this are always at minimal rate.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	float MaxSignificanceDistance;
+
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	float ReducedTickInterval;
+
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	float MinimalTickInterval;
+
+	// Seconds between two significance updates.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Significance")
+	float UpdateInterval;
+
+private:
+	UPROPERTY(Transient)
+	TArray<FOSignificantCharacter> Characters;
+
+	// Characters at each significance level after the last update
+	int32 NumPerSignificance[3];
+};
@@ -0,0 +1,254 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OLagCompensationComponent.h"
+#include "../Core/OStats.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLagCompensation, Log, All);
+
+O_DECLARE_CYCLE_STAT("Lag Compensation Record", STAT_OLagCompensationRecord);
+O_DECLARE_CYCLE_STAT("Lag Compensation Rewind", STAT_OLagCompensationRewind);
+
+static void LagCompensationBenchmark(const TArray<FString>& Args)
+{
+	// Default is one second of shots from 64 players firing 10 shots per second
+	const int32 NumCharacters = 64;
+	const int32 NumShots = (Args.Num() > 0) ? FCString::Atoi(*Args[0]) : NumCharacters * 10;
+
+	UOLagCompensationComponent* History = NewObject<UOLagCompensationComponent>();
+
+	// A capsule walking along X at 600 units per second, recorded at 60 ticks per second
+	const float TickInterval = 1.0f / 60.0f;
+	for (int32 Index = 0; Index < UOLagCompensationComponent::MaxSnapshots; ++Index)
+	{
+		const float Time = Index * TickInterval;
+		History->RecordSnapshot({ Time, FVector(600.0f * Time, 0.0f, 96.0f), FQuat::Identity, 55.0f, 96.0f });
+	}
+
+	FRandomStream RandomStream(1234);
+	const float HistoryLength = (UOLagCompensationComponent::MaxSnapshots - 1) * TickInterval;
+
+	int32 NumHits = 0;
+	const double StartTime = FPlatformTime::Seconds();
+
+	for (int32 Index = 0; Index < NumShots; ++Index)
+	{
+		const float Time = RandomStream.FRandRange(0.0f, HistoryLength);
+		const FVector Start(RandomStream.FRandRange(0.0f, 600.0f), -2000.0f, 96.0f);
+		const FVector End(Start.X, 2000.0f, RandomStream.FRandRange(0.0f, 200.0f));
+
+		NumHits += History->TestShot(Time, Start, End) ? 1 : 0;
+	}
+
+	const double ElapsedTime = FPlatformTime::Seconds() - StartTime;
+
+	UE_LOG(LogLagCompensation, Log, TEXT("Lag compensation benchmark: %d rewound shots in %.3f ms (%.1f ns per shot, %d hits), %d bytes of history per character"),
+		NumShots, ElapsedTime * 1000.0, ElapsedTime * 1.0e9 / FMath::Max(NumShots, 1), NumHits, static_cast<int32>(sizeof(FOCapsuleSnapshot) * UOLagCompensationComponent::MaxSnapshots));
+}
+
+static FAutoConsoleCommandWithArgs LagCompensationBenchmarkCommand(
+	TEXT("o.LagCompensation.Benchmark"),
+	TEXT("Measures the cost of rewinding and testing shots against the capsule history. Usage: o.LagCompensation.Benchmark [NumShots]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&LagCompensationBenchmark));
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FOLagCompensationInterpolationTest, "UnrealOnlineCpp.LagCompensation.Interpolation",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FOLagCompensationInterpolationTest::RunTest(const FString& Parameters)
+{
+	UOLagCompensationComponent* History = NewObject<UOLagCompensationComponent>();
+
+	// A capsule walking along X at 600 units per second, recorded at 60 ticks per second
+	const float TickInterval = 1.0f / 60.0f;
+	auto LocationAt = [](float Time) { return FVector(600.0f * Time, 0.0f, 96.0f); };
+	auto RecordTicks = [History, TickInterval, &LocationAt](int32 FirstTick, int32 NumTicks)
+	{
+		for (int32 Tick = FirstTick; Tick < FirstTick + NumTicks; ++Tick)
+		{
+			History->RecordSnapshot({ Tick * TickInterval, LocationAt(Tick * TickInterval), FQuat::Identity, 55.0f, 96.0f });
+		}
+	};
+
+	const int32 MaxSnapshots = UOLagCompensationComponent::MaxSnapshots;
+	const float Tolerance = 0.01f;
+	FOCapsuleSnapshot Snapshot;
+
+	TestFalse(TEXT("Empty history"), History->GetSnapshotAtTime(0.0f, Snapshot));
+
+	RecordTicks(0, MaxSnapshots);
+
+	// Halfway between two snapshots the capsule has to be halfway between them as well
+	TestTrue(TEXT("Midpoint rewound"), History->GetSnapshotAtTime(10.5f * TickInterval, Snapshot));
+	TestTrue(TEXT("Midpoint location"), Snapshot.Location.Equals(LocationAt(10.5f * TickInterval), Tolerance));
+
+	// Times outside the history get the oldest or the newest snapshot
+	History->GetSnapshotAtTime(-1.0f, Snapshot);
+	TestTrue(TEXT("Clamped to the oldest snapshot"), Snapshot.Location.Equals(LocationAt(0.0f), Tolerance));
+
+	History->GetSnapshotAtTime(100.0f, Snapshot);
+	TestTrue(TEXT("Clamped to the newest snapshot"), Snapshot.Location.Equals(LocationAt((MaxSnapshots - 1) * TickInterval), Tolerance));
+
+	// Half a buffer more overwrites the oldest half, the newest snapshots now sit at the start of the ring buffer
+	RecordTicks(MaxSnapshots, MaxSnapshots / 2);
+	TestEqual(TEXT("Snapshots kept after wrapping"), History->NumSnapshots(), MaxSnapshots);
+
+	History->GetSnapshotAtTime(0.0f, Snapshot);
+	TestTrue(TEXT("Clamped to the oldest snapshot after wrapping"), Snapshot.Location.Equals(LocationAt((MaxSnapshots / 2) * TickInterval), Tolerance));
+
+	// Between the last snapshot of the ring buffer and the first one
+	const float SeamTime = (MaxSnapshots - 0.5f) * TickInterval;
+	History->GetSnapshotAtTime(SeamTime, Snapshot);
+	TestTrue(TEXT("Midpoint across the wraparound"), Snapshot.Location.Equals(LocationAt(SeamTime), Tolerance));
+
+	const float NewestTime = (MaxSnapshots + MaxSnapshots / 2 - 1) * TickInterval;
+	History->GetSnapshotAtTime(NewestTime + 1.0f, Snapshot);
+	TestTrue(TEXT("Clamped to the newest snapshot after wrapping"), Snapshot.Location.Equals(LocationAt(NewestTime), Tolerance));
+
+	return true;
+}
+
+#endif
+
+UOLagCompensationComponent::UOLagCompensationComponent()
+{
+	// Record after movement has been applied for the frame
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+
+	MaxRewindTime = 0.5f;
+	HitTolerance = 15.0f;
+
+	OldestIndex = 0;
+	NumStored = 0;
+}
+
+void UOLagCompensationComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	// Only the server judges shots
+	const AActor* Owner = GetOwner();
+	SetComponentTickEnabled(Owner != nullptr && Owner->HasAuthority());
+}
+
+void UOLagCompensationComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	RecordSnapshot(GetWorld()->GetTimeSeconds());
+}
+
+void UOLagCompensationComponent::RecordSnapshot(float Time)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OLagCompensationRecord);
+
+	const AActor* Owner = GetOwner();
+	const UCapsuleComponent* Capsule = (Owner != nullptr) ? Cast<UCapsuleComponent>(Owner->GetRootComponent()) : nullptr;
+	if (Capsule == nullptr)
+	{
+		return;
+	}
+
+	FOCapsuleSnapshot Snapshot;
+	Snapshot.Time = Time;
+	Snapshot.Location = Capsule->GetComponentLocation();
+	Snapshot.Rotation = Capsule->GetComponentQuat();
+	Snapshot.Radius = Capsule->GetScaledCapsuleRadius();
+	Snapshot.HalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+
+	RecordSnapshot(Snapshot);
+}
+
+void UOLagCompensationComponent::RecordSnapshot(const FOCapsuleSnapshot& Snapshot)
+{
+	if (NumStored < MaxSnapshots)
+	{
+		Snapshots[(OldestIndex + NumStored) % MaxSnapshots] = Snapshot;
+		NumStored++;
+	}
+	else
+	{
+		Snapshots[OldestIndex] = Snapshot;
+		OldestIndex = (OldestIndex + 1) % MaxSnapshots;
+	}
+}
+
+bool UOLagCompensationComponent::GetSnapshotAtTime(float Time, FOCapsuleSnapshot& OutSnapshot) const
+{
+	if (NumStored == 0)
+	{
+		return false;
+	}
+
+	if (Time <= GetSnapshot(0).Time)
+	{
+		OutSnapshot = GetSnapshot(0);
+		return true;
+	}
+
+	if (Time >= GetSnapshot(NumStored - 1).Time)
+	{
+		OutSnapshot = GetSnapshot(NumStored - 1);
+		return true;
+	}
+
+	// Binary search for the newest snapshot that is not newer than Time
+	int32 Low = 0;
+	int32 High = NumStored - 1;
+	while (High - Low > 1)
+	{
+		const int32 Middle = (Low + High) / 2;
+		if (GetSnapshot(Middle).Time <= Time)
+		{
+			Low = Middle;
+		}
+		else
+		{
+			High = Middle;
+		}
+	}
+
+	const FOCapsuleSnapshot& Before = GetSnapshot(Low);
+	const FOCapsuleSnapshot& After = GetSnapshot(High);
+	const float TimeSpan = After.Time - Before.Time;
+	const float Alpha = (TimeSpan > SMALL_NUMBER) ? (Time - Before.Time) / TimeSpan : 0.0f;
+
+	OutSnapshot.Time = Time;
+	OutSnapshot.Location = FMath::Lerp(Before.Location, After.Location, Alpha);
+	OutSnapshot.Rotation = FQuat::Slerp(Before.Rotation, After.Rotation, Alpha);
+	OutSnapshot.Radius = FMath::Lerp(Before.Radius, After.Radius, Alpha);
+	OutSnapshot.HalfHeight = FMath::Lerp(Before.HalfHeight, After.HalfHeight, Alpha);
+
+	return true;
+}
+
+bool UOLagCompensationComponent::TestShot(float Time, const FVector& Start, const FVector& End) const
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OLagCompensationRewind);
+
+	FOCapsuleSnapshot Snapshot;
+	if (!GetSnapshotAtTime(Time, Snapshot))
+	{
+		return false;
+	}
+
+	return SegmentIntersectsCapsule(Start, End, Snapshot, HitTolerance);
+}
+
+bool UOLagCompensationComponent::SegmentIntersectsCapsule(const FVector& Start, const FVector& End, const FOCapsuleSnapshot& Capsule, float Tolerance)
+{
+	// A capsule is every point within Radius of the segment between its two sphere centers
+	const FVector Axis = Capsule.Rotation.GetUpVector() * FMath::Max(Capsule.HalfHeight - Capsule.Radius, 0.0f);
+
+	FVector PointOnShot;
+	FVector PointOnAxis;
+	FMath::SegmentDistToSegmentSafe(Start, End, Capsule.Location - Axis, Capsule.Location + Axis, PointOnShot, PointOnAxis);
+
+	return FVector::DistSquared(PointOnShot, PointOnAxis) <= FMath::Square(Capsule.Radius + Tolerance);
+}
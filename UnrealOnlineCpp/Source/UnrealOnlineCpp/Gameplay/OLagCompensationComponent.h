@@ -0,0 +1,98 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "OLagCompensationComponent.generated.h"
+
+// Capsule of a character at one point in server time.
+struct FOCapsuleSnapshot
+{
+	float Time;
+	FVector Location;
+	FQuat Rotation;
+	float Radius;
+	float HalfHeight;
+};
+
+/**
+ * Server side capsule history of a character, used to judge a client's shot against where the target was
+ * when the client fired. Snapshots live in a fixed-size ring buffer, so recording never allocates.
+ */
+UCLASS(ClassGroup = (Gameplay), meta = (BlueprintSpawnableComponent))
+class UNREALONLINECPP_API UOLagCompensationComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Number of snapshots kept per character, about one second of history at 60 server ticks per second.
+	static const int32 MaxSnapshots = 64;
+
+	UOLagCompensationComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/**
+	 * Stores a snapshot of the owner's capsule, overwriting the oldest one once the buffer is full.
+	 *
+	 * @param Time: server world time of the snapshot.
+	 */
+	void RecordSnapshot(float Time);
+
+	/**
+	 * Stores a snapshot directly.
+	 *
+	 * @param Snapshot: capsule to store, its time must not be older than the newest stored snapshot.
+	 */
+	void RecordSnapshot(const FOCapsuleSnapshot& Snapshot);
+
+	/**
+	 * Interpolates the capsule at a point in time between the two snapshots around it.
+	 *
+	 * @param Time: server world time to rewind to, clamped to the recorded history.
+	 * @param OutSnapshot: the interpolated capsule.
+	 * @returns false if there is no history yet.
+	 */
+	bool GetSnapshotAtTime(float Time, FOCapsuleSnapshot& OutSnapshot) const;
+
+	/**
+	 * Tests a shot segment against the capsule as it was at a point in time.
+	 *
+	 * @param Time: server world time the shot was fired at.
+	 * @param Start: start of the shot segment.
+	 * @param End: end of the shot segment.
+	 * @returns true if the segment passes within HitTolerance of the rewound capsule.
+	 */
+	bool TestShot(float Time, const FVector& Start, const FVector& End) const;
+
+	// Returns true if a segment passes within Tolerance of a capsule.
+	static bool SegmentIntersectsCapsule(const FVector& Start, const FVector& End, const FOCapsuleSnapshot& Capsule, float Tolerance);
+
+	// Returns the number of stored snapshots.
+	FORCEINLINE int32 NumSnapshots() const { return NumStored; }
+
+protected:
+	virtual void BeginPlay() override;
+
+public:
+	// Shots older than this many seconds are not rewound.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Gameplay|LagCompensation")
+	float MaxRewindTime;
+
+	// Extra distance around the capsule that still counts as a hit, covers quantization and interpolation error.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Gameplay|LagCompensation")
+	float HitTolerance;
+
+private:
+	// Returns the snapshot at a position from oldest (0) to newest (NumStored - 1).
+	FORCEINLINE const FOCapsuleSnapshot& GetSnapshot(int32 Index) const { return Snapshots[(OldestIndex + Index) % MaxSnapshots]; }
+
+	FOCapsuleSnapshot Snapshots[MaxSnapshots];
+
+	// Ring buffer position of the oldest snapshot
+	int32 OldestIndex;
+
+	// Number of valid snapshots
+	int32 NumStored;
+};
@@ -2,15 +2,49 @@
 
 #include "OPlayerCharacter.h"
 #include "OWeaponProjectile.h"
-#include "Animation/AnimInstance.h"
+#include "OProjectilePool.h"
+#include "OProjectileBatch.h"
+#include "OLagCompensationComponent.h"
+#include "OCharacterSignificance.h"
+#include "OWeaponEffects.h"
+#include "../Core/ODiagnostics.h"
+#include "../Core/OStats.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
+#include "Engine/NetDriver.h"
+#include "GameFramework/DamageType.h"
+#include "GameFramework/GameStateBase.h"
 #include "GameFramework/InputSettings.h"
+#include "GameFramework/PlayerController.h"
 #include "Kismet/GameplayStatics.h"
+#include "TimerManager.h"
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
+O_DECLARE_CYCLE_STAT("Fire Input", STAT_OFireInput);
+O_DECLARE_CYCLE_STAT("Flush Shots", STAT_OFlushShots);
+O_DECLARE_CYCLE_STAT("Process Fire Batch", STAT_OProcessFireBatch);
+O_DECLARE_CYCLE_STAT("Confirm Hit", STAT_OConfirmHit);
+O_DECLARE_CYCLE_STAT("Fire Batch Effects", STAT_OFireBatchEffects);
+O_DECLARE_CYCLE_STAT("Movement Input", STAT_OMovementInput);
+O_DECLARE_CYCLE_STAT("Look Input", STAT_OLookInput);
+O_DECLARE_CYCLE_STAT("Net Update Frequency", STAT_ONetUpdateFrequency);
+
+static TAutoConsoleVariable<int32> CVarOptimizedCharacterReplication(
+	TEXT("o.Net.OptimizedCharacterReplication"),
+	1,
+	TEXT("Characters spawned from now on use distance based net update frequency, a shorter cull distance and fire relevancy. The replication graph takes them from its class settings instead.\n")
+	TEXT("0: engine defaults, 1: optimized"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarPredictFire(
+	TEXT("o.Fire.Predict"),
+	1,
+	TEXT("Clients fire the cosmetic projectile of their own shots right away instead of waiting for the server to replay them.\n")
+	TEXT("0: wait for the server, 1: predict"),
+	ECVF_Default);
+
 AOPlayerCharacter::AOPlayerCharacter()
 {
 	// Set size for collision capsule
@@ -49,6 +83,47 @@ AOPlayerCharacter::AOPlayerCharacter()
 
 	// Default offset from the character location for projectiles to spawn
 	GunOffset = FVector(100.0f, 0.0f, 10.0f);
+
+	// Records the capsule every server tick so client hits can be rewound
+	LagCompensation = CreateDefaultSubobject<UOLagCompensationComponent>(TEXT("LagCompensation"));
+
+	MaxShotsPerBatch = 8;
+	MaxFireOriginDistance = 300.0f;
+	MinFireInterval = 0.1f;
+	MaxShotAge = 1.0f;
+	MaxProjectileSpeed = 3000.0f;
+	MaxHitClaimsPerSecond = 20;
+	PredictionTimeout = 2.0f;
+	LastPredictionKey = 0;
+	HitDamage = 20.0f;
+
+	NearNetUpdateFrequency = 60.0f;
+	FarNetUpdateFrequency = 10.0f;
+	NearNetUpdateDistance = 1500.0f;
+	FarNetUpdateDistance = 6000.0f;
+	CharacterNetCullDistance = 8000.0f;
+	FireRelevancyTime = 2.0f;
+	FireRelevancyDistance = 16000.0f;
+
+	LastFireTime = -1.0f;
+	LastShotTimestamp = -MAX_flt;
+	HitClaimWindowStart = 0.0f;
+	NumHitClaimsInWindow = 0;
+
+	// Only the owner ever sees the first person meshes, they stay local to every machine and are never replicated
+	Mesh1P->SetIsReplicated(false);
+	FP_Gun->SetIsReplicated(false);
+}
+
+bool AOPlayerCharacter::UsesOptimizedReplication()
+{
+	return CVarOptimizedCharacterReplication.GetValueOnGameThread() != 0;
+}
+
+bool AOPlayerCharacter::UsesReplicationGraph() const
+{
+	const UNetDriver* NetDriver = GetNetDriver();
+	return NetDriver != nullptr && NetDriver->GetReplicationDriver() != nullptr;
 }
 
 void AOPlayerCharacter::BeginPlay()
@@ -58,6 +133,84 @@ void AOPlayerCharacter::BeginPlay()
 
 	// Attach gun mesh component to Skeleton, doing it here because the skeleton is not yet created in the constructor
 	FP_Gun->AttachToComponent(Mesh1P, FAttachmentTransformRules(EAttachmentRule::SnapToTarget, true), TEXT("GripPoint"));
+
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		// Nobody looks through a dedicated server's first person view, don't animate it
+		Mesh1P->SetComponentTickEnabled(false);
+		FP_Gun->SetComponentTickEnabled(false);
+	}
+
+	// The replication graph ignores cull distance, update frequency and IsNetRelevantFor of the actor, it takes them
+	// from its class settings. Scaling the frequency would only cost a pass over every player per character
+	if (HasAuthority() && UsesOptimizedReplication() && !UsesReplicationGraph())
+	{
+		NetCullDistanceSquared = FMath::Square(CharacterNetCullDistance);
+		MinNetUpdateFrequency = FarNetUpdateFrequency;
+
+		UpdateNetUpdateFrequency();
+		GetWorldTimerManager().SetTimer(NetUpdateFrequencyTimerHandle, this, &AOPlayerCharacter::UpdateNetUpdateFrequency, 0.5f, true);
+	}
+
+	// Make sure the first shots don't have to spawn anything
+	AOProjectilePool* ProjectilePool = AOProjectilePool::Get(GetWorld());
+	if (ProjectilePool != nullptr)
+	{
+		ProjectilePool->Prewarm(ProjectileClass);
+	}
+
+	// Characters far away or out of view tick and animate less often
+	AOCharacterSignificance* Significance = AOCharacterSignificance::Get(GetWorld());
+	if (Significance != nullptr)
+	{
+		Significance->RegisterCharacter(this);
+	}
+}
+
+void AOPlayerCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	AOCharacterSignificance* Significance = AOCharacterSignificance::Get(GetWorld(), false);
+	if (Significance != nullptr)
+	{
+		Significance->UnregisterCharacter(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AOPlayerCharacter::UpdateNetUpdateFrequency()
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_ONetUpdateFrequency);
+
+	// The nearest player needs the most updates
+	float NearestDistanceSquared = MAX_flt;
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		const APawn* ViewPawn = (PlayerController != nullptr) ? PlayerController->GetPawn() : nullptr;
+		if (ViewPawn != nullptr && ViewPawn != this)
+		{
+			NearestDistanceSquared = FMath::Min(NearestDistanceSquared, FVector::DistSquared(ViewPawn->GetActorLocation(), GetActorLocation()));
+		}
+	}
+
+	const float Alpha = FMath::Clamp(FMath::GetRangePct(NearNetUpdateDistance, FarNetUpdateDistance, FMath::Sqrt(NearestDistanceSquared)), 0.0f, 1.0f);
+	NetUpdateFrequency = FMath::Lerp(NearNetUpdateFrequency, FarNetUpdateFrequency, Alpha);
+}
+
+bool AOPlayerCharacter::IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const
+{
+	if (Super::IsNetRelevantFor(RealViewer, ViewTarget, SrcLocation))
+	{
+		return true;
+	}
+
+	if (!UsesOptimizedReplication() || LastFireTime < 0.0f || GetWorld()->GetTimeSeconds() - LastFireTime > FireRelevancyTime)
+	{
+		return false;
+	}
+
+	return FVector::DistSquared(SrcLocation, GetActorLocation()) < FMath::Square(FireRelevancyDistance);
 }
 
 void AOPlayerCharacter::SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent)
@@ -88,42 +241,412 @@ void AOPlayerCharacter::SetupPlayerInputComponent(class UInputComponent* PlayerI
 	PlayerInputComponent->BindAxis("LookUpRate", this, &AOPlayerCharacter::LookUpAtRate);
 }
 
+void AOPlayerCharacter::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	// All shots of this frame go out in one RPC
+	FlushPendingShots();
+}
+
 void AOPlayerCharacter::OnFire()
 {
-	// Try and fire a projectile
+	O_SCOPE_CYCLE_COUNTER(STAT_OFireInput);
+
+	// Queue a shot for the server, which fires the authoritative projectile. Clients predict a cosmetic one meanwhile
 	if (ProjectileClass != NULL)
 	{
 		UWorld* const World = GetWorld();
 		if (World != NULL)
 		{
-
 			const FRotator SpawnRotation = GetControlRotation();
 			// MuzzleOffset is in camera space, so transform it to world space before offsetting from the character location to find the final muzzle position
 			const FVector SpawnLocation = ((FP_MuzzleLocation != nullptr) ? FP_MuzzleLocation->GetComponentLocation() : GetActorLocation()) + SpawnRotation.RotateVector(GunOffset);
 
-			//Set Spawn Collision Handling Override
-			FActorSpawnParameters ActorSpawnParams;
-			ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+			const AGameStateBase* GameState = World->GetGameState();
+
+			FOFireShot Shot;
+			Shot.Timestamp = (GameState != nullptr) ? GameState->GetServerWorldTimeSeconds() : World->GetTimeSeconds();
+			Shot.Origin = SpawnLocation;
+			Shot.Direction = SpawnRotation.Vector();
+
+			// Clients key every shot, the server only confirms hits of keyed shots it accepted
+			if (!HasAuthority())
+			{
+				LastPredictionKey = (LastPredictionKey == MAX_uint16) ? 1 : LastPredictionKey + 1;
+				Shot.PredictionKey = LastPredictionKey;
+			}
+
+			if (ShouldPredictFire())
+			{
+				PredictShot(Shot);
+			}
+
+			PendingShots.Add(Shot);
+
+			if (PendingShots.Num() >= MaxShotsPerBatch)
+			{
+				FlushPendingShots();
+			}
+		}
+	}
+
+	// Sound and firing animation go through the pooled, voice limited effects of the world
+	AOWeaponEffects* WeaponEffects = AOWeaponEffects::Get(GetWorld());
+	if (WeaponEffects != nullptr)
+	{
+		WeaponEffects->PlayFireSound(FireSound, GetActorLocation());
+		WeaponEffects->PlayFireMontage(Mesh1P, FireAnimation);
+	}
+}
+
+void AOPlayerCharacter::FlushPendingShots()
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OFlushShots);
+
+	if (PendingShots.Num() == 0)
+	{
+		return;
+	}
+
+	if (HasAuthority())
+	{
+		ProcessFireBatch(PendingShots);
+	}
+	else
+	{
+		ServerFireBatch(PendingShots);
+	}
+
+	PendingShots.Reset();
+}
+
+void AOPlayerCharacter::ProcessFireBatch(const TArray<FOFireShot>& Shots)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OProcessFireBatch);
+
+	TArray<FOFireShot> AcceptedShots;
+	AcceptedShots.Reserve(Shots.Num());
+
+	TArray<uint16> RejectedPredictionKeys;
+
+	const float Now = GetWorld()->GetTimeSeconds();
+	int32 NumTooFast = 0;
+
+	// A projectile can't claim a hit once it has run out of life
+	const AOWeaponProjectile* DefaultProjectile = (ProjectileClass != nullptr) ? ProjectileClass->GetDefaultObject<AOWeaponProjectile>() : nullptr;
+	const float MaxHitAge = MaxShotAge + ((DefaultProjectile != nullptr) ? DefaultProjectile->LifeTime : 0.0f);
+	while (AcceptedShotHistory.Num() > 0 && AcceptedShotHistory[0].Time < Now - MaxHitAge)
+	{
+		AcceptedShotHistory.RemoveAt(0, 1, false);
+	}
+
+	for (const FOFireShot& Shot : Shots)
+	{
+		bool bAccepted = true;
+
+		// The weapon fires at most once per MinFireInterval of server time. Timestamps from the future or from long ago
+		// would let a client spread any number of shots over time it never fired in
+		if (Shot.Timestamp > Now + 0.1f || Shot.Timestamp < Now - MaxShotAge || Shot.Timestamp - LastShotTimestamp < MinFireInterval)
+		{
+			NumTooFast++;
+			bAccepted = false;
+		}
+		// Don't trust origins that are nowhere near where the character was when it fired
+		else if (FVector::DistSquared(Shot.Origin, GetLocationAtTime(Shot.Timestamp)) > FMath::Square(MaxFireOriginDistance))
+		{
+			UE_LOG(LogFPChar, Warning, TEXT("%s: rejected shot, origin too far from the character"), *GetName());
+			bAccepted = false;
+		}
+
+		if (!bAccepted)
+		{
+			if (Shot.PredictionKey != 0)
+			{
+				RejectedPredictionKeys.Add(Shot.PredictionKey);
+			}
+			continue;
+		}
+
+		LastShotTimestamp = Shot.Timestamp;
+
+		if (Shot.PredictionKey != 0)
+		{
+			FOAcceptedShot& AcceptedShot = AcceptedShotHistory.AddDefaulted_GetRef();
+			AcceptedShot.PredictionKey = Shot.PredictionKey;
+			AcceptedShot.Origin = Shot.Origin;
+			AcceptedShot.Direction = Shot.Direction;
+			AcceptedShot.Time = Shot.Timestamp;
+		}
+
+		FireProjectile(Shot);
+		AcceptedShots.Add(Shot);
+	}
+
+	if (NumTooFast > 0)
+	{
+		UE_LOG(LogFPChar, Warning, TEXT("%s: dropped %d of %d shots, fired faster than once per %.2f seconds or stamped outside the last %.2f seconds"),
+			*GetName(), NumTooFast, Shots.Num(), MinFireInterval, MaxShotAge);
+	}
+
+	if (AcceptedShots.Num() > 0)
+	{
+		LastFireTime = Now;
+
+		MulticastFireBatch(AcceptedShots);
+	}
+
+	// The shooter already sees these projectiles flying
+	if (RejectedPredictionKeys.Num() > 0)
+	{
+		ClientRejectShots(RejectedPredictionKeys);
+	}
+}
+
+AOWeaponProjectile* AOPlayerCharacter::FireProjectile(const FOFireShot& Shot)
+{
+	// Lightweight mode appends a row instead of firing an actor
+	if (AOProjectileBatch::IsEnabled())
+	{
+		AOProjectileBatch* ProjectileBatch = AOProjectileBatch::Get(GetWorld());
+		if (ProjectileBatch != nullptr)
+		{
+			ProjectileBatch->AddProjectile(Shot.Origin, Shot.Direction, this, Shot.PredictionKey);
+			return nullptr;
+		}
+	}
+
+	AOProjectilePool* ProjectilePool = AOProjectilePool::Get(GetWorld());
+	if (ProjectilePool != nullptr)
+	{
+		return ProjectilePool->Acquire(ProjectileClass, Shot.Origin, Shot.Direction.Rotation(), this);
+	}
+
+	return nullptr;
+}
+
+bool AOPlayerCharacter::ShouldPredictFire() const
+{
+	// Servers fire authoritative projectiles in the same frame, there is nothing to predict
+	return !HasAuthority() && IsLocallyControlled() && CVarPredictFire.GetValueOnGameThread() != 0;
+}
+
+void AOPlayerCharacter::PredictShot(FOFireShot& Shot)
+{
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	// The server answers in order, anything this old got lost with an unreliable replay
+	while (PredictedShots.Num() > 0 && Now - PredictedShots[0].Time > PredictionTimeout)
+	{
+		PredictedShots.RemoveAt(0, 1, false);
+	}
+
+	FOPredictedShot& PredictedShot = PredictedShots.AddDefaulted_GetRef();
+	PredictedShot.PredictionKey = Shot.PredictionKey;
+	PredictedShot.Projectile = FireProjectile(Shot);
+	PredictedShot.Time = Now;
+
+	if (PredictedShot.Projectile.IsValid())
+	{
+		PredictedShot.Projectile->SetPredictionKey(Shot.PredictionKey);
+	}
+}
+
+void AOPlayerCharacter::ReconcilePredictedShot(uint16 PredictionKey, bool bDiscard)
+{
+	const int32 ShotIdx = PredictedShots.IndexOfByPredicate([PredictionKey](const FOPredictedShot& PredictedShot)
+	{
+		return PredictedShot.PredictionKey == PredictionKey;
+	});
+
+	if (ShotIdx == INDEX_NONE)
+	{
+		return;
+	}
+
+	// The projectile may have landed and been reused for a later shot since
+	AOWeaponProjectile* Projectile = PredictedShots[ShotIdx].Projectile.Get();
+	if (bDiscard && Projectile != nullptr && Projectile->GetPredictionKey() == PredictionKey)
+	{
+		Projectile->Recycle();
+	}
+
+	PredictedShots.RemoveAt(ShotIdx, 1, false);
+}
+
+void AOPlayerCharacter::ClientRejectShots_Implementation(const TArray<uint16>& PredictionKeys)
+{
+	for (uint16 PredictionKey : PredictionKeys)
+	{
+		ReconcilePredictedShot(PredictionKey, true);
+	}
+}
+
+void AOPlayerCharacter::ServerFireBatch_Implementation(const TArray<FOFireShot>& Shots)
+{
+	ProcessFireBatch(Shots);
+}
+
+bool AOPlayerCharacter::ServerFireBatch_Validate(const TArray<FOFireShot>& Shots)
+{
+	return Shots.Num() <= MaxShotsPerBatch;
+}
+
+void AOPlayerCharacter::ReportHit(AOPlayerCharacter* Target, const FHitResult& Hit, uint16 PredictionKey)
+{
+	if (Target == nullptr || Target == this)
+	{
+		return;
+	}
+
+	const FVector ShotDirection = (Hit.TraceEnd - Hit.TraceStart).GetSafeNormal();
+
+	if (HasAuthority())
+	{
+		// Server players see the present, there is nothing to rewind
+		ApplyHit(Target, ShotDirection, Hit);
+		return;
+	}
+
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+
+	// A predicted projectile can hit before its shot went out, the server has to see the shot before the hit
+	FlushPendingShots();
+
+	FOHitClaim Claim;
+	Claim.Target = Target;
+	Claim.PredictionKey = PredictionKey;
+	Claim.Timestamp = (GameState != nullptr) ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+	Claim.Start = Hit.TraceStart;
+	Claim.End = Hit.TraceEnd;
+
+	ServerConfirmHit(Claim);
+}
 
-			// spawn the projectile at the muzzle
-			World->SpawnActor<AOWeaponProjectile>(ProjectileClass, SpawnLocation, SpawnRotation, ActorSpawnParams);
+void AOPlayerCharacter::ServerConfirmHit_Implementation(const FOHitClaim& Claim)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OConfirmHit);
+
+	// Far more claims than the weapon can fire shots is no lag spike, the excess is dropped
+	const float Now = GetWorld()->GetTimeSeconds();
+	if (Now - HitClaimWindowStart >= 1.0f)
+	{
+		HitClaimWindowStart = Now;
+		NumHitClaimsInWindow = 0;
+	}
+
+	if (++NumHitClaimsInWindow > MaxHitClaimsPerSecond)
+	{
+		O_DIAG(LogFPChar, Warning, TEXT("%s: dropped hit claim for shot %d, over %d claims per second"), *GetName(), Claim.PredictionKey, MaxHitClaimsPerSecond);
+		return;
+	}
+
+	if (Claim.Target == nullptr || Claim.Target == this || Claim.Target->GetLagCompensation() == nullptr)
+	{
+		return;
+	}
+
+	// Hits from too far in the past, or the future, are not rewound
+	const float Age = Now - Claim.Timestamp;
+	if (Age < -0.1f || Age > Claim.Target->GetLagCompensation()->MaxRewindTime)
+	{
+		UE_LOG(LogFPChar, Warning, TEXT("%s: rejected hit on %s, %.3f seconds old"), *GetName(), *Claim.Target->GetName(), Age);
+		return;
+	}
+
+	// Only shots the server accepted can hit, predicted projectiles fly before it has seen their shot
+	const int32 ShotIdx = AcceptedShotHistory.IndexOfByPredicate([&Claim](const FOAcceptedShot& AcceptedShot)
+	{
+		return AcceptedShot.PredictionKey == Claim.PredictionKey;
+	});
+
+	if (Claim.PredictionKey == 0 || ShotIdx == INDEX_NONE)
+	{
+		UE_LOG(LogFPChar, Warning, TEXT("%s: rejected hit on %s, shot %d was not accepted or already hit"), *GetName(), *Claim.Target->GetName(), Claim.PredictionKey);
+		return;
+	}
+
+	// Every shot hits once, whether this claim checks out or not
+	const FOAcceptedShot Shot = AcceptedShotHistory[ShotIdx];
+	AcceptedShotHistory.RemoveAt(ShotIdx, 1, false);
+
+	// The origin was checked against where the shooter was when it fired, the hit can't start further away than the projectile got since
+	const float FlightTime = Claim.Timestamp - Shot.Time;
+	if (FlightTime < -0.1f || FVector::DistSquared(Claim.Start, Shot.Origin) > FMath::Square(MaxFireOriginDistance + MaxProjectileSpeed * FMath::Max(FlightTime, 0.0f)))
+	{
+		UE_LOG(LogFPChar, Warning, TEXT("%s: rejected hit on %s, out of reach of shot %d"), *GetName(), *Claim.Target->GetName(), Claim.PredictionKey);
+		return;
+	}
+
+	if (!Claim.Target->GetLagCompensation()->TestShot(Claim.Timestamp, Claim.Start, Claim.End))
+	{
+		UE_LOG(LogFPChar, Warning, TEXT("%s: rejected hit on %s, no overlap with the rewound capsule"), *GetName(), *Claim.Target->GetName());
+		return;
+	}
+
+	FHitResult Hit(Claim.Target, nullptr, Claim.End, (Claim.Start - Claim.End).GetSafeNormal());
+	Hit.TraceStart = Claim.Start;
+	Hit.TraceEnd = Claim.End;
+
+	ApplyHit(Claim.Target, (Claim.End - Claim.Start).GetSafeNormal(), Hit);
+}
+
+bool AOPlayerCharacter::ServerConfirmHit_Validate(const FOHitClaim& Claim)
+{
+	// Vectors arrive quantized, only the timestamp can be garbage
+	return FMath::IsFinite(Claim.Timestamp);
+}
+
+FVector AOPlayerCharacter::GetLocationAtTime(float Time) const
+{
+	FOCapsuleSnapshot Snapshot;
+	if (LagCompensation != nullptr && LagCompensation->GetSnapshotAtTime(Time, Snapshot))
+	{
+		return Snapshot.Location;
+	}
+
+	return GetActorLocation();
+}
+
+void AOPlayerCharacter::ApplyHit(AOPlayerCharacter* Target, const FVector& ShotDirection, const FHitResult& Hit)
+{
+	UGameplayStatics::ApplyPointDamage(Target, HitDamage, ShotDirection, Hit, GetController(), this, UDamageType::StaticClass());
+}
+
+void AOPlayerCharacter::MulticastFireBatch_Implementation(const TArray<FOFireShot>& Shots)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OFireBatchEffects);
+
+	// The owner already heard the shots when pressing fire, everybody else gets one sound per batch, the host included
+	if (!IsLocallyControlled())
+	{
+		AOWeaponEffects* WeaponEffects = AOWeaponEffects::Get(GetWorld());
+		if (WeaponEffects != nullptr)
+		{
+			WeaponEffects->PlayFireSound(FireSound, GetActorLocation());
 		}
 	}
 
-	// Try and play the sound if specified
-	if (FireSound != NULL)
+	// The server already fired the authoritative projectiles
+	if (HasAuthority())
 	{
-		UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
+		return;
 	}
 
-	// Try and play a firing animation if specified
-	if (FireAnimation != NULL)
+	for (const FOFireShot& Shot : Shots)
 	{
-		// Get the animation object for the arms mesh
-		UAnimInstance* AnimInstance = Mesh1P->GetAnimInstance();
-		if (AnimInstance != NULL)
+		// The owner's predicted projectile already flies along this shot, replaying it would fire it twice
+		if (Shot.PredictionKey != 0 && IsLocallyControlled() && ShouldPredictFire())
 		{
-			AnimInstance->Montage_Play(FireAnimation, 1.f);
+			ReconcilePredictedShot(Shot.PredictionKey, false);
+			continue;
+		}
+
+		// The owner claims hits of its replayed projectiles with the key of their shot
+		AOWeaponProjectile* Projectile = FireProjectile(Shot);
+		if (Projectile != nullptr && IsLocallyControlled())
+		{
+			Projectile->SetPredictionKey(Shot.PredictionKey);
 		}
 	}
 }
@@ -155,6 +678,8 @@ void AOPlayerCharacter::EndTouch(const ETouchIndex::Type FingerIndex, const FVec
 
 void AOPlayerCharacter::MoveForward(float Value)
 {
+	O_SCOPE_CYCLE_COUNTER(STAT_OMovementInput);
+
 	if (Value != 0.0f)
 	{
 		// add movement in that direction
@@ -164,6 +689,8 @@ void AOPlayerCharacter::MoveForward(float Value)
 
 void AOPlayerCharacter::MoveRight(float Value)
 {
+	O_SCOPE_CYCLE_COUNTER(STAT_OMovementInput);
+
 	if (Value != 0.0f)
 	{
 		// add movement in that direction
@@ -173,12 +700,16 @@ void AOPlayerCharacter::MoveRight(float Value)
 
 void AOPlayerCharacter::TurnAtRate(float Rate)
 {
+	O_SCOPE_CYCLE_COUNTER(STAT_OLookInput);
+
 	// calculate delta for this frame from the rate information
 	AddControllerYawInput(Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds());
 }
 
 void AOPlayerCharacter::LookUpAtRate(float Rate)
 {
+	O_SCOPE_CYCLE_COUNTER(STAT_OLookInput);
+
 	// calculate delta for this frame from the rate information
 	AddControllerPitchInput(Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds());
 }
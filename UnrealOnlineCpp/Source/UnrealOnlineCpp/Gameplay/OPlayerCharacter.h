@@ -8,23 +8,134 @@
 
 class UInputComponent;
 
+USTRUCT()
+struct FOFireShot
+{
+	GENERATED_BODY()
+
+public:
+	// Estimated server world time at which the shot was fired.
+	UPROPERTY()
+	float Timestamp = 0.0f;
+
+	// Muzzle location, quantized to one decimal.
+	UPROPERTY()
+	FVector_NetQuantize10 Origin;
+
+	// Fire direction, quantized as a unit vector.
+	UPROPERTY()
+	FVector_NetQuantizeNormal Direction;
+
+	// Key the owning client gave the shot, its projectile claims hits with it. 0 for shots of the server's own players.
+	UPROPERTY()
+	uint16 PredictionKey = 0;
+};
+
+// A shot the owning client fired before the server accepted it.
+struct FOPredictedShot
+{
+	uint16 PredictionKey;
+
+	// Cosmetic projectile spawned for the shot, none in lightweight projectile mode
+	TWeakObjectPtr<class AOWeaponProjectile> Projectile;
+
+	// Client world time the shot was fired
+	float Time;
+};
+
+// A shot of the owning client the server accepted, hits are only confirmed for these, one per shot.
+struct FOAcceptedShot
+{
+	uint16 PredictionKey;
+
+	FVector Origin;
+	FVector Direction;
+
+	// Timestamp the client gave the shot
+	float Time;
+};
+
+USTRUCT()
+struct FOHitClaim
+{
+	GENERATED_BODY()
+
+public:
+	// Character the client saw getting hit.
+	UPROPERTY()
+	class AOPlayerCharacter* Target;
+
+	// Key of the shot whose projectile hit.
+	UPROPERTY()
+	uint16 PredictionKey = 0;
+
+	// Estimated server world time of the hit on the client.
+	UPROPERTY()
+	float Timestamp;
+
+	// Start of the projectile move that hit.
+	UPROPERTY()
+	FVector_NetQuantize10 Start;
+
+	// End of the projectile move that hit.
+	UPROPERTY()
+	FVector_NetQuantize10 End;
+};
+
 UCLASS(config = Game)
 class UNREALONLINECPP_API AOPlayerCharacter : public ACharacter
 {
 	GENERATED_BODY()
 
+	// Simulated clients and benchmark bots drive the character through the same input handlers as a player
+	friend class UOLoadGenerator;
+	friend class UOBenchmark;
+
 public:
 	AOPlayerCharacter();
 
 	// Returns Mesh1P subobject.
 	FORCEINLINE class USkeletalMeshComponent* GetMesh1P() const { return Mesh1P; }
 
+	// Returns FP_Gun subobject.
+	FORCEINLINE class USkeletalMeshComponent* GetFP_Gun() const { return FP_Gun; }
+
 	// Returns FirstPersonCameraComponent subobject.
 	FORCEINLINE class UCameraComponent* GetFirstPersonCameraComponent() const { return FirstPersonCameraComponent; }
 
+	// Returns LagCompensation subobject.
+	FORCEINLINE class UOLagCompensationComponent* GetLagCompensation() const { return LagCompensation; }
+
+	/**
+	 * Called when one of this character's projectiles hits another character. The server applies the hit
+	 * directly for its own players, clients send it to the server to be checked against the target's history.
+	 *
+	 * @param Target: character that got hit.
+	 * @param Hit: the projectile's hit result.
+	 * @param PredictionKey: key of the shot the projectile flies for, 0 if it doesn't fly for one of the client's shots.
+	 */
+	void ReportHit(AOPlayerCharacter* Target, const FHitResult& Hit, uint16 PredictionKey);
+
+	/**
+	 * Keeps characters that fired recently relevant beyond the cull distance, gunfire carries further than sight.
+	 * Never called while the net driver replicates through a replication graph, the graph culls by its own grid.
+	 */
+	virtual bool IsNetRelevantFor(const AActor* RealViewer, const AActor* ViewTarget, const FVector& SrcLocation) const override;
+
+	// Returns true if characters use the bandwidth optimized replication profile, see o.Net.OptimizedCharacterReplication.
+	static bool UsesOptimizedReplication();
+
+	// Returns true if the net driver of the world replicates through a replication graph instead of the per actor relevancy checks.
+	bool UsesReplicationGraph() const;
+
 protected:
 	virtual void BeginPlay();
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Sends the shots queued this frame to the server.
+	virtual void Tick(float DeltaSeconds) override;
+
 	virtual void SetupPlayerInputComponent(UInputComponent* InputComponent) override;
 
 	/*
@@ -40,6 +151,57 @@ protected:
 	/** Fires a projectile. */
 	void OnFire();
 
+	/** Sends all queued shots to the server as one batch. */
+	void FlushPendingShots();
+
+	/**
+	 * Server side handling of a batch of shots: fires the authoritative projectiles and
+	 * forwards the batch to the other clients.
+	 */
+	void ProcessFireBatch(const TArray<FOFireShot>& Shots);
+
+	/**
+	 * Takes a projectile out of the pool and fires it along a shot.
+	 *
+	 * @returns the projectile, or nullptr if it went into the projectile batch or could not be placed.
+	 */
+	class AOWeaponProjectile* FireProjectile(const FOFireShot& Shot);
+
+	/** Returns true if shots of this character are fired locally before the server confirms them, see o.Fire.Predict. */
+	bool ShouldPredictFire() const;
+
+	/** Fires the cosmetic projectile of a shot right away on the owning client and tracks it by its key for reconciliation. */
+	void PredictShot(FOFireShot& Shot);
+
+	/**
+	 * Stops tracking a predicted shot.
+	 *
+	 * @param bDiscard: the server rejected the shot, recycle its projectile if it is still in flight.
+	 */
+	void ReconcilePredictedShot(uint16 PredictionKey, bool bDiscard);
+
+	/** Carries every shot fired during one client frame to the server. */
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerFireBatch(const TArray<FOFireShot>& Shots);
+
+	/**
+	 * Checks a client's hit against the accepted shot it claims, rewinds the target to the time of the hit and applies
+	 * the hit if it checks out. Every shot hits at most once.
+	 */
+	UFUNCTION(Server, Reliable, WithValidation)
+	void ServerConfirmHit(const FOHitClaim& Claim);
+
+	/** Applies the weapon damage of a confirmed hit. */
+	void ApplyHit(AOPlayerCharacter* Target, const FVector& ShotDirection, const FHitResult& Hit);
+
+	/** Replays a batch of shots as cosmetic projectiles on the clients this character is relevant to. */
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastFireBatch(const TArray<FOFireShot>& Shots);
+
+	/** Tells the owning client which of its predicted shots the server did not accept. */
+	UFUNCTION(Client, Reliable)
+	void ClientRejectShots(const TArray<uint16>& PredictionKeys);
+
 	/** Handles moving forward/backward */
 	void MoveForward(float Val);
 
@@ -96,9 +258,98 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
 	class UAnimMontage* FireAnimation;
 
+	// Maximum number of shots sent in one fire batch, the server rejects bigger batches.
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	int32 MaxShotsPerBatch;
+
+	// Maximum distance between the character and a shot's origin the server still accepts.
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float MaxFireOriginDistance;
+
+	// Minimum server time between two shots, the server drops shots fired faster.
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float MinFireInterval;
+
+	// Seconds a shot's timestamp may lie behind the server's clock, older shots are dropped.
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float MaxShotAge;
+
+	// Fastest a projectile of this character moves, bounds how far from its shot's origin a hit can start.
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float MaxProjectileSpeed;
+
+	// Hit claims a client may send per second, more are dropped. Every claim needs a shot of its own.
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	int32 MaxHitClaimsPerSecond;
+
+	// Seconds a predicted shot is tracked for a server rejection, its projectile keeps flying either way.
+	UPROPERTY(EditDefaultsOnly, Category = Gameplay)
+	float PredictionTimeout;
+
+	// Damage applied by a confirmed projectile hit.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Gameplay)
+	float HitDamage;
+
+	// Net update frequency while another player is within NearNetUpdateDistance.
+	UPROPERTY(EditDefaultsOnly, Category = Replication)
+	float NearNetUpdateFrequency;
+
+	// Net update frequency once every other player is beyond FarNetUpdateDistance.
+	UPROPERTY(EditDefaultsOnly, Category = Replication)
+	float FarNetUpdateFrequency;
+
+	UPROPERTY(EditDefaultsOnly, Category = Replication)
+	float NearNetUpdateDistance;
+
+	UPROPERTY(EditDefaultsOnly, Category = Replication)
+	float FarNetUpdateDistance;
+
+	// Characters further away than this are not replicated to a player.
+	UPROPERTY(EditDefaultsOnly, Category = Replication)
+	float CharacterNetCullDistance;
+
+	// Seconds a character stays relevant up to FireRelevancyDistance after firing.
+	UPROPERTY(EditDefaultsOnly, Category = Replication)
+	float FireRelevancyTime;
+
+	UPROPERTY(EditDefaultsOnly, Category = Replication)
+	float FireRelevancyDistance;
+
 	TouchData TouchItem;
 
 private:
+	// Scales the net update frequency by the distance to the nearest other player.
+	void UpdateNetUpdateFrequency();
+
+	// Returns where the server recorded the character at a server world time, its current location without history.
+	FVector GetLocationAtTime(float Time) const;
+
+	// Server world time of the last accepted shot.
+	float LastFireTime;
+
+	// Timestamp the client gave the last accepted shot, the next one has to be MinFireInterval newer.
+	float LastShotTimestamp;
+
+	FTimerHandle NetUpdateFrequencyTimerHandle;
+
+	// Shots fired since the last batch was sent.
+	TArray<FOFireShot> PendingShots;
+
+	// Shots this client predicted and the server has neither replayed nor rejected yet, oldest first.
+	TArray<FOPredictedShot> PredictedShots;
+
+	// Last prediction key handed out, 0 is never used.
+	uint16 LastPredictionKey;
+
+	// Shots of the owning client the server accepted and may still get a hit for, oldest first. Server only.
+	TArray<FOAcceptedShot> AcceptedShotHistory;
+
+	// Server world time the current second of hit claims started.
+	float HitClaimWindowStart;
+
+	// Hit claims received since HitClaimWindowStart.
+	int32 NumHitClaimsInWindow;
+
 	// Pawn mesh: 1st person view (arms; seen only by self).
 	UPROPERTY(VisibleDefaultsOnly, Category = Mesh)
 	class USkeletalMeshComponent* Mesh1P;
@@ -114,4 +365,8 @@ private:
 	// First person camera.
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* FirstPersonCameraComponent;
+
+	// Server side capsule history used to check the hits clients report.
+	UPROPERTY(VisibleDefaultsOnly, Category = Gameplay)
+	class UOLagCompensationComponent* LagCompensation;
 };
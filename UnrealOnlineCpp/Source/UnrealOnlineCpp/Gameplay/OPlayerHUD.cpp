@@ -1,12 +1,15 @@
 // Copyright (c) 2019 Jasper Drescher.
 
 #include "OPlayerHUD.h"
+#include "../Core/OStats.h"
 #include "Engine/Canvas.h"
 #include "Engine/Texture2D.h"
 #include "TextureResource.h"
 #include "CanvasItem.h"
 #include "UObject/ConstructorHelpers.h"
 
+O_DECLARE_CYCLE_STAT("Draw HUD", STAT_ODrawHUD);
+
 AOPlayerHUD::AOPlayerHUD()
 {
 	// Set the crosshair texture
@@ -23,6 +26,8 @@ AOPlayerHUD::AOPlayerHUD()
 
 void AOPlayerHUD::DrawHUD()
 {
+	O_SCOPE_CYCLE_COUNTER(STAT_ODrawHUD);
+
 	Super::DrawHUD();
 
 	// Draw very simple crosshair
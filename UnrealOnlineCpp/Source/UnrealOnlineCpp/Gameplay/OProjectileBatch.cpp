@@ -0,0 +1,472 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OProjectileBatch.h"
+#include "OPlayerCharacter.h"
+#include "OProjectilePool.h"
+#include "OWeaponProjectile.h"
+#include "../Core/OStats.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogProjectileBatch, Log, All);
+
+O_DECLARE_CYCLE_STAT("Projectile Batch Tick", STAT_OProjectileBatchTick);
+
+static TAutoConsoleVariable<int32> CVarLightweightProjectiles(
+	TEXT("o.Projectile.Lightweight"),
+	0,
+	TEXT("Fire shots into the projectile batch instead of spawning projectile actors.\n")
+	TEXT("0: projectile actors (default)\n")
+	TEXT("1: lightweight batched projectiles"),
+	ECVF_Default);
+
+static void ProjectileBenchmark(const TArray<FString>& Args, UWorld* World)
+{
+	TArray<int32> Counts;
+	for (const FString& Arg : Args)
+	{
+		Counts.Add(FCString::Atoi(*Arg));
+	}
+
+	if (Counts.Num() == 0)
+	{
+		Counts = { 1000, 10000, 50000 };
+	}
+
+	AOProjectileBatch::StartBenchmark(World, Counts);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs ProjectileBenchmarkCommand(
+	TEXT("o.Projectile.Benchmark"),
+	TEXT("Compares the frame time of actor and batched projectiles. Usage: o.Projectile.Benchmark [Count ...], defaults to 1000 10000 50000"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&ProjectileBenchmark));
+
+namespace ProjectileBenchmarkSettings
+{
+	// Frames skipped after setting up a step, so spawning doesn't show up in the numbers
+	const int32 WarmupFrames = 5;
+
+	// Frames measured per step
+	const int32 MeasuredFrames = 60;
+
+	// Lifetime long enough to outlive a step
+	const float LifeTime = 3600.0f;
+}
+
+AOProjectileBatch::AOProjectileBatch()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = true;
+
+	// Every machine simulates its own rows
+	bReplicates = false;
+
+	InstancedMesh = CreateDefaultSubobject<UInstancedStaticMeshComponent>(TEXT("InstancedMesh"));
+	InstancedMesh->SetMobility(EComponentMobility::Movable);
+	InstancedMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	InstancedMesh->CastShadow = false;
+	RootComponent = InstancedMesh;
+
+	ProjectileSpeed = 3000.0f;
+	GravityScale = 0.0f;
+	LifeTime = 3.0f;
+	MaxProjectiles = 65536;
+	TraceChannel = ECC_Visibility;
+
+	bIsBenchmark = false;
+	BenchmarkMode = EBenchmarkMode::None;
+	BenchmarkCountIndex = 0;
+	BenchmarkFrame = 0;
+	BenchmarkFrameStartTime = 0.0;
+	BenchmarkFrameTime = 0.0;
+	BenchmarkActorFrameTime = 0.0;
+	BenchmarkSimulationTime = 0.0;
+}
+
+AOProjectileBatch* AOProjectileBatch::Get(UWorld* World, bool bCreateIfMissing)
+{
+	if (World == nullptr)
+	{
+		return nullptr;
+	}
+
+	for (TActorIterator<AOProjectileBatch> It(World); It; ++It)
+	{
+		if (!It->IsPendingKill() && !It->bIsBenchmark)
+		{
+			return *It;
+		}
+	}
+
+	if (!bCreateIfMissing || World->bIsTearingDown)
+	{
+		return nullptr;
+	}
+
+	return Spawn(World);
+}
+
+AOProjectileBatch* AOProjectileBatch::Spawn(UWorld* World)
+{
+	// Rows are stored in world space, so the instanced mesh has to sit at the origin
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	return World->SpawnActor<AOProjectileBatch>(FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+}
+
+bool AOProjectileBatch::IsEnabled()
+{
+	return CVarLightweightProjectiles.GetValueOnGameThread() != 0;
+}
+
+void AOProjectileBatch::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (GetNetMode() != NM_DedicatedServer && !ProjectileMesh.IsNull())
+	{
+		InstancedMesh->SetStaticMesh(ProjectileMesh.LoadSynchronous());
+	}
+}
+
+void AOProjectileBatch::AddProjectile(const FVector& Location, const FVector& Direction, AActor* InOwner, uint16 PredictionKey)
+{
+	if (Num() >= MaxProjectiles)
+	{
+		return;
+	}
+
+	const FVector Velocity = Direction * ProjectileSpeed;
+
+	PositionX.Add(Location.X);
+	PositionY.Add(Location.Y);
+	PositionZ.Add(Location.Z);
+	VelocityX.Add(Velocity.X);
+	VelocityY.Add(Velocity.Y);
+	VelocityZ.Add(Velocity.Z);
+	LifeTimes.Add(LifeTime);
+	Owners.Add(InOwner);
+	PredictionKeys.Add(PredictionKey);
+	TraceHandles.AddDefaulted();
+}
+
+void AOProjectileBatch::Reset()
+{
+	PositionX.Reset();
+	PositionY.Reset();
+	PositionZ.Reset();
+	VelocityX.Reset();
+	VelocityY.Reset();
+	VelocityZ.Reset();
+	LifeTimes.Reset();
+	Owners.Reset();
+	PredictionKeys.Reset();
+	TraceHandles.Reset();
+
+	UpdateInstances();
+}
+
+void AOProjectileBatch::Tick(float DeltaSeconds)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OProjectileBatchTick);
+
+	Super::Tick(DeltaSeconds);
+
+	TickBenchmark();
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	ResolveTraces();
+	Integrate(DeltaSeconds);
+	IssueTraces(DeltaSeconds);
+	UpdateInstances();
+
+	BenchmarkSimulationTime += FPlatformTime::Seconds() - StartTime;
+}
+
+void AOProjectileBatch::ResolveTraces()
+{
+	UWorld* World = GetWorld();
+
+	// Walk backwards so swapping the last row in doesn't skip anything
+	for (int32 Index = Num() - 1; Index >= 0; --Index)
+	{
+		FTraceDatum TraceDatum;
+		if (TraceHandles[Index].IsValid() && World->QueryTraceData(TraceHandles[Index], TraceDatum))
+		{
+			if (TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].bBlockingHit)
+			{
+				// Same as a projectile actor, only the shooter's own machine reports the hit
+				const FHitResult& Hit = TraceDatum.OutHits[0];
+				AOPlayerCharacter* Shooter = Cast<AOPlayerCharacter>(Owners[Index].Get());
+				AOPlayerCharacter* Target = Cast<AOPlayerCharacter>(Hit.GetActor());
+				if (Shooter != nullptr && Target != nullptr && Shooter->IsLocallyControlled())
+				{
+					Shooter->ReportHit(Target, Hit, PredictionKeys[Index]);
+				}
+
+				RemoveProjectile(Index);
+			}
+		}
+	}
+}
+
+void AOProjectileBatch::Integrate(float DeltaSeconds)
+{
+	const int32 Count = Num();
+	const float GravityDelta = GetWorld()->GetGravityZ() * GravityScale * DeltaSeconds;
+
+	// Plain loops over contiguous floats, so the compiler can vectorize them
+	float* RESTRICT VelZ = VelocityZ.GetData();
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		VelZ[Index] += GravityDelta;
+	}
+
+	float* RESTRICT PosX = PositionX.GetData();
+	float* RESTRICT PosY = PositionY.GetData();
+	float* RESTRICT PosZ = PositionZ.GetData();
+	const float* RESTRICT VelX = VelocityX.GetData();
+	const float* RESTRICT VelY = VelocityY.GetData();
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		PosX[Index] += VelX[Index] * DeltaSeconds;
+		PosY[Index] += VelY[Index] * DeltaSeconds;
+		PosZ[Index] += VelZ[Index] * DeltaSeconds;
+	}
+
+	float* RESTRICT Life = LifeTimes.GetData();
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		Life[Index] -= DeltaSeconds;
+	}
+
+	for (int32 Index = Count - 1; Index >= 0; --Index)
+	{
+		if (LifeTimes[Index] <= 0.0f)
+		{
+			RemoveProjectile(Index);
+		}
+	}
+}
+
+void AOProjectileBatch::IssueTraces(float DeltaSeconds)
+{
+	UWorld* World = GetWorld();
+
+	static const FName TraceTag(TEXT("ProjectileBatch"));
+	FCollisionQueryParams QueryParams(TraceTag, false);
+
+	for (int32 Index = 0; Index < Num(); ++Index)
+	{
+		const FVector Velocity(VelocityX[Index], VelocityY[Index], VelocityZ[Index]);
+		const FVector End(PositionX[Index], PositionY[Index], PositionZ[Index]);
+		const FVector Start = End - Velocity * DeltaSeconds;
+
+		QueryParams.ClearIgnoredActors();
+		if (AActor* ProjectileOwner = Owners[Index].Get())
+		{
+			QueryParams.AddIgnoredActor(ProjectileOwner);
+		}
+
+		TraceHandles[Index] = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, Start, End, TraceChannel, QueryParams);
+	}
+}
+
+void AOProjectileBatch::RemoveProjectile(int32 Index)
+{
+	PositionX.RemoveAtSwap(Index, 1, false);
+	PositionY.RemoveAtSwap(Index, 1, false);
+	PositionZ.RemoveAtSwap(Index, 1, false);
+	VelocityX.RemoveAtSwap(Index, 1, false);
+	VelocityY.RemoveAtSwap(Index, 1, false);
+	VelocityZ.RemoveAtSwap(Index, 1, false);
+	LifeTimes.RemoveAtSwap(Index, 1, false);
+	Owners.RemoveAtSwap(Index, 1, false);
+	PredictionKeys.RemoveAtSwap(Index, 1, false);
+	TraceHandles.RemoveAtSwap(Index, 1, false);
+}
+
+void AOProjectileBatch::UpdateInstances()
+{
+	if (InstancedMesh->GetStaticMesh() == nullptr)
+	{
+		return;
+	}
+
+	const int32 Count = Num();
+
+	while (InstancedMesh->GetInstanceCount() > Count)
+	{
+		InstancedMesh->RemoveInstance(InstancedMesh->GetInstanceCount() - 1);
+	}
+
+	while (InstancedMesh->GetInstanceCount() < Count)
+	{
+		InstancedMesh->AddInstance(FTransform::Identity);
+	}
+
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FVector Location(PositionX[Index], PositionY[Index], PositionZ[Index]);
+		const FVector Velocity(VelocityX[Index], VelocityY[Index], VelocityZ[Index]);
+
+		// Only mark the render state dirty once, for the last instance
+		InstancedMesh->UpdateInstanceTransform(Index, FTransform(Velocity.Rotation(), Location), true, Index == Count - 1, true);
+	}
+}
+
+void AOProjectileBatch::StartBenchmark(UWorld* World, const TArray<int32>& Counts)
+{
+	if (World == nullptr || World->bIsTearingDown)
+	{
+		return;
+	}
+
+	for (TActorIterator<AOProjectileBatch> It(World); It; ++It)
+	{
+		if (!It->IsPendingKill() && It->bIsBenchmark)
+		{
+			UE_LOG(LogProjectileBatch, Warning, TEXT("Projectile benchmark is already running"));
+			return;
+		}
+	}
+
+	AOProjectileBatch* BenchmarkBatch = Spawn(World);
+	if (BenchmarkBatch == nullptr)
+	{
+		return;
+	}
+
+	BenchmarkBatch->bIsBenchmark = true;
+	BenchmarkBatch->BenchmarkCounts = Counts;
+	BenchmarkBatch->BenchmarkCountIndex = 0;
+
+	BenchmarkBatch->StartBenchmarkStep();
+}
+
+void AOProjectileBatch::StartBenchmarkStep()
+{
+	Reset();
+
+	if (!BenchmarkCounts.IsValidIndex(BenchmarkCountIndex))
+	{
+		BenchmarkMode = EBenchmarkMode::None;
+		UE_LOG(LogProjectileBatch, Log, TEXT("Projectile benchmark finished"));
+		Destroy();
+		return;
+	}
+
+	const int32 Count = BenchmarkCounts[BenchmarkCountIndex];
+
+	// Fixed seed, so every run fires the same pattern high above the level
+	FRandomStream RandomStream(1234);
+	auto RandomOrigin = [&RandomStream]()
+	{
+		return FVector(RandomStream.FRandRange(-10000.0f, 10000.0f), RandomStream.FRandRange(-10000.0f, 10000.0f), 100000.0f);
+	};
+	auto RandomDirection = [&RandomStream]()
+	{
+		return FRotator(0.0f, RandomStream.FRandRange(0.0f, 360.0f), 0.0f);
+	};
+
+	BenchmarkFrame = 0;
+	BenchmarkFrameTime = 0.0;
+	BenchmarkSimulationTime = 0.0;
+	BenchmarkFrameStartTime = FPlatformTime::Seconds();
+
+	if (BenchmarkMode == EBenchmarkMode::None || BenchmarkMode == EBenchmarkMode::Batch)
+	{
+		BenchmarkMode = EBenchmarkMode::Actors;
+		BenchmarkActorFrameTime = 0.0;
+
+		const AOPlayerCharacter* PlayerCharacter = Cast<AOPlayerCharacter>(UGameplayStatics::GetPlayerPawn(this, 0));
+		AOProjectilePool* ProjectilePool = AOProjectilePool::Get(GetWorld());
+		if (PlayerCharacter != nullptr && PlayerCharacter->ProjectileClass != nullptr && ProjectilePool != nullptr)
+		{
+			BenchmarkActors.Reserve(Count);
+			for (int32 Index = 0; Index < Count; ++Index)
+			{
+				AOWeaponProjectile* Projectile = ProjectilePool->Acquire(PlayerCharacter->ProjectileClass, RandomOrigin(), RandomDirection(), nullptr);
+				if (Projectile != nullptr)
+				{
+					Projectile->SetLifeSpan(ProjectileBenchmarkSettings::LifeTime);
+					BenchmarkActors.Add(Projectile);
+				}
+			}
+		}
+		else
+		{
+			UE_LOG(LogProjectileBatch, Warning, TEXT("Projectile benchmark: no player projectile class, actor mode is measured empty"));
+		}
+	}
+	else
+	{
+		BenchmarkMode = EBenchmarkMode::Batch;
+
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			AddProjectile(RandomOrigin(), RandomDirection().Vector(), nullptr);
+			LifeTimes.Last() = ProjectileBenchmarkSettings::LifeTime;
+		}
+	}
+}
+
+void AOProjectileBatch::TickBenchmark()
+{
+	if (BenchmarkMode == EBenchmarkMode::None)
+	{
+		return;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (BenchmarkFrame == ProjectileBenchmarkSettings::WarmupFrames)
+	{
+		BenchmarkSimulationTime = 0.0;
+	}
+	else if (BenchmarkFrame > ProjectileBenchmarkSettings::WarmupFrames)
+	{
+		BenchmarkFrameTime += Now - BenchmarkFrameStartTime;
+	}
+
+	BenchmarkFrameStartTime = Now;
+
+	if (++BenchmarkFrame <= ProjectileBenchmarkSettings::WarmupFrames + ProjectileBenchmarkSettings::MeasuredFrames)
+	{
+		return;
+	}
+
+	const double MillisecondsPerFrame = BenchmarkFrameTime * 1000.0 / ProjectileBenchmarkSettings::MeasuredFrames;
+
+	if (BenchmarkMode == EBenchmarkMode::Actors)
+	{
+		BenchmarkActorFrameTime = MillisecondsPerFrame;
+
+		for (const TWeakObjectPtr<AOWeaponProjectile>& Projectile : BenchmarkActors)
+		{
+			if (Projectile.IsValid())
+			{
+				Projectile->Recycle();
+			}
+		}
+
+		BenchmarkActors.Reset();
+	}
+	else
+	{
+		const double SimulationMillisecondsPerFrame = BenchmarkSimulationTime * 1000.0 / ProjectileBenchmarkSettings::MeasuredFrames;
+
+		UE_LOG(LogProjectileBatch, Log, TEXT("Projectile benchmark: %6d projectiles | actor mode %8.3f ms/frame | batch mode %8.3f ms/frame (batch simulation %8.3f ms/frame)"),
+			BenchmarkCounts[BenchmarkCountIndex], BenchmarkActorFrameTime, MillisecondsPerFrame, SimulationMillisecondsPerFrame);
+
+		BenchmarkCountIndex++;
+	}
+
+	StartBenchmarkStep();
+}
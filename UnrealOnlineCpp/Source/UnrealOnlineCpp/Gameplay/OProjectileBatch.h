@@ -0,0 +1,153 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "WorldCollision.h"
+#include "OProjectileBatch.generated.h"
+
+class AOWeaponProjectile;
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+
+/**
+ * Lightweight projectile mode. Instead of one actor per bullet, every projectile of a world is a row in a set of
+ * flat arrays that is advanced in one pass per frame. Collision uses async line traces that are issued in one batch
+ * and resolved on the next frame, and rendering goes through a single instanced static mesh.
+ *
+ * Enabled with o.Projectile.Lightweight 1.
+ */
+UCLASS(config = Game, notplaceable)
+class UNREALONLINECPP_API AOProjectileBatch : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AOProjectileBatch();
+
+	/**
+	 * Returns the projectile batch of a world.
+	 *
+	 * @param World: world the batch lives in.
+	 * @param bCreateIfMissing: spawn a batch if the world does not have one yet.
+	 */
+	static AOProjectileBatch* Get(UWorld* World, bool bCreateIfMissing = true);
+
+	// Returns true if shots should be added to the batch instead of firing projectile actors.
+	static bool IsEnabled();
+
+	/**
+	 * Appends a projectile row.
+	 *
+	 * @param Location: world location to fire from.
+	 * @param Direction: normalized fire direction.
+	 * @param InOwner: actor that fired the projectile, its own collision is ignored.
+	 * @param PredictionKey: key of the shot, the owner claims hits of the projectile with it.
+	 */
+	void AddProjectile(const FVector& Location, const FVector& Direction, AActor* InOwner, uint16 PredictionKey = 0);
+
+	// Removes every projectile.
+	void Reset();
+
+	// Returns the number of projectiles in flight.
+	FORCEINLINE int32 Num() const { return LifeTimes.Num(); }
+
+	/**
+	 * Compares the frame time of actor projectiles and batched projectiles for each count. The batched rows go into a
+	 * batch of their own, which destroys itself when done, so the projectiles in play are left alone.
+	 *
+	 * @param World: world to measure in.
+	 * @param Counts: numbers of simultaneous projectiles to measure.
+	 */
+	static void StartBenchmark(UWorld* World, const TArray<int32>& Counts);
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void Tick(float DeltaSeconds) override;
+
+private:
+	// Spawns an empty batch at the origin.
+	static AOProjectileBatch* Spawn(UWorld* World);
+
+	// Kills the rows whose traces of the previous frame hit something, and reports the players they hit.
+	void ResolveTraces();
+
+	// Advances every row and counts down their lifetimes.
+	void Integrate(float DeltaSeconds);
+
+	// Queues one async line trace per row for the distance it moved this frame.
+	void IssueTraces(float DeltaSeconds);
+
+	// Removes a row by swapping the last row into its place.
+	void RemoveProjectile(int32 Index);
+
+	// Matches the instanced mesh to the rows.
+	void UpdateInstances();
+
+	void TickBenchmark();
+
+	void StartBenchmarkStep();
+
+public:
+	// Speed of a projectile when fired, in units per second.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Batch")
+	float ProjectileSpeed;
+
+	// Scale applied to the world gravity.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Batch")
+	float GravityScale;
+
+	// Seconds a projectile stays alive.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Batch")
+	float LifeTime;
+
+	// Projectiles beyond this count are not added.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Batch")
+	int32 MaxProjectiles;
+
+	// Channel the projectiles trace on.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Batch")
+	TEnumAsByte<ECollisionChannel> TraceChannel;
+
+	// Mesh drawn for every projectile, nothing is drawn if unset.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Batch")
+	TSoftObjectPtr<UStaticMesh> ProjectileMesh;
+
+private:
+	UPROPERTY(VisibleDefaultsOnly, Category = "Projectile|Batch")
+	UInstancedStaticMeshComponent* InstancedMesh;
+
+	// Projectile rows, one entry per projectile in every array
+	TArray<float> PositionX;
+	TArray<float> PositionY;
+	TArray<float> PositionZ;
+	TArray<float> VelocityX;
+	TArray<float> VelocityY;
+	TArray<float> VelocityZ;
+	TArray<float> LifeTimes;
+	TArray<TWeakObjectPtr<AActor>> Owners;
+	TArray<uint16> PredictionKeys;
+	TArray<FTraceHandle> TraceHandles;
+
+	// Benchmark state
+	enum class EBenchmarkMode : uint8
+	{
+		None,
+		Actors,
+		Batch
+	};
+
+	// Set on the batch a benchmark runs in, Get never returns it
+	bool bIsBenchmark;
+	EBenchmarkMode BenchmarkMode;
+	TArray<int32> BenchmarkCounts;
+	int32 BenchmarkCountIndex;
+	int32 BenchmarkFrame;
+	double BenchmarkFrameStartTime;
+	double BenchmarkFrameTime;
+	double BenchmarkActorFrameTime;
+	double BenchmarkSimulationTime;
+	TArray<TWeakObjectPtr<AOWeaponProjectile>> BenchmarkActors;
+};
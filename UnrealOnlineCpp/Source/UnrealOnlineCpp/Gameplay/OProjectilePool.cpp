@@ -0,0 +1,218 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OProjectilePool.h"
+#include "OWeaponProjectile.h"
+#include "../Core/OStats.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogProjectilePool, Log, All);
+
+O_DECLARE_CYCLE_STAT("Projectile Acquire", STAT_OProjectileAcquire);
+O_DECLARE_CYCLE_STAT("Projectile Release", STAT_OProjectileRelease);
+
+AOProjectilePool::AOProjectilePool()
+{
+	// The pool only hands out and takes back projectiles, it never needs to tick
+	PrimaryActorTick.bCanEverTick = false;
+
+	// Every machine keeps its own pool
+	bReplicates = false;
+
+	PrewarmCount = 32;
+	MaxPooledCount = 256;
+}
+
+AOProjectilePool* AOProjectilePool::Get(UWorld* World, bool bCreateIfMissing)
+{
+	if (World == nullptr)
+	{
+		return nullptr;
+	}
+
+	for (TActorIterator<AOProjectilePool> It(World); It; ++It)
+	{
+		if (!It->IsPendingKill())
+		{
+			return *It;
+		}
+	}
+
+	if (!bCreateIfMissing || World->bIsTearingDown)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	return World->SpawnActor<AOProjectilePool>(SpawnParams);
+}
+
+void AOProjectilePool::Prewarm(TSubclassOf<AOWeaponProjectile> ProjectileClass)
+{
+	if (ProjectileClass == nullptr)
+	{
+		return;
+	}
+
+	// Projectiles in flight are not in the pool, topping it up again would count them twice
+	bool bAlreadyPrewarmed = false;
+	PrewarmedClasses.Add(ProjectileClass, &bAlreadyPrewarmed);
+	if (bAlreadyPrewarmed)
+	{
+		return;
+	}
+
+	FOProjectileList& ProjectileList = PooledProjectiles.FindOrAdd(ProjectileClass);
+	ProjectileList.Projectiles.Reserve(FMath::Min(PrewarmCount, MaxPooledCount));
+
+	while (ProjectileList.Projectiles.Num() < PrewarmCount)
+	{
+		AOWeaponProjectile* Projectile = SpawnProjectile(ProjectileClass);
+		if (Projectile == nullptr)
+		{
+			break;
+		}
+
+		ProjectileList.Projectiles.Push(Projectile);
+	}
+}
+
+AOWeaponProjectile* AOProjectilePool::Acquire(TSubclassOf<AOWeaponProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, APawn* InInstigator)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OProjectileAcquire);
+
+	if (ProjectileClass == nullptr)
+	{
+		return nullptr;
+	}
+
+	AOWeaponProjectile* Projectile = nullptr;
+
+	// Projectiles can still get destroyed from outside the pool (Blueprints, level streaming), so skip those
+	FOProjectileList& ProjectileList = PooledProjectiles.FindOrAdd(ProjectileClass);
+	while (Projectile == nullptr && ProjectileList.Projectiles.Num() > 0)
+	{
+		AOWeaponProjectile* Candidate = ProjectileList.Projectiles.Pop(false);
+		if (Candidate != nullptr && !Candidate->IsPendingKill())
+		{
+			Projectile = Candidate;
+		}
+	}
+
+	if (Projectile != nullptr)
+	{
+		Stats.Hits++;
+	}
+	else
+	{
+		Projectile = SpawnProjectile(ProjectileClass);
+		if (Projectile == nullptr)
+		{
+			return nullptr;
+		}
+
+		Stats.Misses++;
+	}
+
+	Stats.InUse++;
+	Stats.HighWaterMark = FMath::Max(Stats.HighWaterMark, Stats.InUse);
+
+	Projectile->SetOwner(InInstigator);
+	Projectile->Instigator = InInstigator;
+	Projectile->ActivateFromPool(Location, Rotation);
+
+	// Same behaviour as spawning with AdjustIfPossibleButDontSpawnIfColliding
+	FVector AdjustedLocation = Location;
+	FRotator AdjustedRotation = Rotation;
+	if (!GetWorld()->FindTeleportSpot(Projectile, AdjustedLocation, AdjustedRotation))
+	{
+		Release(Projectile);
+		return nullptr;
+	}
+
+	if (!AdjustedLocation.Equals(Location))
+	{
+		Projectile->SetActorLocation(AdjustedLocation, false, nullptr, ETeleportType::TeleportPhysics);
+	}
+
+	return Projectile;
+}
+
+void AOProjectilePool::Release(AOWeaponProjectile* Projectile)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OProjectileRelease);
+
+	if (Projectile == nullptr || Projectile->IsPooled())
+	{
+		return;
+	}
+
+	Projectile->DeactivateToPool();
+	Stats.InUse = FMath::Max(Stats.InUse - 1, 0);
+
+	FOProjectileList& ProjectileList = PooledProjectiles.FindOrAdd(Projectile->GetClass());
+	if (ProjectileList.Projectiles.Num() < MaxPooledCount)
+	{
+		ProjectileList.Projectiles.Push(Projectile);
+	}
+	else
+	{
+		Projectile->Destroy();
+	}
+}
+
+void AOProjectilePool::ResetStats()
+{
+	const int32 InUse = Stats.InUse;
+
+	Stats = FOProjectilePoolStats();
+	Stats.InUse = InUse;
+	Stats.HighWaterMark = InUse;
+}
+
+void AOProjectilePool::GetSeamlessTravelActors(TArray<AActor*>& ActorList)
+{
+	ActorList.Add(this);
+
+	for (TPair<UClass*, FOProjectileList>& ProjectileList : PooledProjectiles)
+	{
+		ProjectileList.Value.Projectiles.RemoveAll([](const AOWeaponProjectile* Projectile)
+		{
+			return Projectile == nullptr || Projectile->IsPendingKill();
+		});
+
+		ActorList.Append(ProjectileList.Value.Projectiles);
+	}
+
+	// In flight projectiles are destroyed with the old map and never come back
+	Stats.InUse = 0;
+}
+
+void AOProjectilePool::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Used to size PrewarmCount and MaxPooledCount per map
+	UE_LOG(LogProjectilePool, Log, TEXT("Projectile pool stats: Hits %d | Misses %d | InUse %d | HighWaterMark %d"), Stats.Hits, Stats.Misses, Stats.InUse, Stats.HighWaterMark);
+
+	PooledProjectiles.Empty();
+	PrewarmedClasses.Empty();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+AOWeaponProjectile* AOProjectilePool::SpawnProjectile(TSubclassOf<AOWeaponProjectile> ProjectileClass)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	AOWeaponProjectile* Projectile = GetWorld()->SpawnActor<AOWeaponProjectile>(ProjectileClass, GetActorLocation(), FRotator::ZeroRotator, SpawnParams);
+	if (Projectile != nullptr)
+	{
+		Projectile->DeactivateToPool();
+	}
+
+	return Projectile;
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "OProjectilePool.generated.h"
+
+class AOWeaponProjectile;
+
+USTRUCT(BlueprintType)
+struct FOProjectilePoolStats
+{
+	GENERATED_BODY()
+
+public:
+	// Number of requests served by a sleeping projectile.
+	UPROPERTY(BlueprintReadOnly, Category = "Projectile|Pool")
+	int32 Hits = 0;
+
+	// Number of requests that had to spawn a new projectile.
+	UPROPERTY(BlueprintReadOnly, Category = "Projectile|Pool")
+	int32 Misses = 0;
+
+	// Number of projectiles currently in flight.
+	UPROPERTY(BlueprintReadOnly, Category = "Projectile|Pool")
+	int32 InUse = 0;
+
+	// Highest number of projectiles that were in flight at the same time.
+	UPROPERTY(BlueprintReadOnly, Category = "Projectile|Pool")
+	int32 HighWaterMark = 0;
+};
+
+USTRUCT()
+struct FOProjectileList
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	TArray<AOWeaponProjectile*> Projectiles;
+};
+
+/**
+ * Per-world pool of sleeping projectiles. Firing takes a projectile out of the pool instead of spawning
+ * a new actor, and projectiles return to it on impact or when their lifetime runs out.
+ */
+UCLASS(config = Game, notplaceable)
+class UNREALONLINECPP_API AOProjectilePool : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AOProjectilePool();
+
+	/**
+	 * Returns the projectile pool of a world.
+	 *
+	 * @param World: world the pool lives in.
+	 * @param bCreateIfMissing: spawn a pool if the world does not have one yet.
+	 */
+	static AOProjectilePool* Get(UWorld* World, bool bCreateIfMissing = true);
+
+	/**
+	 * Spawns PrewarmCount sleeping projectiles of a class, once per class. Every character prewarms its class when it
+	 * begins play, the pool would otherwise grow by the projectiles in flight each time.
+	 *
+	 * @param ProjectileClass: class of the projectiles to create.
+	 */
+	void Prewarm(TSubclassOf<AOWeaponProjectile> ProjectileClass);
+
+	/**
+	 * Takes a projectile out of the pool, or spawns a new one if the pool is empty.
+	 *
+	 * @param ProjectileClass: class of the projectile to fire.
+	 * @param Location: world location to fire from.
+	 * @param Rotation: world rotation to fire along.
+	 * @param InInstigator: pawn that fired the projectile.
+	 * @returns the active projectile, or nullptr if it would spawn inside blocking geometry.
+	 */
+	AOWeaponProjectile* Acquire(TSubclassOf<AOWeaponProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, APawn* InInstigator);
+
+	/**
+	 * Puts a projectile back to sleep so it can be reused.
+	 *
+	 * @param Projectile: projectile that hit something or ran out of lifetime.
+	 */
+	void Release(AOWeaponProjectile* Projectile);
+
+	// Returns the hit, miss and high-water mark counters of this pool.
+	UFUNCTION(BlueprintPure, Category = "Projectile|Pool")
+	FORCEINLINE FOProjectilePoolStats GetStats() const { return Stats; }
+
+	// Resets the hit, miss and high-water mark counters.
+	UFUNCTION(BlueprintCallable, Category = "Projectile|Pool")
+	void ResetStats();
+
+	/**
+	 * Adds the pool and its sleeping projectiles to the actors kept by a seamless travel, so the next map starts with
+	 * a warm pool. Projectiles in flight are left behind with the old map.
+	 *
+	 * @param ActorList: actors the travel keeps.
+	 */
+	void GetSeamlessTravelActors(TArray<AActor*>& ActorList);
+
+protected:
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	AOWeaponProjectile* SpawnProjectile(TSubclassOf<AOWeaponProjectile> ProjectileClass);
+
+public:
+	// Number of sleeping projectiles created per class before the first shot.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Pool")
+	int32 PrewarmCount;
+
+	// Maximum number of sleeping projectiles kept per class, extra ones are destroyed on release.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Projectile|Pool")
+	int32 MaxPooledCount;
+
+private:
+	// Sleeping projectiles, per class.
+	UPROPERTY(Transient)
+	TMap<UClass*, FOProjectileList> PooledProjectiles;
+
+	// Classes that were prewarmed already.
+	UPROPERTY(Transient)
+	TSet<UClass*> PrewarmedClasses;
+
+	FOProjectilePoolStats Stats;
+};
@@ -0,0 +1,342 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#include "OWeaponEffects.h"
+#include "../Core/OStats.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimMontage.h"
+#include "AudioDevice.h"
+#include "Components/AudioComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Sound/SoundBase.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogWeaponEffects, Log, All);
+
+O_DECLARE_CYCLE_STAT("Play Fire Sound", STAT_OPlayFireSound);
+O_DECLARE_CYCLE_STAT("Play Fire Montage", STAT_OPlayFireMontage);
+
+static TAutoConsoleVariable<int32> CVarPooledWeaponEffects(
+	TEXT("o.WeaponEffects.Pooled"),
+	1,
+	TEXT("0: every shot spawns its own sound and restarts its montage\n")
+	TEXT("1: fire sounds play on pooled, limited voices and montages are skipped when nobody sees them (default)"),
+	ECVF_Default);
+
+static void WeaponEffectsReport(const TArray<FString>& Args, UWorld* World)
+{
+	AOWeaponEffects* WeaponEffects = AOWeaponEffects::Get(World, false);
+	if (WeaponEffects != nullptr)
+	{
+		WeaponEffects->LogStats();
+		WeaponEffects->ResetStats();
+	}
+}
+
+static FAutoConsoleCommandWithWorldAndArgs WeaponEffectsReportCommand(
+	TEXT("o.WeaponEffects.Report"),
+	TEXT("Logs active voices and merged or skipped fire effects since the last report."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&WeaponEffectsReport));
+
+AOWeaponEffects::AOWeaponEffects()
+{
+	// Ticks only to return finished voices to the pool
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickInterval = 0.1f;
+
+	// Every machine plays its own effects
+	bReplicates = false;
+
+	MaxVoicesPerSound = 6;
+	MaxVoices = 24;
+	MergeDistance = 2500.0f;
+	MergeRadius = 1000.0f;
+	MergeWindow = 0.1f;
+	MontageRenderTolerance = 0.2f;
+	MinMontageRestartTime = 0.1f;
+}
+
+AOWeaponEffects* AOWeaponEffects::Get(UWorld* World, bool bCreateIfMissing)
+{
+	if (World == nullptr)
+	{
+		return nullptr;
+	}
+
+	for (TActorIterator<AOWeaponEffects> It(World); It; ++It)
+	{
+		if (!It->IsPendingKill())
+		{
+			return *It;
+		}
+	}
+
+	if (!bCreateIfMissing || World->bIsTearingDown)
+	{
+		return nullptr;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+
+	return World->SpawnActor<AOWeaponEffects>(SpawnParams);
+}
+
+bool AOWeaponEffects::IsEnabled()
+{
+	return CVarPooledWeaponEffects.GetValueOnGameThread() != 0;
+}
+
+bool AOWeaponEffects::PlayFireSound(USoundBase* Sound, const FVector& Location)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OPlayFireSound);
+
+	if (Sound == nullptr)
+	{
+		return false;
+	}
+
+	if (!IsEnabled())
+	{
+		UGameplayStatics::PlaySoundAtLocation(this, Sound, Location);
+		return true;
+	}
+
+	// Dedicated servers and -nosound have nothing to play on
+	if (GetWorld()->GetAudioDevice() == nullptr)
+	{
+		return false;
+	}
+
+	FVector ListenerLocation = Location;
+	GetListenerLocation(ListenerLocation);
+
+	const float Distance = FVector::Dist(Location, ListenerLocation);
+	const float Now = GetWorld()->GetTimeSeconds();
+
+	FOWeaponVoiceList& VoiceList = Voices.FindOrAdd(Sound);
+
+	// Far away, one shot of a burst sounds like the whole burst
+	if (Distance > MergeDistance)
+	{
+		for (const FOWeaponVoice& Voice : VoiceList.Active)
+		{
+			if (Voice.Component != nullptr && Now - Voice.StartTime <= MergeWindow &&
+				FVector::DistSquared(Voice.Component->GetComponentLocation(), Location) <= FMath::Square(MergeRadius))
+			{
+				Stats.MergedSounds++;
+				return true;
+			}
+		}
+	}
+
+	// A closer shot takes over the farthest voice of its weapon, then the farthest of all weapons
+	if (VoiceList.Active.Num() >= MaxVoicesPerSound && !StealFarthestVoice(&VoiceList, ListenerLocation, Distance))
+	{
+		Stats.LimitedSounds++;
+		return false;
+	}
+
+	if (Stats.ActiveVoices >= MaxVoices && !StealFarthestVoice(nullptr, ListenerLocation, Distance))
+	{
+		Stats.LimitedSounds++;
+		return false;
+	}
+
+	UAudioComponent* Component = AcquireComponent(VoiceList);
+	Component->SetSound(Sound);
+	Component->SetWorldLocation(Location);
+	Component->Play();
+
+	FOWeaponVoice& Voice = VoiceList.Active.AddDefaulted_GetRef();
+	Voice.Component = Component;
+	Voice.StartTime = Now;
+
+	Stats.PlayedSounds++;
+	Stats.ActiveVoices++;
+	Stats.HighWaterMark = FMath::Max(Stats.HighWaterMark, Stats.ActiveVoices);
+
+	return true;
+}
+
+bool AOWeaponEffects::PlayFireMontage(USkeletalMeshComponent* Mesh, UAnimMontage* Montage)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OPlayFireMontage);
+
+	UAnimInstance* AnimInstance = (Mesh != nullptr && Montage != nullptr) ? Mesh->GetAnimInstance() : nullptr;
+	if (AnimInstance == nullptr)
+	{
+		return false;
+	}
+
+	if (IsEnabled())
+	{
+		// Nobody sees the arms of a character that is not on screen
+		if (!Mesh->WasRecentlyRendered(MontageRenderTolerance))
+		{
+			Stats.SkippedMontages++;
+			return false;
+		}
+
+		// Automatic fire would restart the montage every shot, the running one already shows the recoil
+		if (AnimInstance->Montage_IsPlaying(Montage) && AnimInstance->Montage_GetPosition(Montage) < MinMontageRestartTime)
+		{
+			Stats.SkippedMontages++;
+			return false;
+		}
+	}
+
+	AnimInstance->Montage_Play(Montage, 1.f);
+	Stats.PlayedMontages++;
+
+	return true;
+}
+
+void AOWeaponEffects::ResetStats()
+{
+	const int32 ActiveVoices = Stats.ActiveVoices;
+
+	Stats = FOWeaponEffectsStats();
+	Stats.ActiveVoices = ActiveVoices;
+	Stats.HighWaterMark = ActiveVoices;
+}
+
+void AOWeaponEffects::LogStats() const
+{
+	UE_LOG(LogWeaponEffects, Log, TEXT("Weapon effects stats: ActiveVoices %d | HighWaterMark %d | Played %d | Merged %d | Limited %d | Stolen %d | Montages %d | SkippedMontages %d"),
+		Stats.ActiveVoices, Stats.HighWaterMark, Stats.PlayedSounds, Stats.MergedSounds, Stats.LimitedSounds, Stats.StolenVoices, Stats.PlayedMontages, Stats.SkippedMontages);
+}
+
+void AOWeaponEffects::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	for (TPair<USoundBase*, FOWeaponVoiceList>& VoiceList : Voices)
+	{
+		for (int32 VoiceIdx = VoiceList.Value.Active.Num() - 1; VoiceIdx >= 0; VoiceIdx--)
+		{
+			const UAudioComponent* Component = VoiceList.Value.Active[VoiceIdx].Component;
+			if (Component == nullptr || !Component->IsPlaying())
+			{
+				StopVoice(VoiceList.Value, VoiceIdx);
+			}
+		}
+	}
+}
+
+void AOWeaponEffects::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Used to size MaxVoicesPerSound and MaxVoices per map
+	LogStats();
+
+	Voices.Empty();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+bool AOWeaponEffects::GetListenerLocation(FVector& OutLocation) const
+{
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	if (PlayerController == nullptr || !PlayerController->IsLocalController())
+	{
+		return false;
+	}
+
+	FVector FrontDir;
+	FVector RightDir;
+	PlayerController->GetAudioListenerPosition(OutLocation, FrontDir, RightDir);
+
+	return true;
+}
+
+bool AOWeaponEffects::StealFarthestVoice(FOWeaponVoiceList* VoiceList, const FVector& ListenerLocation, float Distance)
+{
+	FOWeaponVoiceList* FarthestVoiceList = nullptr;
+	int32 FarthestVoiceIdx = INDEX_NONE;
+	float FarthestDistanceSquared = FMath::Square(Distance);
+
+	auto FindFarthest = [&](FOWeaponVoiceList& CandidateList)
+	{
+		for (int32 VoiceIdx = 0; VoiceIdx < CandidateList.Active.Num(); VoiceIdx++)
+		{
+			const UAudioComponent* Component = CandidateList.Active[VoiceIdx].Component;
+			const float DistanceSquared = (Component != nullptr) ? FVector::DistSquared(Component->GetComponentLocation(), ListenerLocation) : MAX_flt;
+			if (DistanceSquared > FarthestDistanceSquared)
+			{
+				FarthestVoiceList = &CandidateList;
+				FarthestVoiceIdx = VoiceIdx;
+				FarthestDistanceSquared = DistanceSquared;
+			}
+		}
+	};
+
+	if (VoiceList != nullptr)
+	{
+		FindFarthest(*VoiceList);
+	}
+	else
+	{
+		for (TPair<USoundBase*, FOWeaponVoiceList>& CandidateList : Voices)
+		{
+			FindFarthest(CandidateList.Value);
+		}
+	}
+
+	if (FarthestVoiceList == nullptr)
+	{
+		return false;
+	}
+
+	StopVoice(*FarthestVoiceList, FarthestVoiceIdx);
+	Stats.StolenVoices++;
+
+	return true;
+}
+
+void AOWeaponEffects::StopVoice(FOWeaponVoiceList& VoiceList, int32 VoiceIdx)
+{
+	UAudioComponent* Component = VoiceList.Active[VoiceIdx].Component;
+	VoiceList.Active.RemoveAtSwap(VoiceIdx, 1, false);
+	Stats.ActiveVoices = FMath::Max(Stats.ActiveVoices - 1, 0);
+
+	if (Component == nullptr || Component->IsPendingKill())
+	{
+		return;
+	}
+
+	Component->Stop();
+
+	// A weapon never needs more idle components than it may play at once
+	if (VoiceList.Free.Num() < MaxVoicesPerSound)
+	{
+		VoiceList.Free.Push(Component);
+	}
+	else
+	{
+		Component->DestroyComponent();
+	}
+}
+
+UAudioComponent* AOWeaponEffects::AcquireComponent(FOWeaponVoiceList& VoiceList)
+{
+	while (VoiceList.Free.Num() > 0)
+	{
+		UAudioComponent* Component = VoiceList.Free.Pop(false);
+		if (Component != nullptr && !Component->IsPendingKill())
+		{
+			return Component;
+		}
+	}
+
+	UAudioComponent* Component = NewObject<UAudioComponent>(this);
+	Component->bAutoActivate = false;
+	Component->bAutoDestroy = false;
+	Component->bAllowSpatialization = true;
+	Component->RegisterComponent();
+
+	return Component;
+}
@@ -0,0 +1,182 @@
+// Copyright (c) 2019 Jasper Drescher.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "OWeaponEffects.generated.h"
+
+class UAnimMontage;
+class UAudioComponent;
+class USkeletalMeshComponent;
+class USoundBase;
+
+USTRUCT(BlueprintType)
+struct FOWeaponEffectsStats
+{
+	GENERATED_BODY()
+
+public:
+	// Number of fire sounds playing right now.
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 ActiveVoices = 0;
+
+	// Highest number of fire sounds that played at the same time.
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 HighWaterMark = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 PlayedSounds = 0;
+
+	// Shots of distant players folded into a sound of the same weapon that had just started nearby.
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 MergedSounds = 0;
+
+	// Shots not played because every voice was taken by a closer one.
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 LimitedSounds = 0;
+
+	// Voices stopped early for a closer shot.
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 StolenVoices = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 PlayedMontages = 0;
+
+	// Montages not played because the mesh was not rendered or the montage had only just started.
+	UPROPERTY(BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 SkippedMontages = 0;
+};
+
+USTRUCT()
+struct FOWeaponVoice
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	UAudioComponent* Component = nullptr;
+
+	// World time the voice started playing.
+	float StartTime = 0.0f;
+};
+
+USTRUCT()
+struct FOWeaponVoiceList
+{
+	GENERATED_BODY()
+
+public:
+	UPROPERTY()
+	TArray<FOWeaponVoice> Active;
+
+	UPROPERTY()
+	TArray<UAudioComponent*> Free;
+};
+
+/**
+ * Per-world player of weapon fire effects. Fire sounds play on pooled audio components, limited to MaxVoicesPerSound
+ * per weapon sound and MaxVoices in total: a closer shot takes over the farthest voice, a farther one is dropped.
+ * Shots of players beyond MergeDistance that land within MergeRadius of a voice of the same sound started less than
+ * MergeWindow ago are heard through that voice. Fire montages are skipped on meshes that were not rendered and not
+ * restarted while they have only just started.
+ */
+UCLASS(config = Game, notplaceable)
+class UNREALONLINECPP_API AOWeaponEffects : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	AOWeaponEffects();
+
+	/**
+	 * Returns the weapon effects player of a world.
+	 *
+	 * @param World: world the player lives in.
+	 * @param bCreateIfMissing: spawn a player if the world does not have one yet.
+	 */
+	static AOWeaponEffects* Get(UWorld* World, bool bCreateIfMissing = true);
+
+	/**
+	 * Plays the fire sound of a shot, or folds it into a sound that is already playing.
+	 *
+	 * @param Sound: fire sound of the weapon, voices are limited per sound.
+	 * @param Location: world location of the shot.
+	 * @returns true if the shot can be heard.
+	 */
+	bool PlayFireSound(USoundBase* Sound, const FVector& Location);
+
+	/**
+	 * Plays a fire montage on a mesh unless nobody sees it.
+	 *
+	 * @param Mesh: mesh whose anim instance plays the montage.
+	 * @param Montage: montage to play.
+	 * @returns true if the montage was started.
+	 */
+	bool PlayFireMontage(USkeletalMeshComponent* Mesh, UAnimMontage* Montage);
+
+	// Returns the voice, merge and skip counters of this world.
+	UFUNCTION(BlueprintPure, Category = "Weapon|Effects")
+	FORCEINLINE FOWeaponEffectsStats GetStats() const { return Stats; }
+
+	// Resets every counter but the active voices.
+	UFUNCTION(BlueprintCallable, Category = "Weapon|Effects")
+	void ResetStats();
+
+	void LogStats() const;
+
+	// Returns true if effects go through the pooled player, see o.WeaponEffects.Pooled.
+	static bool IsEnabled();
+
+protected:
+	// Returns voices that finished playing to the pool.
+	virtual void Tick(float DeltaSeconds) override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	// Location the local player hears from, false if there is no local player.
+	bool GetListenerLocation(FVector& OutLocation) const;
+
+	// Stops the voice farther from the listener than Distance that is farthest away, false if there is none.
+	bool StealFarthestVoice(FOWeaponVoiceList* VoiceList, const FVector& ListenerLocation, float Distance);
+
+	void StopVoice(FOWeaponVoiceList& VoiceList, int32 VoiceIdx);
+
+	UAudioComponent* AcquireComponent(FOWeaponVoiceList& VoiceList);
+
+public:
+	// Fire sounds of one weapon sound that may play at the same time.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 MaxVoicesPerSound;
+
+	// Fire sounds of all weapons that may play at the same time.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Weapon|Effects")
+	int32 MaxVoices;
+
+	// Shots closer to the listener than this always get their own voice.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Weapon|Effects")
+	float MergeDistance;
+
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Weapon|Effects")
+	float MergeRadius;
+
+	// Seconds after a voice started during which distant shots are folded into it.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Weapon|Effects")
+	float MergeWindow;
+
+	// Seconds a mesh may have been off screen and still get its fire montage.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Weapon|Effects")
+	float MontageRenderTolerance;
+
+	// Seconds into a running fire montage before another shot restarts it.
+	UPROPERTY(config, EditAnywhere, BlueprintReadOnly, Category = "Weapon|Effects")
+	float MinMontageRestartTime;
+
+private:
+	// Playing and idle audio components, per fire sound.
+	UPROPERTY(Transient)
+	TMap<USoundBase*, FOWeaponVoiceList> Voices;
+
+	FOWeaponEffectsStats Stats;
+};
@@ -1,25 +1,110 @@
 // Copyright (c) 2019 Jasper Drescher.
 
 #include "OWeaponProjectile.h"
+#include "OProjectilePool.h"
+#include "OPlayerCharacter.h"
+#include "../Core/OStats.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+
+O_DECLARE_CYCLE_STAT("Projectile Hit", STAT_OProjectileHit);
 
 // Sets default values
 AOWeaponProjectile::AOWeaponProjectile()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// Projectiles are driven by their movement component, the actor itself never needs to tick
+	PrimaryActorTick.bCanEverTick = false;
+
+	// The server simulates its own projectiles and clients replay shots cosmetically, nothing is replicated per bullet
+	bReplicates = false;
 
+	LifeTime = 3.0f;
+	bIsPooled = false;
+	PredictionKey = 0;
 }
 
 // Called when the game starts or when spawned
 void AOWeaponProjectile::BeginPlay()
 {
 	Super::BeginPlay();
-	
+
+	OnActorHit.AddDynamic(this, &AOWeaponProjectile::OnProjectileHit);
+}
+
+void AOWeaponProjectile::ActivateFromPool(const FVector& Location, const FRotator& Rotation)
+{
+	bIsPooled = false;
+
+	SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+
+	// Restart the movement along the new forward vector, the same way a freshly spawned projectile would
+	UProjectileMovementComponent* ProjectileMovement = FindComponentByClass<UProjectileMovementComponent>();
+	if (ProjectileMovement != nullptr)
+	{
+		ProjectileMovement->SetUpdatedComponent(GetRootComponent());
+		ProjectileMovement->Velocity = GetActorForwardVector() * ProjectileMovement->InitialSpeed;
+		ProjectileMovement->Activate(true);
+		ProjectileMovement->UpdateComponentVelocity();
+	}
+
+	SetLifeSpan(LifeTime);
 }
 
-// Called every frame
-void AOWeaponProjectile::Tick(float DeltaTime)
+void AOWeaponProjectile::DeactivateToPool()
 {
-	Super::Tick(DeltaTime);
+	bIsPooled = true;
+	PredictionKey = 0;
+
+	// Clears the lifetime timer
+	SetLifeSpan(0.0f);
+
+	UProjectileMovementComponent* ProjectileMovement = FindComponentByClass<UProjectileMovementComponent>();
+	if (ProjectileMovement != nullptr)
+	{
+		ProjectileMovement->StopMovementImmediately();
+		ProjectileMovement->Deactivate();
+	}
+
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(false);
+}
+
+void AOWeaponProjectile::Recycle()
+{
+	if (bIsPooled)
+	{
+		return;
+	}
+
+	AOProjectilePool* ProjectilePool = AOProjectilePool::Get(GetWorld(), false);
+	if (ProjectilePool != nullptr)
+	{
+		ProjectilePool->Release(this);
+	}
+	else
+	{
+		Destroy();
+	}
+}
+
+void AOWeaponProjectile::LifeSpanExpired()
+{
+	Recycle();
+}
+
+void AOWeaponProjectile::OnProjectileHit(AActor* SelfActor, AActor* OtherActor, FVector NormalImpulse, const FHitResult& Hit)
+{
+	O_SCOPE_CYCLE_COUNTER(STAT_OProjectileHit);
+
+	// Only the shooter's own machine reports hits, the server decides whether they count
+	AOPlayerCharacter* Shooter = Cast<AOPlayerCharacter>(Instigator);
+	AOPlayerCharacter* Target = Cast<AOPlayerCharacter>(OtherActor);
+	if (Shooter != nullptr && Target != nullptr && Shooter->IsLocallyControlled())
+	{
+		Shooter->ReportHit(Target, Hit, PredictionKey);
+	}
 
+	Recycle();
 }
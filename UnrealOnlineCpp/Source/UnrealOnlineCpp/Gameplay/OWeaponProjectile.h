@@ -10,17 +10,54 @@ UCLASS()
 class UNREALONLINECPP_API AOWeaponProjectile : public AActor
 {
 	GENERATED_BODY()
-	
-public:	
+
+public:
 	// Sets default values for this actor's properties
 	AOWeaponProjectile();
 
+	/**
+	 * Wakes up a pooled projectile at the given transform and starts its lifetime.
+	 *
+	 * @param Location: world location to fire from.
+	 * @param Rotation: world rotation to fire along.
+	 */
+	void ActivateFromPool(const FVector& Location, const FRotator& Rotation);
+
+	// Puts the projectile to sleep: hidden, no collision, no movement and no ticking.
+	void DeactivateToPool();
+
+	// Returns the projectile to the pool of its world, or destroys it if there is none.
+	UFUNCTION(BlueprintCallable, Category = Projectile)
+	void Recycle();
+
+	// Returns true while the projectile is sleeping in a pool.
+	FORCEINLINE bool IsPooled() const { return bIsPooled; }
+
+	// Returns the key of the owning client's shot this projectile flies for on that client, 0 for every other projectile.
+	FORCEINLINE uint16 GetPredictionKey() const { return PredictionKey; }
+
+	FORCEINLINE void SetPredictionKey(uint16 InPredictionKey) { PredictionKey = InPredictionKey; }
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
-public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	// Recycles instead of destroying once LifeTime has run out.
+	virtual void LifeSpanExpired() override;
+
+	// Recycles the projectile on its first blocking hit.
+	UFUNCTION()
+	void OnProjectileHit(AActor* SelfActor, AActor* OtherActor, FVector NormalImpulse, const FHitResult& Hit);
+
+public:
+	// Seconds the projectile stays alive before it is recycled.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = Projectile)
+	float LifeTime;
+
+private:
+	// True while the projectile is sleeping in a pool.
+	bool bIsPooled;
 
+	// Pooled projectiles get reused, the key tells whether this one still flies for a given shot
+	uint16 PredictionKey;
 };
@@ -8,7 +8,10 @@ public class UnrealOnlineCpp : ModuleRules
 	{
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
-		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "OnlineSubsystem", "OnlineSubsystemUtils", "Steamworks" });
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "OnlineSubsystem", "OnlineSubsystemUtils", "Steamworks", "ReplicationGraph", "Sockets", "EngineSettings" });
         DynamicallyLoadedModuleNames.Add("OnlineSubsystemSteam");
+
+        // Simulated clients of load tests use their own Null subsystem instances
+        DynamicallyLoadedModuleNames.Add("OnlineSubsystemNull");
     }
 }